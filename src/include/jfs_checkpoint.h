@@ -0,0 +1,40 @@
+#ifndef JOINFS_JFS_CHECKPOINT_H
+#define JOINFS_JFS_CHECKPOINT_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#include "thr_pool.h"
+
+/*!
+ * Start the WAL checkpointer.
+ *
+ * The checkpointer runs passive checkpoints on its own
+ * connection whenever the write pool is idle.
+ * \param write_pool The pool performing database writes.
+ * \return Error code or 0.
+ */
+int jfs_checkpoint_start(thr_pool_t *write_pool);
+
+/*!
+ * Stop the WAL checkpointer and wait for it to exit.
+ */
+void jfs_checkpoint_stop(void);
+
+#endif
@@ -20,8 +20,25 @@
  * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
  ********************************************************************/
 
+#include <sys/types.h>
+
+/*!
+ * Data path cache counters.
+ */
+struct jfs_datapath_cache_stats {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  size_t        entries;
+  size_t        bytes;
+};
+
 /*!
  * Initialize the joinFS data path cache.
+ *
+ * The cache is split into shards with their own locks, and
+ * evicts least recently used paths once it holds more than
+ * the datapath_cache mount option allows.
  */
 void jfs_datapath_cache_init();
 
@@ -31,10 +48,16 @@ void jfs_datapath_cache_init();
 void jfs_datapath_cache_destroy();
 
 /*!
- * Log the contents of the data path cache.
+ * Log the counters and contents of the data path cache.
  */
 void jfs_datapath_cache_log();
 
+/*!
+ * Read the data path cache counters.
+ * \param stats Where the counters are returned.
+ */
+void jfs_datapath_cache_get_stats(struct jfs_datapath_cache_stats *stats);
+
 /*!
  * Add a path to the data path cache.
  * \param jfs_id The joinFS ID for the data path.
@@ -58,6 +81,15 @@ int jfs_datapath_cache_remove(int jfs_id);
  */
 int jfs_datapath_cache_get_datapath(int jfs_id, char **datapath);
 
+/*!
+ * Copy a data path from the data path cache into a buffer.
+ * \param jfs_id The joinFS ID for the data path.
+ * \param buf Where the data path is returned.
+ * \param size The size of buf.
+ * \return Error code or 0.
+ */
+int jfs_datapath_cache_copy_datapath(int jfs_id, char *buf, size_t size);
+
 /*!
  * Add a path to the data path cache.
  * \param jfs_id The old joinFS ID for the data path.
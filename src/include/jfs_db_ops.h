@@ -35,4 +35,26 @@ enum jfs_db_ops {
   jfs_dynamic_file_op
 };
 
+/*!
+ * Enumerator for the fixed set of joinFS statements
+ * that are prepared once and cached by each pool worker.
+ */
+enum jfs_db_stmts {
+  jfs_link_insert_stmt,
+  jfs_meta_lookup_stmt,
+  jfs_keyid_lookup_stmt,
+  jfs_listattr_stmt,
+  jfs_unlink_meta_stmt,
+  jfs_unlink_link_stmt,
+  jfs_rename_link_stmt,
+  jfs_rename_meta_stmt,
+  jfs_meta_create_stmt,
+  jfs_meta_replace_stmt,
+  jfs_meta_set_stmt,
+  jfs_meta_remove_stmt,
+  jfs_key_insert_stmt,
+  jfs_datapath_lookup_stmt,
+  jfs_num_stmts
+};
+
 #endif
@@ -20,9 +20,21 @@
  * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
  ********************************************************************/
 
-#include <fuse.h>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+
+/*!
+ * Adds one directory entry, shaped like the FUSE 2 filler so
+ * either FUSE backend can collect a listing.
+ * \param buf The listing being filled.
+ * \param name The entry name.
+ * \param stbuf The entry attributes, only the type and inode are required.
+ * \param off The offset of the next entry, 0 to list in one pass.
+ * \return 1 if the listing is full, 0 otherwise.
+ */
+typedef int (*jfs_fill_dir_t)(void *buf, const char *name,
+                              const struct stat *stbuf, off_t off);
 
 /*!
  * Makes a joinFS directory.
@@ -52,9 +64,9 @@ int jfs_dir_opendir(const char *path, DIR **d);
  * \param path The directory path.
  * \param dp The directory entry.
  * \param buf The readdir buffer.
- * \param filler The fuse directory filling function.
+ * \param filler The directory filling function.
  * \return Error code or 0.
  */
-int jfs_dir_readdir(const char *path, DIR *dp, void *buf, fuse_fill_dir_t filler);
+int jfs_dir_readdir(const char *path, DIR *dp, void *buf, jfs_fill_dir_t filler);
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef JOINFS_JFS_DIR_PLAN_H
+#define JOINFS_JFS_DIR_PLAN_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+/*!
+ * A dynamic folder constraint, files must have the key
+ * and, if a value is given, the key must hold that value.
+ */
+struct jfs_dir_term {
+  int         keyid;
+  const char *value;
+};
+
+/*!
+ * Plan the SQL for a dynamic folder.
+ *
+ * All terms are joined on metadata in a single pass, driven
+ * by the metadata(keyid, keyvalue) index. Duplicate terms are
+ * only joined once.
+ * \param terms The folder's constraints.
+ * \param num_terms The number of constraints.
+ * \param folder_keyid The key whose values are listed as folders, 0 to list files.
+ * \param query The returned SQL query, must be freed.
+ * \return Error code or 0.
+ */
+int jfs_dir_plan_query(const struct jfs_dir_term *terms, int num_terms, 
+                       int folder_keyid, char **query);
+
+#endif
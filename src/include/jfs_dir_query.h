@@ -26,8 +26,11 @@
  * \param realpath The real file system directory path.
  * \param is_folders Return value that specifies whether or not the query results should be folders.
  * \param query The returned SQL query.
+ * \param keyids The returned keys the query reads, must be freed.
+ * \param num_keyids The returned number of keys.
  * \return Error code or 0.
  */
-int jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, char **query);
+int jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, char **query,
+                          int **keyids, int *num_keyids);
 
 #endif
@@ -20,12 +20,26 @@
  * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
  ********************************************************************/
 
+#include <sys/types.h>
+
 /*!
  * Initialize the dynamic path hierarchy.
  * \return Error code or 0.
  */
 int jfs_dynamic_path_init(void);
 
+/*!
+ * Resolves a dynamic path into a caller provided buffer.
+ *
+ * Does not allocate. Pass a NULL buffer to only test the path.
+ * \param path The joinfs path.
+ * \param buf Returns the real file system path.
+ * \param size The size of buf.
+ * \param jfs_id Returns the joinFS ID for the file system item.
+ * \return Error code or 0.
+ */
+int jfs_dynamic_path_resolve(const char *path, char *buf, size_t size, int *jfs_id);
+
 /*!
  * Resolves a dynamic path into a datapath.
  * \param path The joinfs path.
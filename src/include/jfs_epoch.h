@@ -0,0 +1,64 @@
+#ifndef JOINFS_JFS_EPOCH_H
+#define JOINFS_JFS_EPOCH_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+/*!
+ * Initialize epoch based reclamation.
+ *
+ * Readers announce the epoch they start in, and memory retired by
+ * writers is only freed once every reader has moved two epochs past
+ * the retirement.
+ * \return Error code or 0.
+ */
+int jfs_epoch_init(void);
+
+/*!
+ * Free everything still waiting to be reclaimed.
+ *
+ * No readers may be active.
+ */
+void jfs_epoch_destroy(void);
+
+/*!
+ * Start a read side critical section.
+ *
+ * Pointers loaded after this call stay valid until jfs_epoch_exit.
+ * \return 0, or -EAGAIN if every reader slot is taken, in which
+ * case the caller must exclude writers some other way.
+ */
+int jfs_epoch_enter(void);
+
+/*!
+ * End a read side critical section.
+ */
+void jfs_epoch_exit(void);
+
+/*!
+ * Free memory once no reader can still hold a pointer to it.
+ *
+ * The memory must already be unreachable for new readers.
+ * \param ptr The memory being retired.
+ * \param free_fn Called on ptr when it is safe to free.
+ * \return Error code or 0.
+ */
+int jfs_epoch_retire(void *ptr, void (*free_fn)(void *));
+
+#endif
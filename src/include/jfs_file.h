@@ -20,7 +20,9 @@
 #ifndef JOINFS_JFS_FILE_H
 #define JOINFS_JFS_FILE_H
 
-#include <fuse.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/time.h>
 
 /*!
@@ -80,6 +82,14 @@ int jfs_file_getattr(const char *path, struct stat *stbuf);
  */
 int jfs_file_utimes(const char *path, const struct timeval tv[2]);
 
+/*!
+ * Set access and modification times with nanosecond precision.
+ * \param path The system path.
+ * \param ts The times, UTIME_NOW or UTIME_OMIT as for utimensat.
+ * \return Error code or 0.
+ */
+int jfs_file_utimens(const char *path, const struct timespec ts[2]);
+
 /*!
  * Get the file system attribute buffer.
  * \param path The system path.
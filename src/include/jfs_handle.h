@@ -0,0 +1,99 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_HANDLE_H
+#define JOINFS_JFS_HANDLE_H
+
+#include <pthread.h>
+
+#define JFS_HANDLE_BUCKETS 1024
+#define JFS_HANDLE_STRIPES 64
+
+/*!
+ * The head of a per file handle record, keyed by the
+ * backing file descriptor. Records embed it as their first member.
+ */
+struct jfs_handle {
+  struct jfs_handle *next;
+  int                fd;
+};
+
+/*!
+ * A table of per file handle records with striped locks.
+ */
+struct jfs_handle_table {
+  struct jfs_handle *buckets[JFS_HANDLE_BUCKETS];
+  pthread_mutex_t    locks[JFS_HANDLE_STRIPES];
+};
+
+/*!
+ * Initialize an empty handle table.
+ * \param table The table.
+ */
+void jfs_handle_table_init(struct jfs_handle_table *table);
+
+/*!
+ * Destroy a handle table, every record must be removed already.
+ * \param table The table.
+ */
+void jfs_handle_table_destroy(struct jfs_handle_table *table);
+
+/*!
+ * Get the lock covering a file descriptor's records.
+ * \param table The table.
+ * \param fd The backing file descriptor.
+ * \return The lock to hold around find, insert and remove.
+ */
+pthread_mutex_t *jfs_handle_lock(struct jfs_handle_table *table, int fd);
+
+/*!
+ * Find the record of a file descriptor, the caller holds its lock.
+ * \param table The table.
+ * \param fd The backing file descriptor.
+ * \return The record or NULL.
+ */
+struct jfs_handle *jfs_handle_find(struct jfs_handle_table *table, int fd);
+
+/*!
+ * Add a record, the caller holds the lock of its fd.
+ * \param table The table.
+ * \param handle The record, with fd set.
+ */
+void jfs_handle_insert(struct jfs_handle_table *table, struct jfs_handle *handle);
+
+/*!
+ * Take the record of a file descriptor out of the table,
+ * the caller holds its lock.
+ * \param table The table.
+ * \param fd The backing file descriptor.
+ * \return The record, to be freed by the caller, or NULL.
+ */
+struct jfs_handle *jfs_handle_remove(struct jfs_handle_table *table, int fd);
+
+/*!
+ * Call fn on every record, holding the lock that covers it.
+ * \param table The table.
+ * \param fn The function to call.
+ * \param arg Passed through to fn.
+ */
+void jfs_handle_table_foreach(struct jfs_handle_table *table,
+                              void (*fn)(struct jfs_handle *handle, void *arg),
+                              void *arg);
+
+#endif
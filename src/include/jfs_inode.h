@@ -0,0 +1,98 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_INODE_H
+#define JOINFS_JFS_INODE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JFS_INODE_ROOT 1
+
+/*!
+ * Initialize the inode table of the low-level backend.
+ *
+ * Node ids are handed to the kernel on lookup and stay valid until
+ * the kernel forgets them. Each node remembers its parent and name,
+ * so its path is rebuilt by walking up instead of parsing strings.
+ * \return Error code or 0.
+ */
+int jfs_inode_init(void);
+
+/*!
+ * Free every node.
+ */
+void jfs_inode_destroy(void);
+
+/*!
+ * Get the full path of a node in the query directory.
+ * \param ino The node id.
+ * \param buf Returns the path.
+ * \param size The size of buf.
+ * \return Error code or 0, -ENOENT if the node was unlinked.
+ */
+int jfs_inode_path(uint64_t ino, char *buf, size_t size);
+
+/*!
+ * Get the full path of a name in a directory node.
+ * \param parent The directory node id.
+ * \param name The entry name.
+ * \param buf Returns the path.
+ * \param size The size of buf.
+ * \return Error code or 0.
+ */
+int jfs_inode_child_path(uint64_t parent, const char *name, char *buf, size_t size);
+
+/*!
+ * Find or create the node for a name and count a kernel reference.
+ * \param parent The directory node id.
+ * \param name The entry name.
+ * \param ino Returns the node id.
+ * \return Error code or 0.
+ */
+int jfs_inode_lookup(uint64_t parent, const char *name, uint64_t *ino);
+
+/*!
+ * Drop kernel references, freeing the node once none are left.
+ * \param ino The node id.
+ * \param nlookup The number of references dropped.
+ */
+void jfs_inode_forget(uint64_t ino, uint64_t nlookup);
+
+/*!
+ * Detach a removed name from its node.
+ *
+ * Open handles keep working, but the node no longer has a path.
+ * \param parent The directory node id.
+ * \param name The removed entry name.
+ */
+void jfs_inode_unlink(uint64_t parent, const char *name);
+
+/*!
+ * Move a node to its new name after a rename.
+ * \param parent The old directory node id.
+ * \param name The old entry name.
+ * \param newparent The new directory node id.
+ * \param newname The new entry name.
+ * \return Error code or 0.
+ */
+int jfs_inode_rename(uint64_t parent, const char *name,
+                     uint64_t newparent, const char *newname);
+
+#endif
@@ -22,6 +22,9 @@
 
 /*!
  * Initialize the key cache.
+ *
+ * The whole keys table is loaded when the database is set up, so
+ * after mount the cache is the authority on which keys exist.
  */
 void jfs_key_cache_init();
 
@@ -31,9 +34,9 @@ void jfs_key_cache_init();
 void jfs_key_cache_destroy();
 
 /*!
- * Get a kyeid from the key cache.
+ * Get a keyid from the key cache without locking.
  * \param keytext The metadata tag name.
- * \return Error code or 0.
+ * \return The keyid, or -ENOATTR if the key is not cached.
  */
 int jfs_key_cache_get_keyid(const char *keytext);
 
@@ -0,0 +1,35 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_LOWLEVEL_H
+#define JOINFS_JFS_LOWLEVEL_H
+
+struct fuse_args;
+
+/*!
+ * Mount joinFS through the FUSE 3 low-level API and serve requests.
+ *
+ * The kernel addresses files by node id, the jfs_inode table turns
+ * them back into query paths for the rest of joinFS.
+ * \param args The FUSE arguments, mount point included.
+ * \return Error code or 0.
+ */
+int jfs_lowlevel_main(struct fuse_args *args);
+
+#endif
@@ -20,10 +20,26 @@
  * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
  ********************************************************************/
 
+#include <sys/types.h>
+
+/*!
+ * Metadata cache counters.
+ */
+struct jfs_meta_cache_stats {
+  unsigned long hits;
+  unsigned long negative_hits;
+  unsigned long misses;
+  unsigned long evictions;
+  size_t        paths;
+  size_t        bytes;
+};
+
 /*!
  * Initialize the jfs_meta_cache.
  *
- * Called when joinFS gets mounted.
+ * Called when joinFS gets mounted. Least recently used paths
+ * are evicted once the cache holds more than the meta_cache
+ * mount option allows.
  */
 void jfs_meta_cache_init();
 
@@ -34,24 +50,55 @@ void jfs_meta_cache_init();
  */
 void jfs_meta_cache_destroy();
 
+/*!
+ * Read the metadata cache counters.
+ * \param stats Where the counters are returned.
+ */
+void jfs_meta_cache_get_stats(struct jfs_meta_cache_stats *stats);
+
 /*!
  * Get metadata stored in the metadata cache.
  * \param path The file system path.
  * \param keyid The metadata tag id.
  * \param value The value returned.
- * \return Error code or 0.
+ * \return 0, -ENOATTR if the path is known to lack the key,
+ * -ENOENT if nothing is cached, or another error code.
  */
 int jfs_meta_cache_get_value(const char *path, int keyid, char **value);
 
 /*!
- * Add metadata to the metadata cache.
+ * Add metadata written by this process to the metadata cache.
  * \param path The file system path.
  * \param keyid The metadata tag id.
- * \param value The metadata value.
+ * \param value The metadata value, NULL if the path lacks the key.
  * \return Error code or 0.
  */
 int jfs_meta_cache_add(const char *path, int keyid, const char *value);
 
+/*!
+ * Get the write generation covering a path.
+ *
+ * Take it before reading the database, and pass it
+ * to jfs_meta_cache_fill with what was read.
+ * \param path The file system path.
+ * \return The generation.
+ */
+unsigned long jfs_meta_cache_generation(const char *path);
+
+/*!
+ * Add metadata read from the database to the metadata cache.
+ *
+ * Nothing is added if the path was written since the
+ * generation was taken.
+ * \param path The file system path.
+ * \param keyid The metadata tag id.
+ * \param value The metadata value, NULL if the path lacks the key.
+ * \param generation From jfs_meta_cache_generation.
+ * \return Error code or 0.
+ */
+int jfs_meta_cache_fill(const char *path, int keyid, const char *value,
+                        unsigned long generation);
+
 /*!
  * Remove an item the metadata cache.
  * \param path The file system path.
@@ -60,4 +107,11 @@ int jfs_meta_cache_add(const char *path, int keyid, const char *value);
  */
 int jfs_meta_cache_remove(const char *path, int keyid);
 
+/*!
+ * Remove everything cached for a path.
+ * \param path The file system path.
+ * \return Error code or 0.
+ */
+int jfs_meta_cache_remove_path(const char *path);
+
 #endif
@@ -0,0 +1,69 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_PAGE_CACHE_H
+#define JOINFS_JFS_PAGE_CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*!
+ * Initialize page cache tracking.
+ *
+ * Remembers the size and mtime of every backing file the kernel
+ * may hold pages for, so an open can keep those pages when the
+ * file did not change behind the mount. The kernel caches pages
+ * per FUSE node, and a backing file is reachable through its static
+ * path and any number of dynamic ones, so versions are kept per node.
+ * \return Error code or 0.
+ */
+int jfs_page_cache_init(void);
+
+/*!
+ * Destroy page cache tracking.
+ */
+void jfs_page_cache_destroy(void);
+
+/*!
+ * Get the node key of a path, for the high level API where
+ * every path is its own FUSE node.
+ * \param path The path relative to the mount.
+ * \return The node key.
+ */
+unsigned long long jfs_page_cache_node(const char *path);
+
+/*!
+ * Should an open keep the kernel's cached pages?
+ *
+ * Records the file version either way.
+ * \param node The FUSE node the file was opened through.
+ * \param st The attributes of the opened backing file.
+ * \return 1 if the file is unchanged since the node last saw it, 0 if not.
+ */
+int jfs_page_cache_keep(unsigned long long node, const struct stat *st);
+
+/*!
+ * Record the version of a backing file the kernel has cached
+ * for a node, after writes through that node changed it.
+ * \param node The FUSE node the file was written through.
+ * \param st The attributes of the backing file.
+ */
+void jfs_page_cache_update(unsigned long long node, const struct stat *st);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef JOINFS_JFS_PENDING_H
+#define JOINFS_JFS_PENDING_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#include "jfs_db_ops.h"
+
+#include <stddef.h>
+
+/*!
+ * Initialize the pending write overlay.
+ *
+ * Called when joinFS gets mounted.
+ */
+void jfs_pending_init(void);
+
+/*!
+ * Destroy the pending write overlay.
+ *
+ * Called when joinFS gets dismounted, after a final flush.
+ */
+void jfs_pending_destroy(void);
+
+/*!
+ * Queue a link insert without waiting for it to commit.
+ * \param inode The file's inode.
+ * \param path The file system path.
+ * \param filename The file name.
+ * \return Error code or 0.
+ */
+int jfs_pending_link_add(int inode, const char *path, const char *filename);
+
+/*!
+ * Queue a metadata write without waiting for it to commit.
+ *
+ * Until the write commits, the value is visible through
+ * jfs_pending_meta_get.
+ * \param stmt_id The cached statement that performs the write.
+ * \param path The file system path.
+ * \param keyid The metadata tag id.
+ * \param value The metadata value, NULL for a remove.
+ * \param size The value size in bytes.
+ * \return Error code or 0.
+ */
+int jfs_pending_meta_write(enum jfs_db_stmts stmt_id, const char *path, int keyid,
+                           const char *value, size_t size);
+
+/*!
+ * Get a metadata value that has not been committed yet.
+ * \param path The file system path.
+ * \param keyid The metadata tag id.
+ * \param value The value returned, must be freed.
+ * \return 0, -ENOATTR for a pending remove or -ENOENT if nothing is pending.
+ */
+int jfs_pending_meta_get(const char *path, int keyid, char **value);
+
+/*!
+ * Wait for the writes queued before the call to commit.
+ */
+void jfs_pending_wait(void);
+
+/*!
+ * Wait for the writes queued before the call to commit and
+ * sync the database file.
+ * \param path The file system path to report failures for, NULL for all.
+ * \return -EIO if a queued write for the path failed since its last flush, or 0.
+ */
+int jfs_pending_flush(const char *path);
+
+#endif
@@ -0,0 +1,55 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_PREFETCH_H
+#define JOINFS_JFS_PREFETCH_H
+
+#include <sys/types.h>
+
+/*!
+ * Initialize sequential read detection.
+ *
+ * A file handle read in order gets its backing file read ahead
+ * with posix_fadvise, in a window that doubles while the stream
+ * lasts. Direct I/O leaves the kernel no chance to do this itself.
+ * \param max_window The largest window in bytes, 0 turns it off.
+ * \return Error code or 0.
+ */
+int jfs_prefetch_init(size_t max_window);
+
+/*!
+ * Destroy sequential read detection, every handle must be closed already.
+ */
+void jfs_prefetch_destroy(void);
+
+/*!
+ * Note a read on a file handle, prefetching if it continues a stream.
+ * \param fd The backing file of the handle.
+ * \param offset The offset of the read.
+ * \param size The length of the read.
+ */
+void jfs_prefetch_read(int fd, off_t offset, size_t size);
+
+/*!
+ * Forget a file handle before it is closed.
+ * \param fd The backing file of the handle.
+ */
+void jfs_prefetch_release(int fd);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef JOINFS_JFS_QUERY_CACHE_H
+#define JOINFS_JFS_QUERY_CACHE_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#include "jfs_list.h"
+
+/*!
+ * Initialize the dynamic folder query cache.
+ *
+ * Called when joinFS gets mounted.
+ */
+void jfs_query_cache_init(void);
+
+/*!
+ * Destroy the dynamic folder query cache.
+ *
+ * Called when joinFS gets dismounted.
+ */
+void jfs_query_cache_destroy(void);
+
+/*!
+ * Get the cache generation.
+ *
+ * Read it before running a query and pass it to
+ * jfs_query_cache_add, so results that raced with a
+ * write are not cached.
+ * \return The current generation.
+ */
+unsigned long jfs_query_cache_generation(void);
+
+/*!
+ * Get a copy of the cached result of a query.
+ * \param query The dynamic folder query.
+ * \param result The returned readdir result list, must be destroyed.
+ * \return Error code, -ENOENT on a miss, or 0.
+ */
+int jfs_query_cache_get(const char *query, jfs_list_t **result);
+
+/*!
+ * Cache a copy of the result of a query.
+ * \param query The dynamic folder query.
+ * \param keyids The keys the query reads.
+ * \param num_keyids The number of keys.
+ * \param generation The cache generation from before the query ran.
+ * \param result The readdir result list.
+ * \return Error code or 0.
+ */
+int jfs_query_cache_add(const char *query, const int *keyids, int num_keyids,
+                        unsigned long generation, jfs_list_t *result);
+
+/*!
+ * Drop every cached result that reads a key.
+ * \param keyid The metadata tag id that changed.
+ */
+void jfs_query_cache_invalidate_key(int keyid);
+
+/*!
+ * Drop every cached result.
+ *
+ * Called when links are removed or renamed.
+ */
+void jfs_query_cache_invalidate_all(void);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef JOINFS_JFS_SCHEMA_H
+#define JOINFS_JFS_SCHEMA_H
+
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#include <sqlite3.h>
+
+/*!
+ * Bring the database schema up to date.
+ *
+ * The schema version is kept in PRAGMA user_version, each
+ * migration runs in its own transaction.
+ * \param db A read write database connection.
+ * \return Error code or 0.
+ */
+int jfs_schema_migrate(sqlite3 *db);
+
+#endif
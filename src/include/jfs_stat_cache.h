@@ -0,0 +1,101 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_STAT_CACHE_H
+#define JOINFS_JFS_STAT_CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*!
+ * Stat cache counters.
+ */
+struct jfs_stat_cache_stats {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long expired;
+};
+
+/*!
+ * Initialize the stat cache.
+ *
+ * Paths that exist in the query directory are cached on getattr,
+ * dynamic entries when their folder is listed. Entries expire after the
+ * stat_timeout mount option, 0 turns the cache off.
+ * \return Error code or 0.
+ */
+int jfs_stat_cache_init(void);
+
+/*!
+ * Destroy the stat cache.
+ */
+void jfs_stat_cache_destroy(void);
+
+/*!
+ * Read the stat cache counters.
+ * \param stats Where the counters are returned.
+ */
+void jfs_stat_cache_get_stats(struct jfs_stat_cache_stats *stats);
+
+/*!
+ * Get the cached attributes of a path.
+ * \param path The full path in the query directory.
+ * \param stbuf Where the attributes are returned.
+ * \return 0, or -ENOENT if nothing valid is cached.
+ */
+int jfs_stat_cache_get(const char *path, struct stat *stbuf);
+
+/*!
+ * Get the invalidation generation covering a path.
+ *
+ * Take it before calling lstat, so a fill can tell the
+ * attributes were changed while it was reading them.
+ * \param path The full path in the query directory.
+ * \return The current generation.
+ */
+unsigned long jfs_stat_cache_generation(const char *path);
+
+/*!
+ * Cache the attributes of a path read from disk.
+ * \param path The full path in the query directory.
+ * \param stbuf The attributes.
+ * \param generation The generation taken before the attributes were read.
+ */
+void jfs_stat_cache_fill(const char *path, const struct stat *stbuf,
+                         unsigned long generation);
+
+/*!
+ * Drop the cached attributes of a path.
+ * \param path The full path in the query directory.
+ */
+void jfs_stat_cache_remove(const char *path);
+
+/*!
+ * Drop the cached attributes of a path and its parent directory,
+ * for operations that add or remove directory entries.
+ * \param path The full path in the query directory.
+ */
+void jfs_stat_cache_remove_dirent(const char *path);
+
+/*!
+ * Drop every cached attribute, for renames that move whole trees.
+ */
+void jfs_stat_cache_invalidate_all(void);
+
+#endif
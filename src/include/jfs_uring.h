@@ -0,0 +1,99 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_URING_H
+#define JOINFS_JFS_URING_H
+
+#include <sys/types.h>
+
+/*!
+ * Data operations the submission engine runs.
+ */
+enum jfs_uring_op {
+  jfs_uring_op_read,
+  jfs_uring_op_write,
+  jfs_uring_op_fsync,
+  jfs_uring_op_fdatasync
+};
+
+/*!
+ * One data operation.
+ *
+ * Owned by the caller until done is called, usually from the
+ * completion thread. res is the byte count or an error code.
+ */
+struct jfs_uring_req {
+  enum jfs_uring_op op;
+  int               fd;
+  void             *buf;
+  size_t            len;
+  off_t             offset;
+  void            (*done)(struct jfs_uring_req *req, ssize_t res);
+};
+
+/*!
+ * Start the submission engine.
+ *
+ * Without io_uring, built without HAVE_LIBURING or refused by
+ * the kernel, operations run synchronously in the caller.
+ * \param entries The submission queue depth, also the most operations in flight.
+ * \return Error code or 0.
+ */
+int jfs_uring_init(unsigned entries);
+
+/*!
+ * Wait for the completion thread and tear the ring down,
+ * nothing may be in flight.
+ */
+void jfs_uring_destroy(void);
+
+/*!
+ * Is io_uring serving the operations?
+ * \return 1 if it is, 0 for the blocking fallback.
+ */
+int jfs_uring_enabled(void);
+
+/*!
+ * Queue an operation, done is called once it finishes.
+ *
+ * Waits for a slot while the ring holds its depth of operations.
+ * \param req The operation.
+ */
+void jfs_uring_submit(struct jfs_uring_req *req);
+
+/*!
+ * Read through the engine and wait for the result.
+ * \return The bytes read or an error code.
+ */
+ssize_t jfs_uring_pread(int fd, void *buf, size_t len, off_t offset);
+
+/*!
+ * Write through the engine and wait for the result.
+ * \return The bytes written or an error code.
+ */
+ssize_t jfs_uring_pwrite(int fd, const void *buf, size_t len, off_t offset);
+
+/*!
+ * Sync a file through the engine and wait for the result.
+ * \param datasync Only sync the data, as fdatasync does.
+ * \return Error code or 0.
+ */
+int jfs_uring_fsync(int fd, int datasync);
+
+#endif
@@ -21,6 +21,8 @@
  ********************************************************************/
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <limits.h>
 
 /*!
  * Get the inode number associated with a path.
@@ -39,18 +41,39 @@ int jfs_util_get_inode(const char *path);
 int jfs_util_get_inode_and_mode(const char *path, int *inode, mode_t *mode);
 
 /*!
- * Does the path exist on the file system?
- * \param path The system path.
- * \return 1 if it exists, 0 if it does not.
+ * How a joinFS path maps onto the file system.
+ */
+enum jfs_path_type {
+  jfs_path_missing,
+  jfs_path_static,
+  jfs_path_dynamic
+};
+
+/*!
+ * A classified joinFS path.
  */
-int jfs_util_is_realpath(const char *path);
+struct jfs_path_info {
+  enum jfs_path_type type;
+
+  int jfs_id;
+  int has_stat;
+
+  struct stat st;
+  char datapath[PATH_MAX];
+};
 
 /*!
- * Is the path a dynamic path?
+ * Classify a path as static, dynamic or missing.
+ *
+ * Static paths exist in the query directory and are their own
+ * datapath. Dynamic paths resolve through the dynamic hierarchy,
+ * with st filled in when their datapath exists. Costs one lstat
+ * for a static path and at most two otherwise.
  * \param path The system path.
- * \return 1 if dynamic, 0 if not
+ * \param info Returns the type, datapath and attributes.
+ * \return Error code or 0, -ENOENT if the path is missing.
  */
-int jfs_util_is_path_dynamic(const char *path);
+int jfs_util_classify_path(const char *path, struct jfs_path_info *info);
 
 /*!
  * Get the datapath associated with a path.
@@ -107,6 +130,13 @@ int jfs_util_change_filename(const char *path, const char *filename, char **newp
  */
 int jfs_util_get_keyid(const char *key);
 
+/*!
+ * Returns the id for a metadata tag only if it already exists.
+ * \param key The metadata tag name.
+ * \return -ENOATTR if the tag is unknown or the metadata tag id.
+ */
+int jfs_util_find_keyid(const char *key);
+
 /*!
  * Remove the last path item from a path.
  * \param path The system path.
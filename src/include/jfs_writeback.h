@@ -0,0 +1,74 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#ifndef JOINFS_JFS_WRITEBACK_H
+#define JOINFS_JFS_WRITEBACK_H
+
+#include <sys/types.h>
+
+/*!
+ * Initialize write coalescing.
+ *
+ * Sequential writes to an open file are gathered in memory and
+ * reach the backing file as one large write. Other file handles
+ * see the data once it is flushed, on flush, fsync or release.
+ * \param size The buffer size of each file handle in bytes.
+ * \return Error code or 0.
+ */
+int jfs_writeback_init(size_t size);
+
+/*!
+ * Destroy write coalescing, every handle must be closed already.
+ */
+void jfs_writeback_destroy(void);
+
+/*!
+ * Write through the buffer of a file handle.
+ * \param fd The backing file of the handle.
+ * \param buf The data.
+ * \param size The length of the data.
+ * \param offset The file offset of the data.
+ * \return The bytes written or an error code.
+ */
+ssize_t jfs_writeback_write(int fd, const char *buf, size_t size, off_t offset);
+
+/*!
+ * Write out anything buffered for a file handle.
+ * \param fd The backing file of the handle.
+ * \return Error code or 0, including errors of earlier buffered writes.
+ */
+int jfs_writeback_flush(int fd);
+
+/*!
+ * Write out the buffers of every handle open on a file, so
+ * attributes read by path include the buffered writes.
+ * \param dev The device of the backing file.
+ * \param ino The inode of the backing file.
+ * \return 1 if buffered data was written out, or 0.
+ */
+int jfs_writeback_flush_file(dev_t dev, ino_t ino);
+
+/*!
+ * Flush and free the buffer of a file handle before it is closed.
+ * \param fd The backing file of the handle.
+ * \return Error code or 0.
+ */
+int jfs_writeback_release(int fd);
+
+#endif
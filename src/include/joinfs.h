@@ -42,10 +42,57 @@ struct jfs_context {
 
   thr_pool_t *read_pool;
   thr_pool_t *write_pool;
+
+  int async_writes;
+
+  int wal;
+  int wal_autocheckpoint;
+  long long mmap_size;
+  int cache_size;
+
+  int datapath_cache_kb;
+  int meta_cache_kb;
+
+  int stat_timeout_ms;
+  double attr_timeout;
+  double entry_timeout;
+
+  int page_cache;
+  int max_write;
+  int max_readahead;
+
+  int writeback;
+  int writeback_size;
+
+  int uring;
+  int prefetch_max;
 };
 
 extern struct jfs_context joinfs_context;
 
+struct fuse_file_info;
+
+/*!
+ * Start the caches, the database and the thread pools.
+ *
+ * Called by either FUSE backend once the file system is mounted.
+ * \param proto_major The FUSE protocol major version.
+ * \param proto_minor The FUSE protocol minor version.
+ */
+void jfs_mount_init(unsigned proto_major, unsigned proto_minor);
+
+/*!
+ * Flush queued writes and stop everything jfs_mount_init started.
+ */
+void jfs_mount_destroy(void);
+
+/*!
+ * Choose between direct and page cached I/O for a new file handle.
+ * \param fi The FUSE file handle, fh must already be open.
+ * \param node The FUSE node the file is opened through.
+ */
+void jfs_set_io_mode(struct fuse_file_info *fi, unsigned long long node);
+
 /*!
  * Queue a database read operation.
  *
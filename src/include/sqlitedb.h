@@ -40,17 +40,58 @@
 #define JFS_QUERY_MAX     1000000  /* SQLITE_SQL_MAX_LENGTH */
 #define JFS_SQL_RC_SCALE  100
 
+#define JFS_DB_BUSY_TIMEOUT 600000
+
+#define JFS_DB_ARGS_MAX   4
+#define JFS_DB_BOUND_MAX  3
+
+/*!
+ * Types of values that can be bound to a cached statement.
+ */
+enum jfs_db_arg_types {
+  jfs_db_arg_int,
+  jfs_db_arg_text,
+  jfs_db_arg_blob
+};
+
+/*!
+ * A value bound to a cached statement parameter.
+ *
+ * Text and blobs are not copied, they must stay valid
+ * until the operation completes.
+ */
+struct jfs_db_arg {
+  enum jfs_db_arg_types  type;
+  int                    len;
+
+  union {
+    int                  int_val;
+    const char          *text;
+    const void          *blob;
+  } val;
+};
+
+/*!
+ * A cached statement and the values bound to it.
+ */
+struct jfs_db_bound {
+  enum jfs_db_stmts  stmt_id;
+  int                num_args;
+  struct jfs_db_arg  args[JFS_DB_ARGS_MAX];
+};
+
 /*!
  * Structure for thread pool database operations.
  *
- * Errors are stored in rc.
+ * Errors are stored in rc. An op with a callback is not
+ * waited on, the worker hands it to the callback when it
+ * finishes and the callback must destroy it.
  */
 struct jfs_db_op {
   sqlite3         *db;
   sqlite3_stmt    *stmt;
   enum jfs_db_ops  op;
 
-  int              num_queries;
   int              done;
   int              rc;
 
@@ -58,10 +99,16 @@ struct jfs_db_op {
   pthread_mutex_t  mut;
 
   char            *query;
-  char           **multi_query;
+
+  sqlite3_stmt   **stmt_cache;
+  int              num_bound;
+  struct jfs_db_bound bound[JFS_DB_BOUND_MAX];
 
   jfs_list_t      *result;
   size_t           buffer_size;
+
+  void           (*callback)(struct jfs_db_op *db_op);
+  void            *callback_arg;
 };
 
 /*!
@@ -90,23 +137,62 @@ int jfs_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, const char *
 int jfs_do_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, char *query);
 
 /*!
- * Create a multi-write transaction operation.
+ * Create a database op that runs a cached statement.
+ *
+ * Values are bound with the jfs_db_op_bind functions in
+ * parameter order.
  * \param op The returned database operation.
  * \param jfs_op The type of database operation.
- * \param num_queries The number of queries.
- * \param ... The format queries.
+ * \param stmt_id The cached statement to run.
  * \return Error code or 0.
  */
-int jfs_db_op_create_multi_op(struct jfs_db_op **op, int num_queries,...);
+int jfs_db_op_create_stmt(struct jfs_db_op **op, enum jfs_db_ops jfs_op, enum jfs_db_stmts stmt_id);
 
 /*!
- * Create a db query using a format string.
- * \param query The returned query.
- * \param format The query format string.
- * \param ... The format variables.
+ * Add another cached statement to a multi-write operation.
+ *
+ * Values bound afterwards are bound to the added statement.
+ * \param db_op The database operation.
+ * \param stmt_id The cached statement to run.
+ * \return Error code or 0.
+ */
+int jfs_db_op_add_stmt(struct jfs_db_op *db_op, enum jfs_db_stmts stmt_id);
+
+/*!
+ * Bind an integer to the next parameter of the last added statement.
+ * \param db_op The database operation.
+ * \param value The integer value.
+ * \return Error code or 0.
+ */
+int jfs_db_op_bind_int(struct jfs_db_op *db_op, int value);
+
+/*!
+ * Bind text to the next parameter of the last added statement.
+ * \param db_op The database operation.
+ * \param text The text value, not copied.
+ * \return Error code or 0.
+ */
+int jfs_db_op_bind_text(struct jfs_db_op *db_op, const char *text);
+
+/*!
+ * Bind sized text to the next parameter of the last added statement.
+ *
+ * The text does not need to be null terminated.
+ * \param db_op The database operation.
+ * \param text The text value, not copied.
+ * \param len The text length in bytes.
  * \return Error code or 0.
  */
-int jfs_db_op_create_query(char **query, const char *format, ...);
+int jfs_db_op_bind_text_len(struct jfs_db_op *db_op, const char *text, int len);
+
+/*!
+ * Bind a blob to the next parameter of the last added statement.
+ * \param db_op The database operation.
+ * \param blob The blob value, not copied.
+ * \param len The blob length in bytes.
+ * \return Error code or 0.
+ */
+int jfs_db_op_bind_blob(struct jfs_db_op *db_op, const void *blob, int len);
 
 /*!
  * Destroy a database operation.
@@ -137,6 +223,19 @@ int jfs_open_db(sqlite3 **db, int sqlite_attr);
  */
 void jfs_close_db(sqlite3 *db);
 
+/*!
+ * Finalize all statements in a worker's statement cache.
+ * \param stmt_cache The statement cache, jfs_num_stmts entries.
+ */
+void jfs_db_stmt_cache_destroy(sqlite3_stmt **stmt_cache);
+
+/*!
+ * Get the SQL text of a cached statement.
+ * \param stmt_id The cached statement.
+ * \return The SQL text.
+ */
+const char *jfs_db_stmt_sql(enum jfs_db_stmts stmt_id);
+
 /*!
  * Performs a query using the jfs_db_op struct.
  * \param db_op The database operation.
@@ -144,4 +243,15 @@ void jfs_close_db(sqlite3 *db);
  */
 int jfs_query(struct jfs_db_op *db_op);
 
+/*!
+ * Performs a group of queries in a single transaction.
+ *
+ * Each query runs in its own savepoint, its error code
+ * is stored in its rc. All queries must share one connection.
+ * \param db_ops The database operations.
+ * \param num_ops The number of database operations.
+ * \return Error code of the transaction or 0.
+ */
+int jfs_query_group(struct jfs_db_op **db_ops, int num_ops);
+
 #endif
@@ -21,6 +21,8 @@
 
 #include <pthread.h>
 
+#define JFS_POOL_BATCH_MAX 128
+
 typedef unsigned int uint_t;
 
 /*!
@@ -41,6 +43,23 @@ typedef	struct thr_pool	thr_pool_t;
 thr_pool_t *jfs_pool_create(uint_t min_threads, uint_t max_threads,
 							uint_t linger, pthread_attr_t *attr, int sqlite_attr);
 
+/*!
+ * Set the maximum number of queued jobs a worker runs in one transaction.
+ *
+ * Each job in a batch runs in its own savepoint and is signalled
+ * after the batch commits. Pools default to one job per transaction.
+ * \param pool The thread pool.
+ * \param max_batch The maximum batch size, clamped to JFS_POOL_BATCH_MAX.
+ */
+void jfs_pool_set_batch(thr_pool_t *pool, uint_t max_batch);
+
+/*!
+ * Check if a pool has no queued or running jobs.
+ * \param pool The thread pool.
+ * \return 1 if the pool is idle, otherwise 0.
+ */
+int jfs_pool_is_idle(thr_pool_t *pool);
+
 /*!
  * Enqueue a work request to the thread pool job queue.
  * If there are idle worker threads, awaken one to perform the job.
@@ -0,0 +1,126 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "error_log.h"
+#include "jfs_checkpoint.h"
+#include "sqlitedb.h"
+
+#include <errno.h>
+#include <time.h>
+#include <sqlite3.h>
+#include <pthread.h>
+
+#define JFS_CHECKPOINT_INTERVAL 1
+
+static pthread_t ckpt_thread;
+static pthread_mutex_t ckpt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ckpt_cv = PTHREAD_COND_INITIALIZER;
+
+static thr_pool_t *ckpt_pool;
+static sqlite3 *ckpt_db;
+static int ckpt_running;
+static int ckpt_stop;
+
+/*
+ * Move committed pages from the WAL into the database
+ * while nothing is being written.
+ */
+static void *
+jfs_checkpoint_thread(void *arg)
+{
+  struct timespec ts;
+
+  int log_pages;
+  int ckpt_pages;
+  int rc;
+
+  (void) arg;
+
+  pthread_mutex_lock(&ckpt_lock);
+  while(!ckpt_stop) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += JFS_CHECKPOINT_INTERVAL;
+    pthread_cond_timedwait(&ckpt_cv, &ckpt_lock, &ts);
+    if(ckpt_stop) {
+      break;
+    }
+    pthread_mutex_unlock(&ckpt_lock);
+
+    //passive checkpoints never wait on readers or the writer
+    if(jfs_pool_is_idle(ckpt_pool)) {
+      rc = sqlite3_wal_checkpoint_v2(ckpt_db, NULL, SQLITE_CHECKPOINT_PASSIVE,
+                                     &log_pages, &ckpt_pages);
+      if(rc && rc != SQLITE_BUSY) {
+        log_error("WAL checkpoint failed, error:%d\n", rc);
+      }
+    }
+
+    pthread_mutex_lock(&ckpt_lock);
+  }
+  pthread_mutex_unlock(&ckpt_lock);
+
+  return NULL;
+}
+
+int
+jfs_checkpoint_start(thr_pool_t *write_pool)
+{
+  int rc;
+
+  rc = jfs_open_db(&ckpt_db, SQLITE_OPEN_READWRITE);
+  if(rc) {
+    return rc;
+  }
+
+  ckpt_pool = write_pool;
+  ckpt_stop = 0;
+
+  rc = pthread_create(&ckpt_thread, NULL, jfs_checkpoint_thread, NULL);
+  if(rc) {
+    jfs_close_db(ckpt_db);
+    ckpt_db = NULL;
+
+    return -rc;
+  }
+  ckpt_running = 1;
+
+  return 0;
+}
+
+void
+jfs_checkpoint_stop(void)
+{
+  if(!ckpt_running) {
+    return;
+  }
+
+  pthread_mutex_lock(&ckpt_lock);
+  ckpt_stop = 1;
+  pthread_cond_signal(&ckpt_cv);
+  pthread_mutex_unlock(&ckpt_lock);
+
+  pthread_join(ckpt_thread, NULL);
+  jfs_close_db(ckpt_db);
+  ckpt_db = NULL;
+  ckpt_running = 0;
+}
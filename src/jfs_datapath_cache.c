@@ -23,7 +23,6 @@
 
 #include "error_log.h"
 #include "jfs_datapath_cache.h"
-#include "sglib.h"
 #include "sqlitedb.h"
 #include "joinfs.h"
 
@@ -33,50 +32,219 @@
 #include <errno.h>
 #include <pthread.h>
 
-#define JFS_DATAPATH_CACHE_SIZE 1000
+#define JFS_DATAPATH_SHARDS    16
+#define JFS_DATAPATH_SLOTS_MIN 64
 
-typedef struct jfs_datapath_cache jfs_datapath_cache_t;
-struct jfs_datapath_cache {
-  int                   jfs_id;
-  char                 *datapath;
-
-  jfs_datapath_cache_t *next;
+/*
+ * Cached data path. Empty slots have a NULL datapath.
+ */
+typedef struct jfs_datapath_entry jfs_datapath_entry_t;
+struct jfs_datapath_entry {
+  int            jfs_id;
+  unsigned char  ref;
+  char          *datapath;
 };
 
-static jfs_datapath_cache_t *hashtable[JFS_DATAPATH_CACHE_SIZE];
+/*
+ * Open addressing table holding a slice of the jfs_id space.
+ * Entries carry a CLOCK reference bit that hits set and the
+ * eviction hand clears.
+ */
+typedef struct jfs_datapath_shard jfs_datapath_shard_t;
+struct jfs_datapath_shard {
+  pthread_rwlock_t      lock;
 
-#define JFS_DATAPATH_CACHE_T_CMP(e1, e2) (e1->jfs_id - e2->jfs_id)
+  jfs_datapath_entry_t *slots;
+  size_t                size;
+  size_t                count;
+  size_t                bytes;
+  size_t                hand;
+
+  unsigned long         hits;
+  unsigned long         misses;
+  unsigned long         evictions;
+} __attribute__((aligned(64)));
+
+static jfs_datapath_shard_t shards[JFS_DATAPATH_SHARDS];
+static size_t shard_budget;
+
+static int jfs_datapath_cache_miss(int inode, char **datapath);
 
 /*
- * Hash function for symlinks.
+ * Spread sequential ids over the shards and slots.
  */
-static unsigned int 
-jfs_datapath_cache_t_hash(jfs_datapath_cache_t *item)
+static unsigned int
+jfs_datapath_hash(int jfs_id)
 {
   unsigned int hash;
 
-  hash = item->jfs_id % JFS_DATAPATH_CACHE_SIZE;
+  hash = jfs_id;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
 
   return hash;
 }
 
+static jfs_datapath_shard_t *
+jfs_datapath_shard(unsigned int hash)
+{
+  return &shards[hash % JFS_DATAPATH_SHARDS];
+}
+
+static size_t
+jfs_datapath_home(jfs_datapath_shard_t *shard, unsigned int hash)
+{
+  return (hash / JFS_DATAPATH_SHARDS) & (shard->size - 1);
+}
+
 /*
- * SGLIB generator macros for jfs_path_cache_t lists.
+ * Memory charged to the budget for an entry.
  */
-SGLIB_DEFINE_LIST_PROTOTYPES(jfs_datapath_cache_t, JFS_DATAPATH_CACHE_T_CMP, next)
-SGLIB_DEFINE_LIST_FUNCTIONS(jfs_datapath_cache_t, JFS_DATAPATH_CACHE_T_CMP, next)
+static size_t
+jfs_datapath_cost(const char *datapath)
+{
+  return sizeof(jfs_datapath_entry_t) + strlen(datapath) + 1;
+}
 
 /*
- * SGLIB generator macros for hashtable function prototypes.
+ * HOLD A SHARD LOCK
+ *
+ * Returns the slot holding jfs_id, or -1.
  */
-SGLIB_DEFINE_HASHED_CONTAINER_PROTOTYPES(jfs_datapath_cache_t, JFS_DATAPATH_CACHE_SIZE,
-										 jfs_datapath_cache_t_hash)
-SGLIB_DEFINE_HASHED_CONTAINER_FUNCTIONS(jfs_datapath_cache_t, JFS_DATAPATH_CACHE_SIZE,
-										jfs_datapath_cache_t_hash)
+static long
+jfs_datapath_find(jfs_datapath_shard_t *shard, int jfs_id, unsigned int hash)
+{
+  size_t mask;
+  size_t i;
 
-static int jfs_datapath_cache_miss(int inode, char **datapath);
+  if(!shard->count) {
+    return -1;
+  }
 
-static pthread_rwlock_t cache_lock;
+  mask = shard->size - 1;
+  for(i = jfs_datapath_home(shard, hash); shard->slots[i].datapath; i = (i + 1) & mask) {
+    if(shard->slots[i].jfs_id == jfs_id) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * HOLD THE SHARD WRITE LOCK
+ */
+static void
+jfs_datapath_place(jfs_datapath_shard_t *shard, jfs_datapath_entry_t *entry)
+{
+  size_t mask;
+  size_t i;
+
+  mask = shard->size - 1;
+  i = jfs_datapath_home(shard, jfs_datapath_hash(entry->jfs_id));
+  for(; shard->slots[i].datapath; i = (i + 1) & mask);
+
+  shard->slots[i] = *entry;
+}
+
+/*
+ * HOLD THE SHARD WRITE LOCK
+ *
+ * Free the entry in slot and shift back the entries probing past it.
+ */
+static void
+jfs_datapath_delete(jfs_datapath_shard_t *shard, size_t slot)
+{
+  size_t mask;
+  size_t home;
+  size_t hole;
+  size_t i;
+
+  shard->bytes -= jfs_datapath_cost(shard->slots[slot].datapath);
+  free(shard->slots[slot].datapath);
+  --shard->count;
+
+  mask = shard->size - 1;
+  hole = slot;
+  for(i = (hole + 1) & mask; shard->slots[i].datapath; i = (i + 1) & mask) {
+    home = jfs_datapath_home(shard, jfs_datapath_hash(shard->slots[i].jfs_id));
+
+    if(((i - home) & mask) >= ((i - hole) & mask)) {
+      shard->slots[hole] = shard->slots[i];
+      hole = i;
+    }
+  }
+  shard->slots[hole].datapath = NULL;
+}
+
+/*
+ * HOLD THE SHARD WRITE LOCK
+ *
+ * Double the table, allocating it on first use.
+ */
+static int
+jfs_datapath_grow(jfs_datapath_shard_t *shard)
+{
+  jfs_datapath_entry_t *old;
+
+  size_t old_size;
+  size_t size;
+  size_t i;
+
+  old = shard->slots;
+  old_size = shard->size;
+  size = old_size ? old_size * 2 : JFS_DATAPATH_SLOTS_MIN;
+
+  shard->slots = calloc(size, sizeof(*shard->slots));
+  if(!shard->slots) {
+    shard->slots = old;
+
+    return -ENOMEM;
+  }
+  shard->size = size;
+
+  for(i = 0; i < old_size; ++i) {
+    if(old[i].datapath) {
+      jfs_datapath_place(shard, &old[i]);
+    }
+  }
+  free(old);
+
+  return 0;
+}
+
+/*
+ * HOLD THE SHARD WRITE LOCK
+ *
+ * Sweep the CLOCK hand until the shard is back under budget,
+ * giving recently used entries a second chance.
+ */
+static void
+jfs_datapath_evict(jfs_datapath_shard_t *shard)
+{
+  jfs_datapath_entry_t *entry;
+
+  while(shard->bytes > shard_budget && shard->count > 1) {
+    shard->hand &= shard->size - 1;
+    entry = &shard->slots[shard->hand];
+
+    if(!entry->datapath) {
+      ++shard->hand;
+    }
+    else if(entry->ref) {
+      entry->ref = 0;
+      ++shard->hand;
+    }
+    else {
+      //the shift may pull another entry under the hand
+      jfs_datapath_delete(shard, shard->hand);
+      ++shard->evictions;
+    }
+  }
+}
 
 /*
  * Initialize the jfs_datapath_cache.
@@ -84,8 +252,24 @@ static pthread_rwlock_t cache_lock;
 void 
 jfs_datapath_cache_init()
 {
-  pthread_rwlock_init(&cache_lock, NULL);
-  sglib_hashed_jfs_datapath_cache_t_init(hashtable);
+  size_t budget;
+  int i;
+
+  budget = (size_t)joinfs_context.datapath_cache_kb * 1024;
+  shard_budget = budget / JFS_DATAPATH_SHARDS;
+
+  for(i = 0; i < JFS_DATAPATH_SHARDS; ++i) {
+    pthread_rwlock_init(&shards[i].lock, NULL);
+
+    shards[i].slots = NULL;
+    shards[i].size = 0;
+    shards[i].count = 0;
+    shards[i].bytes = 0;
+    shards[i].hand = 0;
+    shards[i].hits = 0;
+    shards[i].misses = 0;
+    shards[i].evictions = 0;
+  }
 }
 
 /*
@@ -94,72 +278,137 @@ jfs_datapath_cache_init()
 void
 jfs_datapath_cache_destroy()
 {
-  struct sglib_hashed_jfs_datapath_cache_t_iterator it;
-  jfs_datapath_cache_t *item;
+  jfs_datapath_shard_t *shard;
+
+  size_t j;
+  int i;
   
-  pthread_rwlock_wrlock(&cache_lock);
-  for(item = sglib_hashed_jfs_datapath_cache_t_it_init(&it,hashtable); 
-	  item != NULL; item = sglib_hashed_jfs_datapath_cache_t_it_next(&it)) {
-	free(item->datapath);
-	free(item);
+  for(i = 0; i < JFS_DATAPATH_SHARDS; ++i) {
+    shard = &shards[i];
+
+    pthread_rwlock_wrlock(&shard->lock);
+    for(j = 0; j < shard->size; ++j) {
+      free(shard->slots[j].datapath);
+    }
+    free(shard->slots);
+    shard->slots = NULL;
+    shard->size = 0;
+    pthread_rwlock_unlock(&shard->lock);
+
+    pthread_rwlock_destroy(&shard->lock);
   }
+}
+
+void
+jfs_datapath_cache_get_stats(struct jfs_datapath_cache_stats *stats)
+{
+  jfs_datapath_shard_t *shard;
+
+  int i;
 
-  pthread_rwlock_unlock(&cache_lock);
-  pthread_rwlock_destroy(&cache_lock);
+  memset(stats, 0, sizeof(*stats));
+  for(i = 0; i < JFS_DATAPATH_SHARDS; ++i) {
+    shard = &shards[i];
+
+    pthread_rwlock_rdlock(&shard->lock);
+    stats->hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+    stats->misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+    stats->evictions += shard->evictions;
+    stats->entries += shard->count;
+    stats->bytes += shard->bytes;
+    pthread_rwlock_unlock(&shard->lock);
+  }
 }
 
 /*
- * Destroy the jfs_datapath_cache.
+ * Log the counters and contents of the jfs_datapath_cache.
  */
 void
 jfs_datapath_cache_log()
 {
-  struct sglib_hashed_jfs_datapath_cache_t_iterator it;
-  jfs_datapath_cache_t *item;
+  struct jfs_datapath_cache_stats stats;
+  jfs_datapath_shard_t *shard;
+
+  size_t j;
+  int i;
+
+  jfs_datapath_cache_get_stats(&stats);
 
   log_msg("DATAPATH CACHE LOG START\n");
-  pthread_rwlock_rdlock(&cache_lock);
-  for(item = sglib_hashed_jfs_datapath_cache_t_it_init(&it,hashtable); 
-	  item != NULL; item = sglib_hashed_jfs_datapath_cache_t_it_next(&it)) {
-	log_msg("jfs_id:%d, datapath:%s\n", item->jfs_id, item->datapath);
+  log_msg("hits:%lu, misses:%lu, evictions:%lu, entries:%lu, bytes:%lu\n",
+          stats.hits, stats.misses, stats.evictions, 
+          (unsigned long)stats.entries, (unsigned long)stats.bytes);
+
+  for(i = 0; i < JFS_DATAPATH_SHARDS; ++i) {
+    shard = &shards[i];
+
+    pthread_rwlock_rdlock(&shard->lock);
+    for(j = 0; j < shard->size; ++j) {
+      if(shard->slots[j].datapath) {
+        log_msg("jfs_id:%d, datapath:%s\n", shard->slots[j].jfs_id, 
+                shard->slots[j].datapath);
+      }
+    }
+    pthread_rwlock_unlock(&shard->lock);
   }
 
-  pthread_rwlock_unlock(&cache_lock);
-  pthread_rwlock_destroy(&cache_lock);
-
   log_msg("LOG END\n");
 }
 
 int
 jfs_datapath_cache_add(int jfs_id, const char *datapath)
 {
-  jfs_datapath_cache_t *item;
+  jfs_datapath_shard_t *shard;
+  jfs_datapath_entry_t  entry;
 
-  char *path;
+  unsigned int hash;
 
-  size_t path_len;
+  char *path;
 
-  jfs_datapath_cache_remove(jfs_id);
+  long slot;
 
-  item = malloc(sizeof(*item));
-  if(!item) {
-	return -ENOMEM;
-  }
+  int rc;
 
-  path_len = strlen(datapath) + 1;
-  path = malloc(sizeof(*path) * path_len);
+  path = strdup(datapath);
   if(!path) {
-    free(item);
     return -ENOMEM;
   }
-  strncpy(path, datapath, path_len);
 
-  item->jfs_id = jfs_id;
-  item->datapath = path;
+  hash = jfs_datapath_hash(jfs_id);
+  shard = jfs_datapath_shard(hash);
 
-  pthread_rwlock_wrlock(&cache_lock);
-  sglib_hashed_jfs_datapath_cache_t_add(hashtable, item);
-  pthread_rwlock_unlock(&cache_lock);
+  pthread_rwlock_wrlock(&shard->lock);
+  slot = jfs_datapath_find(shard, jfs_id, hash);
+  if(slot >= 0) {
+    shard->bytes -= jfs_datapath_cost(shard->slots[slot].datapath);
+    free(shard->slots[slot].datapath);
+
+    shard->slots[slot].datapath = path;
+    shard->slots[slot].ref = 1;
+    shard->bytes += jfs_datapath_cost(path);
+  }
+  else {
+    //keep the load factor under 3/4
+    if((shard->count + 1) * 4 > shard->size * 3) {
+      rc = jfs_datapath_grow(shard);
+      if(rc) {
+        pthread_rwlock_unlock(&shard->lock);
+        free(path);
+
+        return rc;
+      }
+    }
+
+    entry.jfs_id = jfs_id;
+    entry.ref = 1;
+    entry.datapath = path;
+    jfs_datapath_place(shard, &entry);
+
+    ++shard->count;
+    shard->bytes += jfs_datapath_cost(path);
+  }
+  jfs_datapath_evict(shard);
+  pthread_rwlock_unlock(&shard->lock);
 
   return 0;
 }
@@ -167,56 +416,137 @@ jfs_datapath_cache_add(int jfs_id, const char *datapath)
 int
 jfs_datapath_cache_remove(int jfs_id)
 {
-  jfs_datapath_cache_t check;
-  jfs_datapath_cache_t *elem;
+  jfs_datapath_shard_t *shard;
 
-  int rc;
+  unsigned int hash;
 
-  check.jfs_id = jfs_id;
-  pthread_rwlock_wrlock(&cache_lock);
-  rc = sglib_hashed_jfs_datapath_cache_t_delete_if_member(hashtable, &check, &elem);
-  pthread_rwlock_unlock(&cache_lock);
-  
-  if(rc) {
-    free(elem->datapath);
-    free(elem);
+  long slot;
+
+  hash = jfs_datapath_hash(jfs_id);
+  shard = jfs_datapath_shard(hash);
+
+  pthread_rwlock_wrlock(&shard->lock);
+  slot = jfs_datapath_find(shard, jfs_id, hash);
+  if(slot >= 0) {
+    jfs_datapath_delete(shard, slot);
   }
+  pthread_rwlock_unlock(&shard->lock);
   
   return 0;
 }
 
+/*
+ * HOLD THE SHARD READ LOCK
+ *
+ * Returns the cached datapath and marks it used, or NULL.
+ */
+static const char *
+jfs_datapath_lookup(jfs_datapath_shard_t *shard, int jfs_id, unsigned int hash)
+{
+  jfs_datapath_entry_t *entry;
+
+  long slot;
+
+  slot = jfs_datapath_find(shard, jfs_id, hash);
+  if(slot < 0) {
+    __atomic_fetch_add(&shard->misses, 1, __ATOMIC_RELAXED);
+
+    return NULL;
+  }
+  __atomic_fetch_add(&shard->hits, 1, __ATOMIC_RELAXED);
+
+  entry = &shard->slots[slot];
+  if(!__atomic_load_n(&entry->ref, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&entry->ref, 1, __ATOMIC_RELAXED);
+  }
+
+  return entry->datapath;
+}
+
 int
 jfs_datapath_cache_get_datapath(int jfs_id, char **datapath)
 {
-  jfs_datapath_cache_t check;
-  jfs_datapath_cache_t *result;
+  jfs_datapath_shard_t *shard;
+
+  unsigned int hash;
 
+  const char *result;
   char *path;
 
-  size_t path_len;
+  hash = jfs_datapath_hash(jfs_id);
+  shard = jfs_datapath_shard(hash);
 
-  check.jfs_id = jfs_id;
-  pthread_rwlock_rdlock(&cache_lock);
-  result = sglib_hashed_jfs_datapath_cache_t_find_member(hashtable, &check);
+  pthread_rwlock_rdlock(&shard->lock);
+  result = jfs_datapath_lookup(shard, jfs_id, hash);
 
   if(!result) {
-    pthread_rwlock_unlock(&cache_lock);
+    pthread_rwlock_unlock(&shard->lock);
 	return jfs_datapath_cache_miss(jfs_id, datapath);
   }
 
-  path_len = strlen(result->datapath) + 1;
-  path = malloc(sizeof(*path) * path_len);
+  path = strdup(result);
+  pthread_rwlock_unlock(&shard->lock);
+
   if(!path) {
     return -ENOMEM;
   }
-  strncpy(path, result->datapath, path_len);
-  pthread_rwlock_unlock(&cache_lock);
-
   *datapath = path;
 
   return 0;
 }
 
+int
+jfs_datapath_cache_copy_datapath(int jfs_id, char *buf, size_t size)
+{
+  jfs_datapath_shard_t *shard;
+
+  unsigned int hash;
+
+  const char *result;
+  char *path;
+
+  size_t path_len;
+
+  int rc;
+
+  hash = jfs_datapath_hash(jfs_id);
+  shard = jfs_datapath_shard(hash);
+
+  pthread_rwlock_rdlock(&shard->lock);
+  result = jfs_datapath_lookup(shard, jfs_id, hash);
+
+  if(!result) {
+    pthread_rwlock_unlock(&shard->lock);
+
+    rc = jfs_datapath_cache_miss(jfs_id, &path);
+    if(rc) {
+      return rc;
+    }
+
+    path_len = strlen(path) + 1;
+    if(path_len > size) {
+      free(path);
+
+      return -ENAMETOOLONG;
+    }
+    memcpy(buf, path, path_len);
+    free(path);
+
+    return 0;
+  }
+
+  path_len = strlen(result) + 1;
+  if(path_len > size) {
+    pthread_rwlock_unlock(&shard->lock);
+
+    return -ENAMETOOLONG;
+  }
+  memcpy(buf, result, path_len);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return 0;
+}
+
 /*
   Handles the cache miss.
  */
@@ -231,12 +561,11 @@ jfs_datapath_cache_miss(int jfs_id, char **datapath)
 
   int rc;
 
-  rc = jfs_db_op_create(&db_op, jfs_datapath_cache_op, 
-                        "SELECT path FROM links WHERE jfs_id=%d;", 
-                        jfs_id);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_datapath_cache_op, jfs_datapath_lookup_stmt);
   if(rc) {
     return rc;
   }
+  jfs_db_op_bind_int(db_op, jfs_id);
   
   jfs_read_pool_queue(db_op);
 
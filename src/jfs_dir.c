@@ -30,9 +30,12 @@
 #include "jfs_meta.h"
 #include "jfs_dynamic_paths.h"
 #include "jfs_file.h"
+#include "jfs_pending.h"
+#include "jfs_query_cache.h"
+#include "jfs_meta_cache.h"
+#include "jfs_stat_cache.h"
 #include "joinfs.h"
 
-#include <fuse.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -44,7 +47,9 @@
 
 static int jfs_dir_is_dynamic(const char *path);
 static int jfs_dir_do_mkdir(const char *path, mode_t mode);
-static int jfs_dir_db_filler(const char *path, const char *realpath, void *buf, fuse_fill_dir_t filler);
+static int jfs_dir_db_filler(const char *path, const char *realpath, void *buf, jfs_fill_dir_t filler);
+static int jfs_dir_db_query(const char *query, const int *keyids, int num_keyids, jfs_list_t **result);
+static int jfs_dir_can_read(const char *datapath, const struct stat *st, uid_t uid, gid_t gid);
 static void safe_jfs_list_destroy(struct sglib_jfs_list_t_iterator *it, jfs_list_t *item);
 
 int
@@ -99,39 +104,29 @@ jfs_dir_do_mkdir(const char *path, mode_t mode)
 int 
 jfs_dir_rmdir(const char *path)
 {
+  struct jfs_path_info info;
   struct jfs_db_op *db_op;
- 
-  char *file_query;
-  char *metadata_query;
   
   int rc;
 
   //can't remove dynamic directories!!
-  if(!jfs_util_is_realpath(path)) {
-    return -EPERM;
-  }
-
-  rc = jfs_db_op_create_query(&metadata_query,
-                              "DELETE FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\");",
-                              path);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
     return rc;
   }
 
-  rc = jfs_db_op_create_query(&file_query, 
-                              "DELETE FROM links WHERE path=\"%s\";",
-                              path);
-  if(rc) {
-    free(metadata_query);
-	return rc;
+  if(info.type != jfs_path_static) {
+    return -EPERM;
   }
 
-  rc = jfs_db_op_create_multi_op(&db_op, 2, metadata_query, file_query);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_multi_write_op, jfs_unlink_meta_stmt);
   if(rc) {
-    free(file_query);
-    free(metadata_query);
     return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
+
+  jfs_db_op_add_stmt(db_op, jfs_unlink_link_stmt);
+  jfs_db_op_bind_text(db_op, path);
 
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -140,11 +135,14 @@ jfs_dir_rmdir(const char *path)
   if(rc) {
     return rc;
   }
+  jfs_query_cache_invalidate_all();
+  jfs_meta_cache_remove_path(path);
 
   rc = rmdir(path);
   if(rc) {
 	return -errno;
   }
+  jfs_stat_cache_remove_dirent(path);
 
   return rc;
 }
@@ -152,18 +150,17 @@ jfs_dir_rmdir(const char *path)
 int
 jfs_dir_opendir(const char *path, DIR **d)
 {
-  char *datapath;
+  struct jfs_path_info info;
   DIR *dp;
 
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
     return rc;
   }
 
-  dp = opendir(datapath);
-  free(datapath);
+  dp = opendir(info.datapath);
 
   if(!dp) {
     return -errno;
@@ -175,12 +172,12 @@ jfs_dir_opendir(const char *path, DIR **d)
 
 int 
 jfs_dir_readdir(const char *path, DIR *dp, void *buf, 
-                fuse_fill_dir_t filler)
+                jfs_fill_dir_t filler)
 {
   struct stat st;
   struct dirent *de;
  
-  char *datapath;
+  struct jfs_path_info info;
   
   int rc;
 
@@ -197,23 +194,23 @@ jfs_dir_readdir(const char *path, DIR *dp, void *buf,
     }
   }
   
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
     return rc;
   }
 
-  if(jfs_dir_is_dynamic(datapath)) {
-    rc = jfs_dir_db_filler(path, datapath, buf, filler);
-    if(rc) {
-      free(datapath);
+  if(jfs_dir_is_dynamic(info.datapath)) {
+    //dynamic folders are queried from the db, let queued writes land
+    jfs_pending_wait();
 
+    rc = jfs_dir_db_filler(path, info.datapath, buf, filler);
+    if(rc) {
       return rc;
     }
   }
   else {
     printf("is not dynamic\n");
   }
-  free(datapath);
 
   return 0;
 }
@@ -224,14 +221,13 @@ jfs_dir_readdir(const char *path, DIR *dp, void *buf,
  */
 static int
 jfs_dir_db_filler(const char *path, const char *realpath, void *buf, 
-                  fuse_fill_dir_t filler)
+                  jfs_fill_dir_t filler)
 {
   struct sglib_jfs_list_t_iterator it;
-  struct jfs_db_op *db_op;
   struct stat st;
-  struct stat item_st;
   
   jfs_list_t *item;
+  jfs_list_t *result;
 
   char *query;
   char *buffer;
@@ -240,20 +236,29 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
   size_t buffer_len;
   size_t datapath_len;
 
+  unsigned long generation;
+
+  int *keyids;
+
+  uid_t uid;
+  gid_t gid;
+
+  int num_keyids;
   int is_folders;
   int datainode;
-  int mask;
   int rc;
 
   datapath = NULL;
   is_folders = 0;
   datainode = 0;
-  mask = R_OK | F_OK; 
+  uid = getuid();
+  gid = getgid();
   
   printf("---jfs_db_readder start\n");
 
   query = NULL;
-  rc = jfs_dir_query_builder(path, realpath, &is_folders, &query);
+  keyids = NULL;
+  rc = jfs_dir_query_builder(path, realpath, &is_folders, &query, &keyids, &num_keyids);
   if(rc) {
 	return rc;
   }
@@ -266,11 +271,15 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
 
   rc = jfs_dynamic_hierarchy_invalidate_folder(path);
   if(rc) {
+    free(query);
+    free(keyids);
     return rc;
   }
 
   rc = jfs_dynamic_hierarchy_add_folder(path, realpath);
   if(rc) {
+    free(query);
+    free(keyids);
     return rc;
   }
 
@@ -278,6 +287,8 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
     datapath_len = strlen(realpath) + strlen(".jfs_sub_query") + 2;
     datapath = malloc(sizeof(*datapath) * datapath_len);
     if(!datapath) {
+      free(query);
+      free(keyids);
       return -ENOMEM;
     }
     snprintf(datapath, datapath_len, "%s/%s", realpath, ".jfs_sub_query");
@@ -285,39 +296,41 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
     memset(&st, 0, sizeof(st));
     rc = stat(datapath, &st);
     if(rc) {
+      rc = -errno;
       free(datapath);
+      free(query);
+      free(keyids);
       
-      return -errno;
+      return rc;
     }
     
     datainode = st.st_ino;
   }
   
-  rc = jfs_do_db_op_create(&db_op, jfs_readdir_op, query);
-  if(rc) {
-	return rc;
+  //repeated listings are served from the query cache
+  rc = jfs_query_cache_get(query, &result);
+  if(rc == -ENOENT) {
+    rc = jfs_dir_db_query(query, keyids, num_keyids, &result);
   }
+  free(query);
+  free(keyids);
 
-  printf("---jfs_readdir query:%s\n", query);
-  
-  jfs_read_pool_queue(db_op);
-
-  rc = jfs_db_op_wait(db_op);
   if(rc) {
-	jfs_db_op_destroy(db_op);
+    if(is_folders) {
+      free(datapath);
+    }
 	return rc;
   }
 
-  if(db_op->result == NULL) {
-	jfs_db_op_destroy(db_op);
-
+  if(result == NULL) {
+    if(is_folders) {
+      free(datapath);
+    }
 	return 0;
   }
   
-  for(item = sglib_jfs_list_t_it_init(&it, db_op->result); 
+  for(item = sglib_jfs_list_t_it_init(&it, result); 
 	  item != NULL; item = sglib_jfs_list_t_it_next(&it)) {
-    memset(&item_st, 0, sizeof(item_st));
-
 	buffer_len = strlen(path) + strlen(item->filename) + 2;
 	buffer = malloc(sizeof(*buffer) * buffer_len);
 	if(!buffer) {
@@ -325,11 +338,11 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
         free(datapath);
       }
 	  jfs_list_destroy(item, jfs_readdir_op);
-	  jfs_db_op_destroy(db_op);
       
 	  return -ENOMEM;
 	}
 	snprintf(buffer, buffer_len, "%s/%s", path, item->filename);
+    generation = jfs_stat_cache_generation(buffer);
 	
 	if(!is_folders) {
       memset(&st, 0, sizeof(st));
@@ -341,38 +354,36 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
         }
         free(buffer);
 		safe_jfs_list_destroy(&it, item);
-		jfs_db_op_destroy(db_op);
 
         return -errno;
       }
 	}
-    item_st.st_ino = st.st_ino;
-    item_st.st_mode = st.st_mode;
-
     if(is_folders) {
       //add for display
-      if(filler(buf, item->filename, &item_st, 0) != 0) {
+      if(filler(buf, item->filename, &st, 0) != 0) {
         free(datapath);
         free(buffer);
         safe_jfs_list_destroy(&it, item);
-        jfs_db_op_destroy(db_op);
         
         return -ENOMEM;
       }
       
       rc = jfs_dynamic_hierarchy_add_folder(buffer, datapath);
+      jfs_stat_cache_fill(buffer, &st, generation);
     }
-    else if(access(item->datapath, mask) == 0) {
+    else if(jfs_dir_can_read(item->datapath, &st, uid, gid)) {
       //add for display
-      if(filler(buf, item->filename, &item_st, 0) != 0) {
+      if(filler(buf, item->filename, &st, 0) != 0) {
         free(buffer);
         safe_jfs_list_destroy(&it, item);
-        jfs_db_op_destroy(db_op);
         
         return -ENOMEM;
       }
       
       rc = jfs_dynamic_hierarchy_add_file(buffer, item->datapath, item->jfs_id);
+
+      //ls -l asks for every entry next, answer from what we just read
+      jfs_stat_cache_fill(buffer, &st, generation);
     }
     
     if(rc) {
@@ -381,7 +392,6 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
       }
       free(buffer);
       safe_jfs_list_destroy(&it, item);
-      jfs_db_op_destroy(db_op);
       
       return rc;
     }
@@ -391,7 +401,6 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
 	free(item);
     free(buffer);
   }
-  jfs_db_op_destroy(db_op);
 
   if(is_folders) {
     free(datapath);
@@ -400,6 +409,80 @@ jfs_dir_db_filler(const char *path, const char *realpath, void *buf,
   return 0;
 }
 
+/*
+ * Check read access from attributes already in hand, the same
+ * answer access(R_OK) gives for the real uid and gid.
+ */
+static int
+jfs_dir_can_read(const char *datapath, const struct stat *st, uid_t uid, gid_t gid)
+{
+  if(!uid) {
+    return 1;
+  }
+  if(st->st_uid == uid) {
+    return (st->st_mode & S_IRUSR) != 0;
+  }
+  if(st->st_gid == gid) {
+    return (st->st_mode & S_IRGRP) != 0;
+  }
+  if(st->st_mode & S_IROTH) {
+    return 1;
+  }
+
+  //supplementary groups are rare enough to ask the kernel
+  if(st->st_mode & S_IRGRP) {
+    return access(datapath, R_OK) == 0;
+  }
+
+  return 0;
+}
+
+/*
+ * Run a dynamic folder query and cache its result.
+ */
+static int
+jfs_dir_db_query(const char *query, const int *keyids, int num_keyids, 
+                 jfs_list_t **result)
+{
+  struct jfs_db_op *db_op;
+
+  unsigned long generation;
+  char *db_query;
+
+  int rc;
+
+  db_query = strdup(query);
+  if(!db_query) {
+    return -ENOMEM;
+  }
+
+  rc = jfs_do_db_op_create(&db_op, jfs_readdir_op, db_query);
+  if(rc) {
+	return rc;
+  }
+
+  generation = jfs_query_cache_generation();
+  jfs_read_pool_queue(db_op);
+
+  rc = jfs_db_op_wait(db_op);
+  if(rc) {
+	jfs_db_op_destroy(db_op);
+	return rc;
+  }
+
+  *result = db_op->result;
+  db_op->result = NULL;
+  jfs_db_op_destroy(db_op);
+
+  //an empty folder is worth caching too
+  rc = jfs_query_cache_add(query, keyids, num_keyids, generation, *result);
+  if(rc) {
+    log_error("Failed to cache dynamic folder query:%s, error:%d\n", query, rc);
+  }
+
+  return 0;
+}
+
 static int
 jfs_dir_is_dynamic(const char *path)
 {
@@ -0,0 +1,132 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_dir_plan.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sqlite3.h>
+
+#define JFS_PLAN_FILES   "SELECT l.jfs_id, l.filename, l.path FROM links AS l"
+#define JFS_PLAN_FOLDERS "SELECT DISTINCT f.keyvalue FROM metadata AS f"
+
+static int jfs_dir_plan_is_dup(const struct jfs_dir_term *terms, int term);
+
+int
+jfs_dir_plan_query(const struct jfs_dir_term *terms, int num_terms, 
+                   int folder_keyid, char **query)
+{
+  const char *join;
+
+  char *from;
+  char *where;
+  char *sql;
+
+  int joined;
+  int i;
+
+  if(!folder_keyid && !num_terms) {
+    return -EBADMSG;
+  }
+
+  //files join on the first term, folders on the folder key
+  if(folder_keyid) {
+    from = sqlite3_mprintf("%s", JFS_PLAN_FOLDERS);
+    where = sqlite3_mprintf(" WHERE f.keyid=%d", folder_keyid);
+    join = "f";
+  }
+  else {
+    from = sqlite3_mprintf("%s", JFS_PLAN_FILES);
+    where = sqlite3_mprintf(" WHERE l.jfs_id=m0.jfs_id");
+    join = "m0";
+  }
+
+  joined = 0;
+  for(i = 0; i < num_terms && from && where; ++i) {
+    if(jfs_dir_plan_is_dup(terms, i)) {
+      continue;
+    }
+
+    from = sqlite3_mprintf("%z, metadata AS m%d", from, joined);
+    if(joined || folder_keyid) {
+      where = sqlite3_mprintf("%z AND m%d.jfs_id=%s.jfs_id", where, joined, join);
+    }
+    if(where) {
+      where = sqlite3_mprintf("%z AND m%d.keyid=%d", where, joined, terms[i].keyid);
+    }
+    if(where && terms[i].value) {
+      where = sqlite3_mprintf("%z AND m%d.keyvalue=%Q", where, joined, terms[i].value);
+    }
+    ++joined;
+  }
+
+  if(!from || !where) {
+    sqlite3_free(from);
+    sqlite3_free(where);
+
+    return -ENOMEM;
+  }
+
+  sql = sqlite3_mprintf("%s%s;", from, where);
+  sqlite3_free(from);
+  sqlite3_free(where);
+  if(!sql) {
+    return -ENOMEM;
+  }
+
+  //the query is owned by a db op, which frees it with free()
+  *query = strdup(sql);
+  sqlite3_free(sql);
+  if(!*query) {
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+/*
+ * Check if a term was already seen.
+ */
+static int
+jfs_dir_plan_is_dup(const struct jfs_dir_term *terms, int term)
+{
+  int i;
+
+  for(i = 0; i < term; ++i) {
+    if(terms[i].keyid != terms[term].keyid) {
+      continue;
+    }
+
+    if(!terms[i].value && !terms[term].value) {
+      return 1;
+    }
+
+    if(terms[i].value && terms[term].value &&
+       strcmp(terms[i].value, terms[term].value) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
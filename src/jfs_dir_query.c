@@ -26,29 +26,37 @@
 #include "jfs_meta.h"
 #include "jfs_util.h"
 #include "jfs_dir_query.h"
+#include "jfs_dir_plan.h"
 #include "jfs_dynamic_dir.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-
-#define JFS_FOLDER_SIMPLE_QUERY "SELECT DISTINCT m.keyvalue FROM keys AS k, metadata AS m WHERE k.keytext=\"%s\" AND m.keyid=k.keyid;"
-#define JFS_FOLDER_QUERY        "SELECT DISTINCT m.keyvalue FROM keys AS k, metadata AS m WHERE k.keytext=\"%s\" AND m.keyid=k.keyid AND m.jfs_id IN (%s);"
-#define JFS_FILE_QUERY          "SELECT DISTINCT l.jfs_id, l.filename, l.path FROM links AS l, metadata AS m, keys AS k WHERE l.jfs_id=m.jfs_id AND m.keyid=k.keyid AND m.jfs_id IN (%s);"
-
-#define JFS_KEY_QUERY           "SELECT l.jfs_id FROM links AS l, metadata AS m, keys AS k WHERE l.jfs_id=m.jfs_id and m.keyid=k.keyid and k.keytext=\"%s\""
-#define JFS_PAIR_QUERY          "SELECT l.jfs_id FROM links AS l, metadata AS m, keys AS k WHERE l.jfs_id=m.jfs_id and m.keyid=k.keyid and k.keytext=\"%s\" and m.keyvalue=\"%s\""
-#define JFS_INTERSECT           " INTERSECT "
-#define JFS_ITEM_ADJUST         2
-#define JFS_PAIR_ADJUST         4
-
-static int jfs_dir_parse_key_pairs(int skip_last, const char *dir_key_pairs, size_t *dir_current_pos, 
-                                   size_t *dir_current_len, size_t *dir_query_len, char **dir_query);
-static int jfs_dir_create_query(int items, int is_folder, char *path, char *dir_key_pair, char **query);
-static int jfs_dir_expand_query(size_t *query_len, char **query);
+#include <sys/types.h>
+#include <attr/xattr.h>
+
+#define JFS_TERMS_INC 8
+
+/*
+ * The constraints collected for a dynamic folder.
+ */
+struct jfs_dir_terms {
+  struct jfs_dir_term *terms;
+  int                  num_terms;
+  int                  size;
+  int                  unknown;
+};
+
+static int jfs_dir_parse_terms(int skip_last, const char *dir_key_pairs, 
+                               struct jfs_dir_terms *terms, char **last_key);
+static int jfs_dir_add_term(struct jfs_dir_terms *terms, const char *key, const char *value);
+static void jfs_dir_free_terms(struct jfs_dir_terms *terms);
+static int jfs_dir_create_query(int items, int is_folder, char *path, char *dir_key_pair, char **query,
+                                int **keyids, int *num_keyids);
 
 int 
-jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, char **query)
+jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, char **query,
+                      int **keyids, int *num_keyids)
 {
   char *copy_path;
   char *dir_is_folders;
@@ -118,7 +126,8 @@ jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, c
   }
   strncpy(copy_path, path, path_len);
 
-  rc = jfs_dir_create_query(items, *is_folders, copy_path, dir_key_pairs, &dir_query);
+  rc = jfs_dir_create_query(items, *is_folders, copy_path, dir_key_pairs, &dir_query,
+                            keyids, num_keyids);
   free(dir_key_pairs);
   free(copy_path);
 
@@ -136,395 +145,252 @@ jfs_dir_query_builder(const char *path, const char *realpath, int *is_folders, c
 }
 
 static int
-jfs_dir_create_query(int items, int is_folders, char *path, char *dir_key_pairs, char **dir_query)
+jfs_dir_create_query(int items, int is_folders, char *path, char *dir_key_pairs, char **dir_query,
+                     int **keyids, int *num_keyids)
 {
+  struct jfs_dir_terms terms;
+
   char *datapath;
   char *key_pairs;
   char *key;
   char *value;
-  char *query;
-  char *outer_query;
-
-  char **values;
-  char **parent_key_pairs;
-
-  size_t query_len;
-  size_t current_len;
-  size_t current_pos;
-  size_t end;
 
+  int folder_keyid;
   int rc;
   int i;
 
-  rc = 0;
-  datapath = NULL;
-
-  //allocate memory
-  values = malloc(sizeof(*values) * (items + 1));
-  if(!values) {
-    return -ENOMEM;
-  }
-  
-  parent_key_pairs = malloc(sizeof(*parent_key_pairs) * (items + 1));
-  if(!parent_key_pairs) {
-    free(values);
-    
-    return -ENOMEM;
-  }
-
-  query_len = JFS_QUERY_INC;
-  query = malloc(sizeof(*query) * query_len);
-  if(!query) {
-    free(values);
-    free(parent_key_pairs);
-    
-    return -ENOMEM;
-  }
-  query[0] = '\0';
+  terms.terms = NULL;
+  terms.num_terms = 0;
+  terms.size = 0;
+  terms.unknown = 0;
+  folder_keyid = 0;
+  key = NULL;
 
-  //start building the query
-  //get parent key_pairs and path values
+  //each path item is the value of its parent's folder key
   for(i = 0; i < items; ++i) {
     value = jfs_util_get_last_path_item(path);
     if(!value) {
       rc = -EBADMSG;
-      if(i > 0) {
-        items = i - 1;
-      }
-      
+
       goto cleanup;
     }
 
     *value = '\0';
     ++value;
 
-    values[i] = value;
-    
     rc = jfs_util_get_datapath(path, &datapath);
     if(rc) {
-      if(i > 0) {
-        items = i - 1;
-      }
-
       goto cleanup;
     }
-
-    printf("---datapath:%s\n", datapath);
     
     rc = jfs_meta_do_getxattr(datapath, JFS_DIR_KEY_PAIRS, &key_pairs);
     free(datapath);
-
-    printf("----got key pairs:%s\n", key_pairs);
-
     if(rc) {
-      if(i > 0) {
-        items = i - 1;
-      }
-
       goto cleanup;
     }
 
-    parent_key_pairs[i] = key_pairs;
-  }
-
-  current_len = 0;
-  current_pos = 0;
-  for(i = 0; i < items; ++i) {
-    rc = jfs_dir_parse_key_pairs(1, parent_key_pairs[i], &current_pos, &current_len, &query_len, &query);
+    rc = jfs_dir_parse_terms(1, key_pairs, &terms, &key);
+    free(key_pairs);
     if(rc) {
       goto cleanup;
     }
 
-    key = strrchr(parent_key_pairs[i], '=');
-    if(!key) {
-      rc = -EBADMSG;
-      
-      goto cleanup;
-    }
-
-    if(*(key - 1) != 'k') {
-      rc = -EBADMSG;
-      
+    rc = jfs_dir_add_term(&terms, key, value);
+    free(key);
+    key = NULL;
+    if(rc) {
       goto cleanup;
     }
-    ++key;
-    
-    end = strlen(key) - 1;
-    if(key[end] == ';') {
-      key[end] = '\0';
-    }
-    
-    value = values[i];
-    current_pos = current_len;
-    current_len += strlen(key) + strlen(value) + strlen(JFS_PAIR_QUERY) - JFS_PAIR_ADJUST;
-    if(current_len >= query_len) {
-      rc = jfs_dir_expand_query(&query_len, &query);
-      if(rc) {
-        goto cleanup;
-      }
-    }
-    sprintf(&query[current_pos], JFS_PAIR_QUERY, key, value);
-    current_pos = current_len;
-
-    current_len += strlen(JFS_INTERSECT);
-    if(current_len >= query_len) {
-      rc = jfs_dir_expand_query(&query_len, &query);
-      if(rc) {        
-        goto cleanup;
-      }
-    }
-    sprintf(&query[current_pos], JFS_INTERSECT);
-    current_pos = current_len;
   }
 
   if(is_folders) {
-    rc = jfs_dir_parse_key_pairs(1, dir_key_pairs, &current_pos, &current_len, &query_len, &query);
+    rc = jfs_dir_parse_terms(1, dir_key_pairs, &terms, &key);
     if(rc) {
       goto cleanup;
     }
 
-    key = strrchr(dir_key_pairs, '=');
-    if(!key) {
-      rc = -EBADMSG;
-      
-      goto cleanup;
+    folder_keyid = jfs_util_find_keyid(key);
+    free(key);
+    if(folder_keyid == -ENOATTR) {
+      terms.unknown = 1;
     }
+    else if(folder_keyid < 1) {
+      rc = folder_keyid;
 
-    if(*(key - 1) != 'k') {
-      rc = -EBADMSG;
-      
       goto cleanup;
     }
-    ++key;
-    
-    end = strlen(key) - 1;
-    if(key[end] == ';') {
-      key[end] = '\0';
-    }
-
-    if(!current_len) {
-      query_len = strlen(JFS_FOLDER_SIMPLE_QUERY) + strlen(key) + 1;
-      outer_query = malloc(sizeof(*outer_query) * query_len);
-      if(!outer_query) {
-        rc = -ENOMEM;
-
-        goto cleanup;
-      }
-      snprintf(outer_query, query_len, JFS_FOLDER_SIMPLE_QUERY, key);
-    }
-    else {
-      //remove the last intersect
-      current_len -= strlen(JFS_INTERSECT);
-      query[current_len] = '\0';
-
-      query_len = strlen(JFS_FOLDER_QUERY) + strlen(key) + current_len + 1;
-      outer_query = malloc(sizeof(*outer_query) * query_len);
-      if(!outer_query) {
-        rc = -ENOMEM;
-
-        goto cleanup;
-      }
-      snprintf(outer_query, query_len, JFS_FOLDER_QUERY, key, query);
-    }
   }
   else {
-    rc = jfs_dir_parse_key_pairs(0, dir_key_pairs, &current_pos, &current_len, &query_len, &query);
+    rc = jfs_dir_parse_terms(0, dir_key_pairs, &terms, NULL);
     if(rc) {
       goto cleanup;
     }
-
-    if(!current_len) {
-      rc = -EBADMSG;
-      
-      goto cleanup;
-    }
-    else {
-      //remove the last intersect
-      current_len -= strlen(JFS_INTERSECT);
-      query[current_len] = '\0';
-
-      query_len = strlen(JFS_FILE_QUERY) + current_len + 1;
-      outer_query = malloc(sizeof(*outer_query) * query_len);
-      if(!outer_query) {
-        rc = -ENOMEM;
-
-        goto cleanup;
-      }
-      snprintf(outer_query, query_len, JFS_FILE_QUERY, query);
-    }
   }
 
-  *dir_query = outer_query;
+  //no file has a key that was never set, the listing is empty
+  if(terms.unknown) {
+    goto cleanup;
+  }
 
- cleanup:
-  for(i = 0; i < items; ++i) {
-    free(parent_key_pairs[i]);
+  rc = jfs_dir_plan_query(terms.terms, terms.num_terms, folder_keyid, dir_query);
+  if(rc) {
+    goto cleanup;
   }
-  free(parent_key_pairs);
-  free(values);
-  free(query);
-  
-  return rc;
-}
 
-static int
-jfs_dir_expand_query(size_t *query_len, char **query)
-{
-  char *new_query;
+  //the keys the result depends on
+  *keyids = malloc(sizeof(**keyids) * (terms.num_terms + 1));
+  if(!*keyids) {
+    free(*dir_query);
+    *dir_query = NULL;
+    rc = -ENOMEM;
 
-  size_t new_len;
-  
-  new_len = *query_len + JFS_QUERY_INC;
-  new_query = malloc(sizeof(*new_query) * new_len);
-  if(!new_query) {
-    return -ENOMEM;
+    goto cleanup;
+  }
+  for(i = 0; i < terms.num_terms; ++i) {
+    (*keyids)[i] = terms.terms[i].keyid;
+  }
+  *num_keyids = terms.num_terms;
+  if(folder_keyid) {
+    (*keyids)[(*num_keyids)++] = folder_keyid;
   }
-  strncpy(new_query, *query, *query_len);
-  free(*query);
-
-  *query_len = new_len;
-  *query = new_query;
 
-  return 0;
+ cleanup:
+  jfs_dir_free_terms(&terms);
+  
+  return rc;
 }
 
+/*
+ * Parse key pairs of the form k=key;v=value;k=key;
+ *
+ * Each key, with its value if it has one, is added as a term.
+ * With skip_last the pairs must end in a key without a value,
+ * that key is returned in last_key instead of being added.
+ */
 static int
-jfs_dir_parse_key_pairs(int skip_last, const char *dir_key_pairs, size_t *dir_current_pos,
-                        size_t *dir_current_len, size_t *dir_query_len, char **dir_query)
+jfs_dir_parse_terms(int skip_last, const char *dir_key_pairs, 
+                    struct jfs_dir_terms *terms, char **last_key)
 {
+  char *key_pairs;
+  char *token;
+  char *next;
+  char *save;
   char *key;
   char *value;
-  char *query;
-  char *token;
-  char *key_pairs;
-
-  size_t current_pos;
-  size_t current_len;
-  size_t query_len;
-  size_t key_pairs_len;
-  size_t intersect_len;
-  size_t key_query_len;
-  size_t pair_query_len;
 
   int rc;
 
   if(!strlen(dir_key_pairs) || dir_key_pairs[0] == ';') {
-    return 0;
+    return skip_last ? -EBADMSG : 0;
   }
- 
-  current_pos = *dir_current_pos;
-  current_len = *dir_current_len;
-  query_len = *dir_query_len;
-  current_pos = current_len;
-  query = *dir_query;
-
-  intersect_len = strlen(JFS_INTERSECT);
-  key_query_len = strlen(JFS_KEY_QUERY) - JFS_ITEM_ADJUST;
-  pair_query_len = strlen(JFS_PAIR_QUERY) - JFS_PAIR_ADJUST;
-  key_pairs_len = strlen(dir_key_pairs) + 1;
-
-  key_pairs = malloc(sizeof(*key_pairs) * key_pairs_len);
+
+  key_pairs = strdup(dir_key_pairs);
   if(!key_pairs) {
     return -ENOMEM;
   }
-  strncpy(key_pairs, dir_key_pairs, key_pairs_len);
 
-  //parse the key value pairs
-  token = strtok(key_pairs, ";");
+  rc = 0;
+  token = strtok_r(key_pairs, ";", &save);
   while(token != NULL) {
-    //get the key
-    if(token[0] == 'k') {
-      key = strchr(token, '=');
-      if(!key) {
-        free(key_pairs);
-  
-        return -EBADMSG;
-      }
-
-      if(key != &token[1]) {
-        free(key_pairs);
-        
-        return -EBADMSG;
-      }
-      ++key;
+    //must be a key before there is a value
+    if(token[0] != 'k' || token[1] != '=') {
+      rc = -EBADMSG;
+      break;
+    }
+    key = &token[2];
 
-      //last token, don't add to query, will be used later
-      token = strtok(NULL, ";");
-      if(skip_last && token == NULL) {
+    value = NULL;
+    next = strtok_r(NULL, ";", &save);
+    if(next != NULL && next[0] == 'v') {
+      if(next[1] != '=') {
+        rc = -EBADMSG;
         break;
       }
+      value = &next[2];
+      next = strtok_r(NULL, ";", &save);
     }
-    //must be a key before there is a value
-    else {
-      free(key_pairs);
-      
-      return -EBADMSG;
-    }
-    
-    //check if the next token is a value
-    if(token != NULL && token[0] == 'v') {
-      value = strchr(token, '=');
-      if(!value) {
-        free(key_pairs);
-        
-        return -EBADMSG;
-      }
 
-      if(value != &token[1]) {
-        free(key_pairs);
-        
-        return -EBADMSG;
+    //last key names the folders, it is not a constraint
+    if(skip_last && next == NULL) {
+      if(value) {
+        rc = -EBADMSG;
+        break;
       }
-      ++value;
-      
-      current_len += strlen(key) + strlen(value) + pair_query_len;
-      if(current_len >= query_len) {
-        rc = jfs_dir_expand_query(&query_len, &query);
-        if(rc) {
-          free(key_pairs);
-
-          return rc;
-        }
+
+      *last_key = strdup(key);
+      if(!*last_key) {
+        rc = -ENOMEM;
       }
-      sprintf(&query[current_pos], JFS_PAIR_QUERY, key, value);
-      current_pos = current_len;
+      break;
+    }
 
-      token = strtok(NULL, ";");
+    rc = jfs_dir_add_term(terms, key, value);
+    if(rc) {
+      break;
     }
-    else {
-      current_len += strlen(key) + key_query_len;
-      if(current_len >= query_len) {
-        rc = jfs_dir_expand_query(&query_len, &query);
-        if(rc) {
-          free(key_pairs);
-
-          return rc;
-        }
-      }
-      sprintf(&query[current_pos], JFS_KEY_QUERY, key);
-      current_pos = current_len;
 
-      //already got next token, which is not a value 
+    token = next;
+  }
+  free(key_pairs);
+
+  return rc;
+}
+
+/*
+ * Resolve a key and add it to the terms.
+ *
+ * Listing a folder must not add keys, an unknown key
+ * only marks the terms as unknown.
+ */
+static int
+jfs_dir_add_term(struct jfs_dir_terms *terms, const char *key, const char *value)
+{
+  struct jfs_dir_term *new_terms;
+  char *new_value;
+
+  int keyid;
+
+  keyid = jfs_util_find_keyid(key);
+  if(keyid == -ENOATTR) {
+    terms->unknown = 1;
+
+    return 0;
+  }
+  if(keyid < 1) {
+    return keyid;
+  }
+
+  if(terms->num_terms == terms->size) {
+    new_terms = realloc(terms->terms, sizeof(*new_terms) * (terms->size + JFS_TERMS_INC));
+    if(!new_terms) {
+      return -ENOMEM;
     }
+    terms->terms = new_terms;
+    terms->size += JFS_TERMS_INC;
+  }
 
-    current_len += intersect_len;
-    if(current_len >= query_len) {
-      rc = jfs_dir_expand_query(&query_len, &query);
-      if(rc) {
-        free(key_pairs);
-        
-        return rc;
-      }
+  new_value = NULL;
+  if(value) {
+    new_value = strdup(value);
+    if(!new_value) {
+      return -ENOMEM;
     }
-    sprintf(&query[current_pos], JFS_INTERSECT);
-    current_pos = current_len;
   }
-  free(key_pairs);
 
-  *dir_current_pos = current_pos;
-  *dir_current_len = current_len;
-  *dir_query_len = query_len;
-  *dir_query = query;
+  terms->terms[terms->num_terms].keyid = keyid;
+  terms->terms[terms->num_terms].value = new_value;
+  ++terms->num_terms;
 
   return 0;
 }
+
+static void
+jfs_dir_free_terms(struct jfs_dir_terms *terms)
+{
+  int i;
+
+  for(i = 0; i < terms->num_terms; ++i) {
+    free((char *)terms->terms[i].value);
+  }
+  free(terms->terms);
+}
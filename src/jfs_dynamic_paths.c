@@ -24,59 +24,400 @@
 #include "jfs_util.h"
 #include "jfs_dynamic_paths.h"
 #include "jfs_datapath_cache.h"
-#include "sglib.h"
+#include "jfs_epoch.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 
+#define JFS_CHILDREN_MIN 8
+
+static char jfs_child_deleted;
+#define JFS_CHILD_DELETED ((void *)&jfs_child_deleted)
+
 /*
-  List of files.
+  One component of a path, pointing into the caller's string.
  */
-typedef struct jfs_filelist jfs_filelist_t;
-struct jfs_filelist {
-  char           *name;
-  int             jfs_id;
+typedef struct jfs_path_seg jfs_path_seg_t;
+struct jfs_path_seg {
+  const char   *name;
+  size_t        len;
+  unsigned int  hash;
+};
 
-  jfs_filelist_t *next;
+typedef struct jfs_child jfs_child_t;
+struct jfs_child {
+  unsigned int  hash;
+  const char   *name;
+  void         *item;
 };
 
-#define JFS_FILELIST_T_CMP(e1, e2) (!(e1->name && e2->name && !strcmp(e1->name, e2->name)))
+/*
+  Open addressing table of the children in a directory.
 
-SGLIB_DEFINE_LIST_PROTOTYPES(jfs_filelist_t, JFS_FILELIST_T_CMP, next)
-SGLIB_DEFINE_LIST_FUNCTIONS(jfs_filelist_t, JFS_FILELIST_T_CMP, next)
+  Readers probe it without locks. Writers fill empty slots in place,
+  storing the item last, mark removed slots deleted, and publish a
+  rehashed copy when it fills up. A slot is never reused in place, so
+  a reader that sees an item also sees its hash and name.
+ */
+typedef struct jfs_childtab jfs_childtab_t;
+struct jfs_childtab {
+  size_t       size;
+  size_t       count;
+  size_t       used;
+
+  jfs_child_t  slots[];
+};
 
 /*
-  Directory list.
+  Dynamic file.
  */
-typedef struct jfs_dirlist jfs_dirlist_t;
-typedef struct jfs_dentry jfs_dentry_t;
+typedef struct jfs_dynfile jfs_dynfile_t;
+struct jfs_dynfile {
+  char           *name;
+  int             jfs_id;
+};
 
-struct jfs_dirlist {
+/*
+  Dynamic directory.
+ */
+typedef struct jfs_dyndir jfs_dyndir_t;
+struct jfs_dyndir {
   char           *name;
   char           *datapath;
 
-  jfs_filelist_t *files;
-  jfs_dirlist_t  *folders;
-
-  jfs_dirlist_t  *next;
+  jfs_childtab_t *files;
+  jfs_childtab_t *folders;
 };
 
-#define JFS_DIRLIST_T_CMP(e1, e2) (!(e1->name && e2->name && !strcmp(e1->name, e2->name)))
-
-SGLIB_DEFINE_LIST_PROTOTYPES(jfs_dirlist_t, JFS_DIRLIST_T_CMP, next)
-SGLIB_DEFINE_LIST_FUNCTIONS(jfs_dirlist_t, JFS_DIRLIST_T_CMP, next)
+static jfs_dyndir_t jfs_root;
 
-static jfs_dirlist_t jfs_root;
-static pthread_rwlock_t path_lock;
+//serializes writers, readers only take it when out of epoch slots
+static pthread_mutex_t path_lock;
 
-static void jfs_dynamic_hierarchy_folder_cleanup(jfs_dirlist_t *root);
+static void jfs_dynamic_hierarchy_forget(jfs_dyndir_t *root);
 
 static int 
-jfs_dynamic_hierarchy_get_node(const char *path, jfs_filelist_t **file, 
-                               jfs_dirlist_t **dir, int delete_dir, int delete_file);
+jfs_dynamic_hierarchy_get_node(const char *path, jfs_dynfile_t **file, 
+                               jfs_dyndir_t **dir, int delete_dir, int delete_file);
+
+/*
+  Step cursor to the next path segment, hashing it on the way.
+
+  Returns 1 if a segment was found, 0 at the end of the path.
+ */
+static int
+jfs_path_next(const char **cursor, jfs_path_seg_t *seg)
+{
+  unsigned int hash;
+  const char *c;
+
+  for(c = *cursor; *c == '/'; ++c);
+  if(!*c) {
+    *cursor = c;
+
+    return 0;
+  }
+
+  hash = 5381;
+  seg->name = c;
+  for(; *c && *c != '/'; ++c) {
+    hash = ((hash << 5) + hash) + *c;
+  }
+  seg->len = c - seg->name;
+  seg->hash = hash;
+  *cursor = c;
+
+  return 1;
+}
+
+/*
+  Returns the live slot holding the segment, or NULL. The item seen in
+  the slot is returned too, as the slot may be deleted right after.
+ */
+static jfs_child_t *
+jfs_childtab_slot(jfs_childtab_t **tabp, const jfs_path_seg_t *seg, void **itemp)
+{
+  jfs_childtab_t *tab;
+  jfs_child_t *child;
+
+  void *item;
+
+  size_t mask;
+  size_t i;
+
+  tab = __atomic_load_n(tabp, __ATOMIC_ACQUIRE);
+  if(!tab) {
+    return NULL;
+  }
+
+  mask = tab->size - 1;
+  for(i = seg->hash & mask; ; i = (i + 1) & mask) {
+    child = &tab->slots[i];
+
+    item = __atomic_load_n(&child->item, __ATOMIC_ACQUIRE);
+    if(!item) {
+      return NULL;
+    }
+
+    if(item != JFS_CHILD_DELETED && child->hash == seg->hash && 
+       !strncmp(child->name, seg->name, seg->len) && child->name[seg->len] == '\0') {
+      *itemp = item;
+
+      return child;
+    }
+  }
+}
+
+static void *
+jfs_childtab_find(jfs_childtab_t **tabp, const jfs_path_seg_t *seg)
+{
+  void *item;
+
+  if(!jfs_childtab_slot(tabp, seg, &item)) {
+    return NULL;
+  }
+
+  return item;
+}
+
+static void
+jfs_childtab_place(jfs_childtab_t *tab, unsigned int hash, const char *name, void *item)
+{
+  jfs_child_t *child;
+
+  size_t mask;
+  size_t i;
+
+  mask = tab->size - 1;
+  for(i = hash & mask; tab->slots[i].item; i = (i + 1) & mask);
+
+  child = &tab->slots[i];
+  child->hash = hash;
+  child->name = name;
+  __atomic_store_n(&child->item, item, __ATOMIC_RELEASE);
+}
+
+/*
+  HOLD THE PATH LOCK
+
+  Publish a copy of the table without deleted slots, sized for at
+  least one more child.
+ */
+static int
+jfs_childtab_rehash(jfs_childtab_t **tabp)
+{
+  jfs_childtab_t *old;
+  jfs_childtab_t *tab;
+  jfs_child_t *child;
+
+  size_t count;
+  size_t size;
+  size_t i;
+
+  old = *tabp;
+  count = old ? old->count : 0;
+
+  for(size = JFS_CHILDREN_MIN; (count + 1) * 2 > size; size *= 2);
+
+  tab = calloc(1, sizeof(*tab) + sizeof(tab->slots[0]) * size);
+  if(!tab) {
+    return -ENOMEM;
+  }
+  tab->size = size;
+
+  if(old) {
+    for(i = 0; i < old->size; ++i) {
+      child = &old->slots[i];
+
+      if(child->item && child->item != JFS_CHILD_DELETED) {
+        jfs_childtab_place(tab, child->hash, child->name, child->item);
+      }
+    }
+    tab->count = old->count;
+    tab->used = old->count;
+  }
+  __atomic_store_n(tabp, tab, __ATOMIC_RELEASE);
+
+  if(old) {
+    jfs_epoch_retire(old, free);
+  }
+
+  return 0;
+}
+
+/*
+  HOLD THE PATH LOCK
+
+  Insert an item whose name is not already in the table. The name is
+  owned by the item and must hash to the given value.
+ */
+static int
+jfs_childtab_insert(jfs_childtab_t **tabp, const char *name, 
+                    unsigned int hash, void *item)
+{
+  jfs_childtab_t *tab;
+
+  int rc;
+
+  //keep the load factor, deleted slots included, under 3/4
+  tab = *tabp;
+  if(!tab || (tab->used + 1) * 4 > tab->size * 3) {
+    rc = jfs_childtab_rehash(tabp);
+    if(rc) {
+      return rc;
+    }
+    tab = *tabp;
+  }
+
+  jfs_childtab_place(tab, hash, name, item);
+  ++tab->count;
+  ++tab->used;
+
+  return 0;
+}
+
+/*
+  HOLD THE PATH LOCK
+
+  Remove the segment from the table and return its item, or NULL.
+  The item must be retired, not freed.
+ */
+static void *
+jfs_childtab_delete(jfs_childtab_t **tabp, const jfs_path_seg_t *seg)
+{
+  jfs_child_t *child;
+
+  void *item;
+
+  child = jfs_childtab_slot(tabp, seg, &item);
+  if(!child) {
+    return NULL;
+  }
+
+  __atomic_store_n(&child->item, JFS_CHILD_DELETED, __ATOMIC_RELEASE);
+  --(*tabp)->count;
+
+  return item;
+}
+
+static size_t
+jfs_childtab_count(jfs_childtab_t *tab)
+{
+  return tab ? tab->count : 0;
+}
+
+static void
+jfs_dynfile_free(void *arg)
+{
+  jfs_dynfile_t *file;
+
+  file = arg;
+  free(file->name);
+  free(file);
+}
+
+/*
+  Free a directory whose children were already released.
+ */
+static void
+jfs_dyndir_free(void *arg)
+{
+  jfs_dyndir_t *dir;
+
+  dir = arg;
+  free(dir->files);
+  free(dir->folders);
+  free(dir->datapath);
+  free(dir->name);
+  free(dir);
+}
+
+/*
+  Free a table of files along with the files in it.
+ */
+static void
+jfs_childtab_free_files(void *arg)
+{
+  jfs_childtab_t *tab;
+  jfs_child_t *child;
+
+  size_t i;
+
+  tab = arg;
+  for(i = 0; i < tab->size; ++i) {
+    child = &tab->slots[i];
+
+    if(child->item && child->item != JFS_CHILD_DELETED) {
+      jfs_dynfile_free(child->item);
+    }
+  }
+  free(tab);
+}
+
+/*
+  Free a table of folders along with everything below them.
+ */
+static void
+jfs_childtab_free_folders(void *arg)
+{
+  jfs_childtab_t *tab;
+  jfs_child_t *child;
+  jfs_dyndir_t *dir;
+
+  size_t i;
+
+  tab = arg;
+  for(i = 0; i < tab->size; ++i) {
+    child = &tab->slots[i];
+
+    if(child->item && child->item != JFS_CHILD_DELETED) {
+      dir = child->item;
+
+      if(dir->files) {
+        jfs_childtab_free_files(dir->files);
+        dir->files = NULL;
+      }
+      if(dir->folders) {
+        jfs_childtab_free_folders(dir->folders);
+        dir->folders = NULL;
+      }
+      jfs_dyndir_free(dir);
+    }
+  }
+  free(tab);
+}
+
+/*
+  Enter a lock free read of the hierarchy.
+
+  Returns 1 if the path lock had to be taken instead.
+ */
+static int
+jfs_dynamic_read_begin(void)
+{
+  if(jfs_epoch_enter()) {
+    pthread_mutex_lock(&path_lock);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+static void
+jfs_dynamic_read_end(int locked)
+{
+  if(locked) {
+    pthread_mutex_unlock(&path_lock);
+  }
+  else {
+    jfs_epoch_exit();
+  }
+}
 
 int
 jfs_dynamic_path_init(void)
@@ -86,114 +427,213 @@ jfs_dynamic_path_init(void)
   
   jfs_root.files = NULL;
   jfs_root.folders = NULL;
-  jfs_root.next = NULL;
   jfs_root.datapath = NULL;
 
-  pthread_rwlock_init(&path_lock, NULL);
+  pthread_mutex_init(&path_lock, NULL);
 
   return 0;
 }
 
 /*
-  Resolves a dynamic path into a datapath.
+  Resolves a dynamic path into a caller provided buffer.
 
-  Returns 0 on success, -ENOENT or -ENOMEM on failure.
+  Returns 0 on success, -ENOENT or -ENAMETOOLONG on failure.
  */
 int
-jfs_dynamic_path_resolution(const char *path, char **resolved_path, int *jfs_id)
+jfs_dynamic_path_resolve(const char *path, char *buf, size_t size, int *jfs_id)
 {
-  jfs_dirlist_t *dir;
-  jfs_filelist_t *file;
+  jfs_dyndir_t *dir;
+  jfs_dynfile_t *file;
 
-  char *datapath;
+  const char *datapath;
 
   size_t datapath_len;
 
+  int locked;
   int rc;
 
   dir = NULL;
   file = NULL;
-  pthread_rwlock_rdlock(&path_lock);
+  locked = jfs_dynamic_read_begin();
   rc = jfs_dynamic_hierarchy_get_node(path, &file, &dir, 0, 0);
 
   if(rc) {
-    pthread_rwlock_unlock(&path_lock);
+    jfs_dynamic_read_end(locked);
     return rc;
   }
 
   if(file) {
-    *jfs_id = file->jfs_id;
-    pthread_rwlock_unlock(&path_lock);
+    *jfs_id = __atomic_load_n(&file->jfs_id, __ATOMIC_RELAXED);
+    jfs_dynamic_read_end(locked);
 
-    rc = jfs_datapath_cache_get_datapath(*jfs_id, resolved_path);
-    if(rc) {
-      return rc;
+    if(!buf) {
+      return 0;
     }
+
+    return jfs_datapath_cache_copy_datapath(*jfs_id, buf, size);
   }
-  else {
-    *jfs_id = 0;
 
-    if(dir->datapath == NULL) {
-      pthread_rwlock_unlock(&path_lock);
+  *jfs_id = 0;
+  if(buf) {
+    datapath = __atomic_load_n(&dir->datapath, __ATOMIC_ACQUIRE);
+    if(!datapath) {
+      datapath = path;
+    }
+    datapath_len = strlen(datapath) + 1;
 
-      datapath_len = strlen(path) + 1;
-      datapath = malloc(sizeof(*datapath) * datapath_len);
-      if(!datapath) {
-        return -ENOMEM;
-      }
-      strncpy(datapath, path, datapath_len);
+    if(datapath_len > size) {
+      jfs_dynamic_read_end(locked);
+
+      return -ENAMETOOLONG;
     }
-    else {
-      datapath_len = strlen(dir->datapath) + 1;
-      datapath = malloc(sizeof(*datapath) * datapath_len);
-      if(!datapath) {
-        pthread_rwlock_unlock(&path_lock);
-        
+    memcpy(buf, datapath, datapath_len);
+  }
+  jfs_dynamic_read_end(locked);
+
+  return 0;
+}
+
+/*
+  Resolves a dynamic path into a datapath.
+
+  Returns 0 on success, -ENOENT or -ENOMEM on failure.
+ */
+int
+jfs_dynamic_path_resolution(const char *path, char **resolved_path, int *jfs_id)
+{
+  char datapath[PATH_MAX];
+
+  int rc;
+
+  rc = jfs_dynamic_path_resolve(path, datapath, sizeof(datapath), jfs_id);
+  if(rc) {
+    return rc;
+  }
+
+  *resolved_path = strdup(datapath);
+  if(!*resolved_path) {
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+static jfs_dyndir_t *
+jfs_dynamic_hierarchy_dir_create(const jfs_path_seg_t *seg, const char *datapath)
+{
+  jfs_dyndir_t *dir;
+
+  dir = calloc(1, sizeof(*dir));
+  if(!dir) {
+    return NULL;
+  }
+
+  dir->name = strndup(seg->name, seg->len);
+  if(!dir->name) {
+    free(dir);
+
+    return NULL;
+  }
+
+  if(datapath) {
+    dir->datapath = strdup(datapath);
+    if(!dir->datapath) {
+      free(dir->name);
+      free(dir);
+
+      return NULL;
+    }
+  }
+
+  return dir;
+}
+
+/*
+  Call inside a read section, or with the path lock held if create
+  is set.
+
+  Finds the directory holding the last segment of path without copying
+  it. Missing directories along the way are added when create is set.
+  Parent is set to NULL for the root.
+ */
+static int
+jfs_dynamic_hierarchy_walk(const char *path, int create, 
+                           jfs_dyndir_t **parent, jfs_path_seg_t *last)
+{
+  jfs_dyndir_t *current_dir;
+  jfs_dyndir_t *next_dir;
+
+  jfs_path_seg_t next;
+
+  const char *cursor;
+
+  int rc;
+
+  if(path[0] != '/') {
+    return -ENOENT;
+  }
+
+  cursor = path;
+  if(!jfs_path_next(&cursor, last)) {
+    *parent = NULL;
+
+    return 0;
+  }
+
+  current_dir = &jfs_root;
+  while(jfs_path_next(&cursor, &next)) {
+    next_dir = jfs_childtab_find(&current_dir->folders, last);
+
+    if(!next_dir) {
+      if(!create) {
+        return -ENOENT;
+      }
+
+      next_dir = jfs_dynamic_hierarchy_dir_create(last, NULL);
+      if(!next_dir) {
         return -ENOMEM;
       }
-      strncpy(datapath, dir->datapath, datapath_len);
-      pthread_rwlock_unlock(&path_lock);
+
+      rc = jfs_childtab_insert(&current_dir->folders, next_dir->name, 
+                               last->hash, next_dir);
+      if(rc) {
+        jfs_dyndir_free(next_dir);
+
+        return rc;
+      }
     }
-    
-    *resolved_path = datapath;
+    current_dir = next_dir;
+    *last = next;
   }
+  *parent = current_dir;
 
   return 0;
 }
 
 /*
-  LOCK THE MUTEX BEFORE CALLING THIS METHOD AND UNLOCK WHEN FINISHED
-  WITH THE RESULT NODE
+  Call inside a read section, or with the path lock held if deleting.
+  Deleted nodes must be retired, not freed.
  */
 static int 
-jfs_dynamic_hierarchy_get_node(const char *path, jfs_filelist_t **file, 
-                               jfs_dirlist_t **dir, int delete_dir, int delete_file)
+jfs_dynamic_hierarchy_get_node(const char *path, jfs_dynfile_t **file, 
+                               jfs_dyndir_t **dir, int delete_dir, int delete_file)
 {
-  size_t path_len;
+  jfs_dyndir_t *parent;
+  jfs_dyndir_t *result_dir;
 
-  char *path_copy;
-  char *last_token;
-  char *token;
+  jfs_dynfile_t *result_file;
 
-  jfs_dirlist_t *current_dir;
-  jfs_dirlist_t *result_dir;
-  jfs_dirlist_t  check_dir;
-
-  jfs_filelist_t *result_file;
-  jfs_filelist_t  check_file;
+  jfs_path_seg_t name;
 
   int rc;
-  
-  path_len = strlen(path) + 1;
-  if(path_len < 1) {
-    return -ENOENT;
-  }
-  else if(path[0] != '/') {
-    return -ENOENT;
+
+  rc = jfs_dynamic_hierarchy_walk(path, 0, &parent, &name);
+  if(rc) {
+    return rc;
   }
 
   //root node?
-  if(path_len == 2) {
+  if(!parent) {
     if(!dir) {
       return -ENOENT;
     }
@@ -201,80 +641,39 @@ jfs_dynamic_hierarchy_get_node(const char *path, jfs_filelist_t **file,
 
     return 0;
   }
-  
-  path_copy = malloc(sizeof(*path_copy) * path_len);
-  if(!path_copy) {
-    return -ENOMEM;
-  }
-  strncpy(path_copy, path, path_len);
 
-  last_token = strrchr(path_copy, '/') + 1;
-  current_dir = &jfs_root;
-  token = strtok(&path_copy[1], "/");
-  
-  while(token != NULL) {
-    //last token, check folders and files
-    if(token == last_token) {
-      check_dir.name = token;
-
-      if(delete_dir && dir) {
-        rc = sglib_jfs_dirlist_t_delete_if_member(&current_dir->folders, &check_dir, &result_dir);
-      }
-      else {
-        result_dir = sglib_jfs_dirlist_t_find_member(current_dir->folders, &check_dir);
-      }
+  //last segment, check folders and files
+  if(delete_dir && dir) {
+    result_dir = jfs_childtab_delete(&parent->folders, &name);
+  }
+  else {
+    result_dir = jfs_childtab_find(&parent->folders, &name);
+  }
 
-      if(result_dir) {
-        free(path_copy);
+  if(result_dir) {
+    if(!dir) {
+      return -ENOENT;
+    }
+    *dir = result_dir;
 
-        if(!dir) {
-          return -ENOENT;
-        }
-        *dir = result_dir;
+    return 0;
+  }
 
-        return 0;
-      }
-      else {
-        check_file.name = token;
-
-        if(delete_file && file) {
-          rc = sglib_jfs_filelist_t_delete_if_member(&current_dir->files, &check_file, &result_file);
-        }
-        else {
-          result_file = sglib_jfs_filelist_t_find_member(current_dir->files, &check_file);
-        }
-        
-        if(result_file) {
-          free(path_copy);
-
-          if(!file) {   
-            return -ENOENT;
-          }
-          *file = result_file;
-          
-          return 0;
-        }
-        else {
-          free(path_copy);
-          
-          return -ENOENT;
-        }
-      }
-    }
-    //check folders only
-    else {
-      check_dir.name = token;
-      current_dir = sglib_jfs_dirlist_t_find_member(current_dir->folders, &check_dir);
-      if(!current_dir) {
-        free(path_copy);
+  if(delete_file && file) {
+    result_file = jfs_childtab_delete(&parent->files, &name);
+  }
+  else {
+    result_file = jfs_childtab_find(&parent->files, &name);
+  }
 
-        return -ENOENT;
-      }
+  if(result_file) {
+    if(!file) {
+      return -ENOENT;
     }
+    *file = result_file;
 
-    token = strtok(NULL, "/");
+    return 0;
   }
-  free(path_copy);
 
   return -ENOENT;
 }
@@ -287,114 +686,60 @@ Returns 0 on success, negative error code on failure.
 int
 jfs_dynamic_hierarchy_add_file(const char *path, const char *datapath, int jfs_id)
 {
-  jfs_filelist_t *file;
+  jfs_dynfile_t *file;
+  jfs_dyndir_t  *parent;
 
-  jfs_dirlist_t *current_dir;
-  jfs_dirlist_t *result_dir;
-  jfs_dirlist_t *check_dir;
-
-  size_t copy_path_len;
-  size_t token_len;
-
-  char *copy_path;
-  char *last_token;
-  char *token;
+  jfs_path_seg_t name;
 
   int rc;
 
-  if(strlen(path) < 2 || path[0] != '/') {
-    return -ENOENT;
-  }
+  pthread_mutex_lock(&path_lock);
+  rc = jfs_dynamic_hierarchy_walk(path, 1, &parent, &name);
+  if(rc || !parent) {
+    pthread_mutex_unlock(&path_lock);
 
-  copy_path_len = strlen(path) + 1;
-  copy_path = malloc(sizeof(*copy_path) * copy_path_len);
-  if(!copy_path) {
-    return -ENOMEM;
+    return rc ? rc : -ENOENT;
   }
-  strncpy(copy_path, path, copy_path_len);
 
-  last_token = strrchr(copy_path, '/') + 1;
-  token = strtok(&copy_path[1], "/");
-  current_dir = &jfs_root;
+  //already listed, point it at the new item
+  file = jfs_childtab_find(&parent->files, &name);
+  if(file) {
+    __atomic_store_n(&file->jfs_id, jfs_id, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&path_lock);
 
-  pthread_rwlock_wrlock(&path_lock);
-  while(token != NULL) {
-    token_len = strlen(token) + 1;
+    return jfs_datapath_cache_add(jfs_id, datapath);
+  }
 
-    //resolve the path and add the file
-    if(token == last_token) {
-      file = malloc(sizeof(*file));
-      if(!file) {
-        pthread_rwlock_unlock(&path_lock);
-        free(copy_path);
+  file = malloc(sizeof(*file));
+  if(!file) {
+    pthread_mutex_unlock(&path_lock);
 
-        return -ENOMEM;
-      }
+    return -ENOMEM;
+  }
 
-      file->name = malloc(sizeof(*file->name) * token_len);
-      if(!file->name) {
-        pthread_rwlock_unlock(&path_lock);
-        free(copy_path);
-        free(file);
+  file->name = strndup(name.name, name.len);
+  if(!file->name) {
+    pthread_mutex_unlock(&path_lock);
+    free(file);
 
-        return -ENOMEM;
-      }
-      strncpy(file->name, token, token_len);
-      file->name[token_len - 1] = '\0';
-
-      file->jfs_id = jfs_id;
-      file->next = NULL;
-      
-      sglib_jfs_filelist_t_add(&current_dir->files, file);
-      pthread_rwlock_unlock(&path_lock);
-      free(copy_path);
-      
-      return jfs_datapath_cache_add(jfs_id, datapath);
-    }
-    //find the directory the file is in
-    else {
-      check_dir = malloc(sizeof(*check_dir));
-      if(!check_dir) {
-        pthread_rwlock_unlock(&path_lock);
-        free(copy_path);
-        
-        return -ENOMEM;
-      }
-      
-      check_dir->name = malloc(sizeof(*check_dir->name) * token_len);
-      if(!check_dir->name) {
-        pthread_rwlock_unlock(&path_lock);
-        free(check_dir);
-        free(copy_path);
-        
-        return -ENOMEM;
-      }
-      strncpy(check_dir->name, token, token_len);
-      check_dir->name[token_len - 1] = '\0';
-      
-      check_dir->datapath = NULL;
-      check_dir->files = NULL;
-      check_dir->folders = NULL;
-      check_dir->next = NULL;
-      
-      rc = sglib_jfs_dirlist_t_add_if_not_member(&current_dir->folders, check_dir, &result_dir);
-      if(rc) { //item was inserted
-        current_dir = check_dir;
-      }
-      else { //was already in the list
-        current_dir = result_dir;
+    return -ENOMEM;
+  }
+  file->jfs_id = jfs_id;
 
-        free(check_dir->name);
-        free(check_dir);
-      }
-    }
+  //cache the datapath before readers can find the file
+  rc = jfs_datapath_cache_add(jfs_id, datapath);
+  if(!rc) {
+    rc = jfs_childtab_insert(&parent->files, file->name, name.hash, file);
+  }
+  pthread_mutex_unlock(&path_lock);
 
-    token = strtok(NULL, "/");
+  if(rc) {
+    jfs_dynfile_free(file);
+
+    return rc;
   }
-  pthread_rwlock_unlock(&path_lock);
-  free(copy_path);
-  
-  return -ENOENT;
+
+  return 0;
 }
 
 /*
@@ -403,157 +748,161 @@ Add a folder to the dynamic hierarchy.
 int
 jfs_dynamic_hierarchy_add_folder(const char *path, const char *datapath)
 {
-  jfs_dirlist_t *check_dir;
-  jfs_dirlist_t *current_dir;
-  jfs_dirlist_t *result_dir;
+  jfs_dyndir_t *parent;
+  jfs_dyndir_t *dir;
 
-  size_t datapath_len;
-  size_t copy_path_len;
-  size_t token_len;
+  jfs_path_seg_t name;
 
-  char *token;
-  char *last_token;
-  char *copy_path;
   char *d_path;
 
   int rc;
 
-  if(strlen(path) < 2 || path[0] != '/') {
-    return -ENOENT;
-  }
+  pthread_mutex_lock(&path_lock);
+  rc = jfs_dynamic_hierarchy_walk(path, 1, &parent, &name);
+  if(rc || !parent) {
+    pthread_mutex_unlock(&path_lock);
 
-  copy_path_len = strlen(path) + 1;
-  copy_path = malloc(sizeof(*copy_path) * copy_path_len);
-  if(!copy_path) {
-    return -ENOMEM;
+    return rc ? rc : -ENOENT;
   }
-  strncpy(copy_path, path, copy_path_len);
-  
-  last_token = strrchr(copy_path, '/') + 1;
-  token = strtok(&copy_path[1], "/");
-  current_dir = &jfs_root;
-  
-  pthread_rwlock_wrlock(&path_lock);
-  while(token != NULL) {
-    token_len = strlen(token) + 1;
-
-    check_dir = malloc(sizeof(*check_dir));
-    if(!check_dir) {
-      pthread_rwlock_unlock(&path_lock);
-      free(copy_path);
-      
-      return -ENOMEM;
-    }
 
-    check_dir->name = malloc(sizeof(*check_dir->name) * token_len);
-    if(!check_dir->name) {
-      pthread_rwlock_unlock(&path_lock);
-      free(copy_path);
-      free(check_dir);
+  //already listed, keep its contents and swap in the new datapath
+  dir = jfs_childtab_find(&parent->folders, &name);
+  if(dir) {
+    d_path = strdup(datapath);
+    if(!d_path) {
+      pthread_mutex_unlock(&path_lock);
 
       return -ENOMEM;
     }
-    strncpy(check_dir->name, token, token_len);
-    check_dir->name[token_len - 1] = '\0';
-
-    check_dir->datapath = NULL;
-    check_dir->files = NULL;
-    check_dir->folders = NULL;
-    check_dir->next = NULL;
-
-    if(token == last_token) {
-      datapath_len = strlen(datapath) + 1;
-      d_path = malloc(sizeof(*d_path) * datapath_len);
-      if(!d_path) {
-        pthread_rwlock_unlock(&path_lock);
-        free(copy_path);
-        free(check_dir);
-        
-        return -ENOMEM;
-      }
-      strncpy(d_path, datapath, datapath_len);
+    d_path = __atomic_exchange_n(&dir->datapath, d_path, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&path_lock);
 
-      check_dir->datapath = d_path;
-      sglib_jfs_dirlist_t_add(&current_dir->folders, check_dir);
-      pthread_rwlock_unlock(&path_lock);
-      free(copy_path);
-
-      return 0;
+    if(d_path) {
+      jfs_epoch_retire(d_path, free);
     }
-    else {
-      rc = sglib_jfs_dirlist_t_add_if_not_member(&current_dir->folders, check_dir, &result_dir);
 
-      if(rc) { //item was inserted
-        current_dir = check_dir;
-      }
-      else { //was already in the list
-        current_dir = result_dir;
+    return 0;
+  }
 
-        free(check_dir->name);
-        free(check_dir);
-      }
-    }
+  dir = jfs_dynamic_hierarchy_dir_create(&name, datapath);
+  if(!dir) {
+    pthread_mutex_unlock(&path_lock);
 
-    token = strtok(NULL, "/");
+    return -ENOMEM;
   }
-  pthread_rwlock_unlock(&path_lock);
-  free(copy_path);
-  
-  return -ENOENT;
+
+  rc = jfs_childtab_insert(&parent->folders, dir->name, name.hash, dir);
+  pthread_mutex_unlock(&path_lock);
+
+  if(rc) {
+    jfs_dyndir_free(dir);
+
+    return rc;
+  }
+
+  return 0;
 }
 
 int 
 jfs_dynamic_hierarchy_rename(const char *path, const char *filename)
 {
-  jfs_filelist_t *file;
-  jfs_dirlist_t  *dir;
+  jfs_dyndir_t  *parent;
+  jfs_dyndir_t  *dir;
+
+  jfs_childtab_t **tabp;
+
+  jfs_path_seg_t old_name;
+  jfs_path_seg_t new_name;
+
+  const char *cursor;
 
   char *new_filename;
+  char *old_filename;
+  char **item_name;
 
-  size_t filename_len;
+  void *item;
 
   int rc;
 
-  dir = NULL;
-  file = NULL;
-  pthread_rwlock_wrlock(&path_lock);
-  rc = jfs_dynamic_hierarchy_get_node(path, &file, &dir, 0, 0);
-  
-  if(rc) {
-    pthread_rwlock_unlock(&path_lock);
+  cursor = filename;
+  if(!jfs_path_next(&cursor, &new_name) || *cursor) {
+    return -EINVAL;
+  }
+
+  pthread_mutex_lock(&path_lock);
+  rc = jfs_dynamic_hierarchy_walk(path, 0, &parent, &old_name);
+  if(rc || !parent) {
+    pthread_mutex_unlock(&path_lock);
     
-    return rc;
+    return rc ? rc : -EBUSY;
+  }
+
+  tabp = &parent->folders;
+  item = jfs_childtab_find(tabp, &old_name);
+  if(item) {
+    dir = item;
+    item_name = &dir->name;
   }
+  else {
+    tabp = &parent->files;
+    item = jfs_childtab_find(tabp, &old_name);
+    if(!item) {
+      pthread_mutex_unlock(&path_lock);
 
-  filename_len = strlen(filename) + 1;
-  new_filename = malloc(sizeof(*new_filename) * filename_len);
+      return -ENOENT;
+    }
+    item_name = &((jfs_dynfile_t *)item)->name;
+  }
+
+  if(jfs_childtab_find(tabp, &new_name)) {
+    pthread_mutex_unlock(&path_lock);
+
+    return -EEXIST;
+  }
+
+  new_filename = strndup(new_name.name, new_name.len);
   if(!new_filename) {
-    pthread_rwlock_unlock(&path_lock);
+    pthread_mutex_unlock(&path_lock);
 
     return -ENOMEM;
   }
-  strncpy(new_filename, filename, filename_len);
 
-  if(file) {
-    free(file->name);
-    file->name = new_filename;
-  }
-  else {
-    free(dir->name);
-    dir->name = new_filename;
+  //the name is the key, so publish the new slot before dropping the old
+  rc = jfs_childtab_insert(tabp, new_filename, new_name.hash, item);
+  if(rc) {
+    pthread_mutex_unlock(&path_lock);
+    free(new_filename);
+
+    return rc;
   }
-  pthread_rwlock_unlock(&path_lock);
+  jfs_childtab_delete(tabp, &old_name);
+
+  old_filename = *item_name;
+  *item_name = new_filename;
+  pthread_mutex_unlock(&path_lock);
+
+  jfs_epoch_retire(old_filename, free);
 
   return 0;
 }
 
+/*
+  No readers may be active.
+ */
 int
 jfs_dynamic_hierarchy_destroy(void)
 {
-  pthread_rwlock_wrlock(&path_lock);
-  jfs_dynamic_hierarchy_folder_cleanup(&jfs_root);
-  pthread_rwlock_unlock(&path_lock);
-  pthread_rwlock_destroy(&path_lock);
+  pthread_mutex_lock(&path_lock);
+  if(jfs_root.files) {
+    jfs_childtab_free_files(jfs_root.files);
+    jfs_root.files = NULL;
+  }
+  if(jfs_root.folders) {
+    jfs_childtab_free_folders(jfs_root.folders);
+    jfs_root.folders = NULL;
+  }
+  pthread_mutex_unlock(&path_lock);
+  pthread_mutex_destroy(&path_lock);
 
   free(jfs_root.name);
 
@@ -563,24 +912,22 @@ jfs_dynamic_hierarchy_destroy(void)
 int
 jfs_dynamic_hierarchy_unlink(const char *path)
 {
-  jfs_filelist_t *file;
+  jfs_dynfile_t *file;
 
   int rc;
 
   file = NULL;
   
-  pthread_rwlock_wrlock(&path_lock);
+  pthread_mutex_lock(&path_lock);
   rc = jfs_dynamic_hierarchy_get_node(path, &file, NULL, 0, 1);
-  pthread_rwlock_unlock(&path_lock);
+  pthread_mutex_unlock(&path_lock);
   
   if(rc) { 
     return rc;
   }
 
   jfs_datapath_cache_remove(file->jfs_id);
-
-  free(file->name);
-  free(file);
+  jfs_epoch_retire(file, jfs_dynfile_free);
 
   return rc;
 }
@@ -588,51 +935,41 @@ jfs_dynamic_hierarchy_unlink(const char *path)
 int
 jfs_dynamic_hierarchy_rmdir(const char *path)
 {
-  jfs_dirlist_t *dir;
+  jfs_dyndir_t *dir;
   
-  int not_empty;
   int rc;
 
   dir = NULL;
 
-  pthread_rwlock_wrlock(&path_lock);
+  pthread_mutex_lock(&path_lock);
   rc = jfs_dynamic_hierarchy_get_node(path, NULL, &dir, 0, 0);
   
   if(rc) {
-    pthread_rwlock_unlock(&path_lock);
+    pthread_mutex_unlock(&path_lock);
 
     return rc;
   }
 
-  not_empty = 0;
-  if(dir->folders) {
-    not_empty += sglib_jfs_dirlist_t_len(dir->folders);
-    if(not_empty) {
-      pthread_rwlock_unlock(&path_lock);
+  if(dir == &jfs_root) {
+    pthread_mutex_unlock(&path_lock);
 
-      return -ENOTEMPTY;
-    }
+    return -EBUSY;
   }
 
-  if(dir->files) {
-    not_empty += sglib_jfs_filelist_t_len(dir->files);
-    if(not_empty) {
-      pthread_rwlock_unlock(&path_lock);
+  if(jfs_childtab_count(dir->folders) || jfs_childtab_count(dir->files)) {
+    pthread_mutex_unlock(&path_lock);
 
-      return -ENOTEMPTY;
-    }
+    return -ENOTEMPTY;
   }
   
   rc = jfs_dynamic_hierarchy_get_node(path, NULL, &dir, 1, 0);
-  pthread_rwlock_unlock(&path_lock);
+  pthread_mutex_unlock(&path_lock);
   
   if(rc) {
     return rc;
   }
   
-  free(dir->datapath);
-  free(dir->name);
-  free(dir);
+  jfs_epoch_retire(dir, jfs_dyndir_free);
   
   return 0;
 }
@@ -640,70 +977,77 @@ jfs_dynamic_hierarchy_rmdir(const char *path)
 int
 jfs_dynamic_hierarchy_invalidate_folder(const char *path)
 {
-  jfs_dirlist_t  *root;
+  jfs_childtab_t *files;
+  jfs_childtab_t *folders;
+
+  jfs_dyndir_t  *root;
 
   int rc;
   
   root = NULL;
-  pthread_rwlock_wrlock(&path_lock);
+  pthread_mutex_lock(&path_lock);
   rc = jfs_dynamic_hierarchy_get_node(path, NULL, &root, 0, 0);
   
   if(rc == -ENOENT) {
-    pthread_rwlock_unlock(&path_lock);
+    pthread_mutex_unlock(&path_lock);
     
     return 0;
   }
   else if(rc) {
-    pthread_rwlock_unlock(&path_lock);
+    pthread_mutex_unlock(&path_lock);
 
     return rc;
   }
 
-  jfs_dynamic_hierarchy_folder_cleanup(root);
-  pthread_rwlock_unlock(&path_lock);
+  jfs_dynamic_hierarchy_forget(root);
+
+  //unpublish the contents, readers still inside see the old tables
+  files = root->files;
+  folders = root->folders;
+  __atomic_store_n(&root->files, NULL, __ATOMIC_RELEASE);
+  __atomic_store_n(&root->folders, NULL, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&path_lock);
+
+  if(files) {
+    jfs_epoch_retire(files, jfs_childtab_free_files);
+  }
+  if(folders) {
+    jfs_epoch_retire(folders, jfs_childtab_free_folders);
+  }
 
   return 0;
 }
 
 /*
-  TAKE A WRITE LOCK BEFORE THIS METHOD AND UNLOCK AFTER
+  HOLD THE PATH LOCK
 
-  Recursively delete. Root is not deleted.
+  Recursively drop the cached datapaths of every file below root.
  */
 static void
-jfs_dynamic_hierarchy_folder_cleanup(jfs_dirlist_t *root)
+jfs_dynamic_hierarchy_forget(jfs_dyndir_t *root)
 {
-  struct sglib_jfs_filelist_t_iterator file_it;
-  struct sglib_jfs_dirlist_t_iterator  dir_it;
+  jfs_child_t *child;
 
-  jfs_dirlist_t  *dir;
-  jfs_filelist_t *file;
+  size_t i;
 
   if(root->files) {
-    for(file = sglib_jfs_filelist_t_it_init(&file_it, root->files);
-        file != NULL; file = sglib_jfs_filelist_t_it_next(&file_it)) {
-      sglib_jfs_filelist_t_delete(&root->files, file);
- 
-      jfs_datapath_cache_remove(file->jfs_id);
-     
-      free(file->name);
-      free(file);
+    for(i = 0; i < root->files->size; ++i) {
+      child = &root->files->slots[i];
+
+      if(child->item && child->item != JFS_CHILD_DELETED) {
+        jfs_datapath_cache_remove(((jfs_dynfile_t *)child->item)->jfs_id);
+      }
     }
   }
 
   //recursive
   if(root->folders) {
-    for(dir = sglib_jfs_dirlist_t_it_init(&dir_it, root->folders);
-        dir != NULL; dir = sglib_jfs_dirlist_t_it_next(&dir_it)) {
-      jfs_dynamic_hierarchy_folder_cleanup(dir);
-      
-      sglib_jfs_dirlist_t_delete(&root->folders, dir);
-      
-      if(dir->datapath) {
-        free(dir->datapath);
-      }      
-      free(dir->name);
-      free(dir);
+    for(i = 0; i < root->folders->size; ++i) {
+      child = &root->folders->slots[i];
+
+      if(child->item && child->item != JFS_CHILD_DELETED) {
+        jfs_dynamic_hierarchy_forget(child->item);
+      }
     }
   }
 }
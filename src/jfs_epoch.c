@@ -0,0 +1,246 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "error_log.h"
+#include "jfs_epoch.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define JFS_EPOCH_READERS 128
+#define JFS_EPOCH_LINE    64
+
+/*
+ * A reader slot. State is (epoch << 1) | 1 while reading and 0
+ * otherwise. Slots sit on their own cache lines so readers never
+ * share one.
+ */
+typedef struct jfs_epoch_reader jfs_epoch_reader_t;
+struct jfs_epoch_reader {
+  unsigned long state;
+  int           in_use;
+} __attribute__((aligned(JFS_EPOCH_LINE)));
+
+typedef struct jfs_epoch_retired jfs_epoch_retired_t;
+struct jfs_epoch_retired {
+  void                 *ptr;
+  void                (*free_fn)(void *);
+  unsigned long         epoch;
+
+  jfs_epoch_retired_t  *next;
+};
+
+static jfs_epoch_reader_t readers[JFS_EPOCH_READERS];
+static unsigned long global_epoch;
+
+static pthread_key_t reader_key;
+
+static pthread_mutex_t retire_lock = PTHREAD_MUTEX_INITIALIZER;
+static jfs_epoch_retired_t *retired;
+
+static void
+jfs_epoch_release_reader(void *arg)
+{
+  jfs_epoch_reader_t *reader;
+
+  reader = arg;
+  __atomic_store_n(&reader->state, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&reader->in_use, 0, __ATOMIC_RELEASE);
+}
+
+int
+jfs_epoch_init(void)
+{
+  int rc;
+
+  rc = pthread_key_create(&reader_key, jfs_epoch_release_reader);
+  if(rc) {
+    return -rc;
+  }
+  global_epoch = 0;
+  retired = NULL;
+
+  return 0;
+}
+
+void
+jfs_epoch_destroy(void)
+{
+  jfs_epoch_retired_t *item;
+
+  pthread_mutex_lock(&retire_lock);
+  while(retired) {
+    item = retired;
+    retired = item->next;
+
+    item->free_fn(item->ptr);
+    free(item);
+  }
+  pthread_mutex_unlock(&retire_lock);
+
+  pthread_key_delete(reader_key);
+}
+
+/*
+ * Claim a reader slot for the calling thread. It is given back
+ * when the thread exits.
+ */
+static jfs_epoch_reader_t *
+jfs_epoch_get_reader(void)
+{
+  jfs_epoch_reader_t *reader;
+
+  int i;
+
+  reader = pthread_getspecific(reader_key);
+  if(reader) {
+    return reader;
+  }
+
+  for(i = 0; i < JFS_EPOCH_READERS; ++i) {
+    if(!__atomic_exchange_n(&readers[i].in_use, 1, __ATOMIC_ACQ_REL)) {
+      reader = &readers[i];
+      pthread_setspecific(reader_key, reader);
+
+      return reader;
+    }
+  }
+
+  return NULL;
+}
+
+int
+jfs_epoch_enter(void)
+{
+  jfs_epoch_reader_t *reader;
+
+  unsigned long epoch;
+
+  reader = jfs_epoch_get_reader();
+  if(!reader) {
+    return -EAGAIN;
+  }
+
+  //the announced epoch must still be current once it is visible
+  do {
+    epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+  } while(__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) != epoch);
+
+  return 0;
+}
+
+void
+jfs_epoch_exit(void)
+{
+  jfs_epoch_reader_t *reader;
+
+  reader = pthread_getspecific(reader_key);
+  __atomic_store_n(&reader->state, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * HOLD THE RETIRE LOCK
+ *
+ * Move the global epoch forward if every active reader has
+ * caught up with it.
+ */
+static void
+jfs_epoch_advance(void)
+{
+  unsigned long epoch;
+  unsigned long state;
+
+  int i;
+
+  epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+  for(i = 0; i < JFS_EPOCH_READERS; ++i) {
+    if(!__atomic_load_n(&readers[i].in_use, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    state = __atomic_load_n(&readers[i].state, __ATOMIC_SEQ_CST);
+    if((state & 1) && (state >> 1) != epoch) {
+      return;
+    }
+  }
+  __atomic_store_n(&global_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * HOLD THE RETIRE LOCK
+ *
+ * Free whatever was retired at least two epochs ago.
+ */
+static void
+jfs_epoch_reclaim(void)
+{
+  jfs_epoch_retired_t **prev;
+  jfs_epoch_retired_t *item;
+
+  unsigned long epoch;
+
+  jfs_epoch_advance();
+  epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+
+  prev = &retired;
+  while(*prev) {
+    item = *prev;
+
+    if(item->epoch + 2 <= epoch) {
+      *prev = item->next;
+
+      item->free_fn(item->ptr);
+      free(item);
+    }
+    else {
+      prev = &item->next;
+    }
+  }
+}
+
+int
+jfs_epoch_retire(void *ptr, void (*free_fn)(void *))
+{
+  jfs_epoch_retired_t *item;
+
+  item = malloc(sizeof(*item));
+  if(!item) {
+    log_error("Failed to retire memory, leaking it.\n");
+
+    return -ENOMEM;
+  }
+  item->ptr = ptr;
+  item->free_fn = free_fn;
+
+  pthread_mutex_lock(&retire_lock);
+  item->epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+  item->next = retired;
+  retired = item;
+
+  jfs_epoch_reclaim();
+  pthread_mutex_unlock(&retire_lock);
+
+  return 0;
+}
@@ -26,21 +26,26 @@
 #include "jfs_util.h"
 #include "jfs_dynamic_paths.h"
 #include "jfs_datapath_cache.h"
+#include "jfs_pending.h"
+#include "jfs_query_cache.h"
+#include "jfs_meta_cache.h"
+#include "jfs_stat_cache.h"
 #include "sqlitedb.h"
 #include "joinfs.h"
 
-#include <fuse.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <sys/types.h>
 
 static int jfs_file_do_open(const char *path, int flags, mode_t mode);
 static int jfs_file_do_unlink(const char *path);
-static int jfs_file_do_rename(const char *from, const char *to);
+static int jfs_file_do_rename(const char *from, const char *to, int to_exists);
 
 /*
  * Create a joinFS static file. The file is added
@@ -51,21 +56,23 @@ static int jfs_file_do_rename(const char *from, const char *to);
 int
 jfs_file_mknod(const char *path, mode_t mode, dev_t rdev)
 {
+  struct jfs_path_info info;
   char *realpath;
   
   int rc;
 
-  if(jfs_util_is_path_dynamic(path)) {
-    rc = jfs_util_get_datapath(path, &realpath);
+  rc = jfs_util_classify_path(path, &info);
+  if(rc == -ENOENT) {
+    rc = jfs_util_resolve_new_path(path, &realpath);
     if(rc) {
       return rc;
     }
   }
+  else if(rc) {
+    return rc;
+  }
   else {
-    rc = jfs_util_resolve_new_path(path, &realpath);
-    if(rc) {
-      return rc;
-    }
+    realpath = info.datapath;
   }
   
   if(S_ISREG(mode)) {
@@ -83,7 +90,14 @@ jfs_file_mknod(const char *path, mode_t mode, dev_t rdev)
       rc = -errno;
     }
   }
-  free(realpath);
+
+  if(!rc) {
+    jfs_stat_cache_remove_dirent(realpath);
+  }
+
+  if(realpath != info.datapath) {
+    free(realpath);
+  }
   
   return rc;
 }
@@ -98,13 +112,22 @@ jfs_file_db_add(int inode, const char *path, const char *filename)
 
   int rc;
 
+  //a new link can bring keys the path was known to lack
+  jfs_meta_cache_remove_path(path);
+  jfs_stat_cache_remove_dirent(path);
+
+  if(joinfs_context.async_writes) {
+    return jfs_pending_link_add(inode, path, filename);
+  }
+
   /* first add to the files table */
-  rc = jfs_db_op_create(&db_op, jfs_write_op,
-                        "INSERT OR ROLLBACK INTO links VALUES(NULL, %d,\"%s\",\"%s\");",
-                        inode, path, filename);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_link_insert_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_int(db_op, inode);
+  jfs_db_op_bind_text(db_op, path);
+  jfs_db_op_bind_text(db_op, filename);
   
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -123,33 +146,35 @@ jfs_file_db_add(int inode, const char *path, const char *filename)
 int
 jfs_file_unlink(const char *path)
 {
-  char *datapath;
+  struct jfs_path_info info;
 
-  int jfs_id;
   int rc;
  
-  //see if unlink was called on a dynamic path object
-  if(!jfs_util_is_realpath(path)) {
-    rc = jfs_dynamic_path_resolution(path, &datapath, &jfs_id);
-    if(rc) {
-      return rc;
-    }
+  rc = jfs_util_classify_path(path, &info);
+  if(rc) {
+    return rc;
+  }
 
-    if(strcmp(jfs_util_get_filename(datapath), ".jfs_sub_query") == 0) {
-      free(datapath);
+  //see if unlink was called on a dynamic path object
+  if(info.type == jfs_path_dynamic) {
+    if(strcmp(jfs_util_get_filename(info.datapath), ".jfs_sub_query") == 0) {
       return -EISDIR;
     }
 
     rc = jfs_dynamic_hierarchy_unlink(path);
     if(rc) {
-      free(datapath);
       return rc;
     }
 
-    rc = jfs_file_do_unlink(datapath);
-    free(datapath);
+    rc = jfs_file_do_unlink(info.datapath);
+    if(rc) {
+      return rc;
+    }
 
-    return rc;
+    //listing the folder cached the entry under its dynamic path too
+    jfs_stat_cache_remove_dirent(path);
+
+    return 0;
   }
 
   return jfs_file_do_unlink(path);
@@ -160,33 +185,16 @@ jfs_file_do_unlink(const char *path)
 {
   struct jfs_db_op *db_op;
   
-  char *link_query;
-  char *metadata_query;
-  
   int rc;
 
-  rc = jfs_db_op_create_query(&metadata_query,
-                              "DELETE FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\");",
-                              path);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_multi_write_op, jfs_unlink_meta_stmt);
   if(rc) {
     return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
 
-  rc = jfs_db_op_create_query(&link_query, 
-                              "DELETE FROM links WHERE path=\"%s\";",
-                              path);
-  if(rc) {
-    free(metadata_query);
-    return rc;
-  }
-  
-  rc = jfs_db_op_create_multi_op(&db_op, 2, metadata_query, link_query);
-  if(rc) {
-    free(metadata_query);
-    free(link_query);
-    
-    return rc;
-  }
+  jfs_db_op_add_stmt(db_op, jfs_unlink_link_stmt);
+  jfs_db_op_bind_text(db_op, path);
   
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -195,11 +203,14 @@ jfs_file_do_unlink(const char *path)
   if(rc) {
     return rc;
   }
+  jfs_query_cache_invalidate_all();
+  jfs_meta_cache_remove_path(path);
 
   rc = unlink(path);
   if(rc) {
     return -errno;
   }
+  jfs_stat_cache_remove_dirent(path);
 
   return 0;
 }
@@ -210,10 +221,12 @@ jfs_file_do_unlink(const char *path)
 int
 jfs_file_rename(const char *from, const char *to)
 {
+  struct jfs_path_info from_info;
+  struct jfs_path_info to_info;
+  struct stat st;
+
   char *from_subpath;
   char *to_subpath;
-  char *from_datapath;
-  char *to_datapath;
   char *subpath;
   char *filename;
   char *real_from;
@@ -223,20 +236,15 @@ jfs_file_rename(const char *from, const char *to)
 
   int from_is_dynamic;
   int to_is_dynamic;
-  int from_id;
-  int to_id;
+  int to_exists;
   int rc;
 
-  from_id = 0;
-  to_id = 0;
   to_is_dynamic = 0;
   from_is_dynamic = 0;
-  from_datapath = NULL;
-  to_datapath = NULL;
+  to_exists = 0;
   subpath = NULL;
   from_subpath = NULL;
   to_subpath = NULL;
-  real_from = NULL;
   real_to = NULL;
 
   filename = jfs_util_get_filename(from);
@@ -256,47 +264,22 @@ jfs_file_rename(const char *from, const char *to)
     goto cleanup;
   }
 
-  //see if rename was called from a dynamic object
-  if(!jfs_util_is_realpath(from)) {
-    rc = jfs_dynamic_path_resolution(from, &real_from, &from_id);
-
-    //.jfs_sub_query edge case
-    if(rc) {
-      rc = jfs_dynamic_path_resolution(from_subpath, &from_datapath, &from_id);
-      if(rc) {
-        goto cleanup;
-      }
-      
-      real_len = strlen(from_datapath) + strlen(filename) + 2; //null and '/'
-      real_from = malloc(sizeof(*real_from) * real_len);
-      if(!real_from) {
-        free(from_datapath);
-        rc = -ENOMEM;
-
-        goto cleanup;
-      }
-      snprintf(real_from, real_len, "%s/%s", from_datapath, filename);
-      free(from_datapath);
+  //one pass tells static, dynamic and .jfs_sub_query items apart
+  rc = jfs_util_classify_path(from, &from_info);
+  if(rc) {
+    goto cleanup;
+  }
+  real_from = from_info.datapath;
 
-      if(!jfs_util_is_realpath(real_from)) {
-        rc = -ENOENT;
+  if(from_info.type == jfs_path_dynamic) {
+    //can't rename a dynamic folder
+    if(strcmp(jfs_util_get_filename(real_from), ".jfs_sub_query") == 0) {
+      rc = -EISDIR;
 
-        goto cleanup;
-      }
+      goto cleanup;
     }
-    else {
-      //can't rename a dynamic folder
-      if(strcmp(jfs_util_get_filename(real_from), ".jfs_sub_query") == 0) {
-        rc = -EISDIR;
-
-        goto cleanup;
-      }
       
-      from_is_dynamic = 1;
-    }
-  }
-  else {
-    real_from = (char *)from;
+    from_is_dynamic = 1;
   }
 
   filename = jfs_util_get_filename(to);
@@ -306,44 +289,24 @@ jfs_file_rename(const char *from, const char *to)
     goto cleanup;
   }
 
+  rc = jfs_util_classify_path(to, &to_info);
+  if(rc && rc != -ENOENT) {
+    goto cleanup;
+  }
+  
   //is too a dynamic path item
-  if(jfs_util_is_path_dynamic(to)) {
-    rc = jfs_dynamic_path_resolution(to, &real_to, &to_id);
-    
-    //.jfs_sub_query edge case
-    if(rc) {
-      rc = jfs_dynamic_path_resolution(to_subpath, &to_datapath, &to_id);
-      if(rc) {
-        goto cleanup;
-      }
-      
-      real_len = strlen(to_datapath) + strlen(filename) + 2; //null and '/'
-      real_to = malloc(sizeof(*real_to) * real_len);
-      if(!real_to) {
-        free(to_datapath);
-        rc = -ENOMEM;
+  if(to_info.type == jfs_path_dynamic) {
+    real_to = to_info.datapath;
 
-        goto cleanup;
-      }
-      snprintf(real_to, real_len, "%s/%s", to_datapath, filename);
-      free(to_datapath);
-      
-      if(!jfs_util_is_realpath(real_to)) {
-        rc = -ENOENT;
+    //can't rename a dynamic folder
+    if(strcmp(jfs_util_get_filename(real_to), ".jfs_sub_query") == 0) {
+      rc = -EISDIR;
 
-        goto cleanup;
-      }
+      goto cleanup;
     }
-    else {
-      //can't rename a dynamic folder
-      if(strcmp(jfs_util_get_filename(real_to), ".jfs_sub_query") == 0) {
-        rc = -EISDIR;
-
-        goto cleanup;
-      }
       
-      to_is_dynamic = 1;
-    }
+    to_exists = to_info.has_stat;
+    to_is_dynamic = 1;
   }
   //is to being saved to a dynamic folder?
   else if(from_is_dynamic && (strcmp(to_subpath, from_subpath) == 0)) {
@@ -361,13 +324,15 @@ jfs_file_rename(const char *from, const char *to)
     }
     snprintf(real_to, real_len, "%s%s", subpath, filename);
     
+    to_exists = !lstat(real_to, &st);
     to_is_dynamic = 1;
   }
   else {
     real_to = (char *)to;
+    to_exists = to_info.type == jfs_path_static;
   }
   
-  rc = jfs_file_do_rename(real_from, real_to);
+  rc = jfs_file_do_rename(real_from, real_to, to_exists);
 
   if(rc) {
     goto cleanup;
@@ -386,7 +351,7 @@ jfs_file_rename(const char *from, const char *to)
       goto cleanup;
     }
 
-    rc = jfs_dynamic_hierarchy_add_file(to, real_from, from_id);
+    rc = jfs_dynamic_hierarchy_add_file(to, real_from, from_info.jfs_id);
   }
   
 cleanup:
@@ -399,10 +364,7 @@ cleanup:
   if(to_subpath) {
     free(to_subpath);
   }
-  if(real_from != from && real_from) {
-    free(real_from);
-  }
-  if(real_to != to && real_to) {
+  if(real_to && real_to != to && real_to != to_info.datapath) {
     free(real_to);
   }
 
@@ -410,80 +372,42 @@ cleanup:
 }
 
 static int
-jfs_file_do_rename(const char *from, const char *to)
+jfs_file_do_rename(const char *from, const char *to, int to_exists)
 {
   struct jfs_db_op *db_op;
   
   char *filename;
-
-  char *metadata_query;
-  char *link_query;
-  char *link_delete_query;
   
-  int to_exists;
   int rc;
 
-  metadata_query = NULL;
-  link_query = NULL;
-  link_delete_query = NULL;
-  
-  if(jfs_util_is_realpath(to)) {
-    to_exists = 1;
-  }
-  else {
-    to_exists = 0;
-  }
-  
   filename = jfs_util_get_filename(to);
-  
-  //update the hardlink
-  rc = jfs_db_op_create_query(&link_query,
-                              "UPDATE links SET path=\"%s\", filename=\"%s\" WHERE path=\"%s\";",
-                              to, filename, from);
-  if(rc) {
-    return rc;
-  }
 
   if(to_exists) {
     //preserve the old metadata
-    rc = jfs_db_op_create_query(&metadata_query,
-                                "UPDATE metadata SET jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\") WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\");",
-                                from, to); 
+    rc = jfs_db_op_create_stmt(&db_op, jfs_multi_write_op, jfs_rename_meta_stmt);
     if(rc) {
-      free(link_query);
-      
       return rc;
     }
-    
+    jfs_db_op_bind_text(db_op, from);
+    jfs_db_op_bind_text(db_op, to);
+
     //cleanup the old datapath in the db
-    rc = jfs_db_op_create_query(&link_delete_query,
-                                "DELETE FROM links WHERE path=\"%s\";",
-                                to);
-    if(rc) {
-      free(link_query);
-      free(metadata_query);
-      
-      return rc;
-    }
-    
-    rc = jfs_db_op_create_multi_op(&db_op, 3, metadata_query, link_delete_query,
-                                   link_query);
-    if(rc) {
-      free(metadata_query);
-      free(link_delete_query);
-      free(link_query);
-      
-      return rc;
-    }
+    jfs_db_op_add_stmt(db_op, jfs_unlink_link_stmt);
+    jfs_db_op_bind_text(db_op, to);
+
+    //update the hardlink
+    jfs_db_op_add_stmt(db_op, jfs_rename_link_stmt);
   }
   else {
-    rc = jfs_db_op_create_multi_op(&db_op, 1, link_query);
+    //update the hardlink
+    rc = jfs_db_op_create_stmt(&db_op, jfs_multi_write_op, jfs_rename_link_stmt);
     if(rc) {
-      free(link_query);
-
       return rc;
     }
   }
+  jfs_db_op_bind_text(db_op, to);
+  jfs_db_op_bind_text(db_op, filename);
+  jfs_db_op_bind_text(db_op, from);
   
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -492,12 +416,18 @@ jfs_file_do_rename(const char *from, const char *to)
   if(rc) {
     return rc;
   }
+  jfs_query_cache_invalidate_all();
+  jfs_meta_cache_remove_path(from);
+  jfs_meta_cache_remove_path(to);
   
   //perform the rename
   rc = rename(from, to);
   if(rc) {
     return -errno;
   }
+  
+  //a directory rename moves every path below it
+  jfs_stat_cache_invalidate_all();
 
   return 0;
 }
@@ -508,21 +438,24 @@ jfs_file_do_rename(const char *from, const char *to)
 int
 jfs_file_truncate(const char *path, off_t size)
 {
-  char *datapath;
+  struct jfs_path_info info;
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
 	return rc;
   }
 
-  rc = truncate(datapath, size);
+  rc = truncate(info.datapath, size);
   if(rc) {
-	rc = -errno;
+	return -errno;
+  }
+  jfs_stat_cache_remove(info.datapath);
+  if(info.type == jfs_path_dynamic) {
+    jfs_stat_cache_remove(path);
   }
-  free(datapath);
 
-  return rc;
+  return 0;
 }
 
 /*
@@ -531,25 +464,29 @@ jfs_file_truncate(const char *path, off_t size)
 int
 jfs_file_open(const char *path, int flags, mode_t mode)
 {
+  struct jfs_path_info info;
   char *realpath;
   
   int rc;
 
-  if(jfs_util_is_path_dynamic(path)) {
-    rc = jfs_util_get_datapath(path, &realpath);
+  rc = jfs_util_classify_path(path, &info);
+  if(rc == -ENOENT) {
+    rc = jfs_util_resolve_new_path(path, &realpath);
     if(rc) {
       return rc;
     }
   }
+  else if(rc) {
+    return rc;
+  }
   else {
-    rc = jfs_util_resolve_new_path(path, &realpath);
-    if(rc) {
-      return rc;
-    }
+    realpath = info.datapath;
   }
 
   rc = jfs_file_do_open(realpath, flags, mode);
-  free(realpath);
+  if(realpath != info.datapath) {
+    free(realpath);
+  }
 
   return rc;
 }
@@ -602,6 +539,10 @@ jfs_file_do_open(const char *path, int flags, mode_t mode)
     }
   }
 
+  if(flags & O_TRUNC) {
+    jfs_stat_cache_remove(path);
+  }
+
   return fd;
 }
 
@@ -611,22 +552,32 @@ jfs_file_do_open(const char *path, int flags, mode_t mode)
 int
 jfs_file_getattr(const char *path, struct stat *stbuf)
 {
-  char *datapath;
+  struct jfs_path_info info;
+
+  unsigned long generation;
 
   int rc;
-  
-  rc = jfs_util_get_datapath(path, &datapath);
+
+  //real paths repeat a lot, so their attributes are cached, dynamic
+  //ones are cached when their folder is listed
+  if(!jfs_stat_cache_get(path, stbuf)) {
+    return 0;
+  }
+  generation = jfs_stat_cache_generation(path);
+
+  //real and already resolved dynamic paths stay off the heap
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
     return rc;
   }
-  
-  rc = lstat(datapath, stbuf);
-  if(datapath) {
-    free(datapath);
+
+  if(!info.has_stat) {
+    return -ENOENT;
   }
+  memcpy(stbuf, &info.st, sizeof(*stbuf));
 
-  if(rc) {
-	return -errno;
+  if(info.type == jfs_path_static) {
+    jfs_stat_cache_fill(path, stbuf, generation);
   }
 
   return 0;
@@ -635,17 +586,34 @@ jfs_file_getattr(const char *path, struct stat *stbuf)
 int
 jfs_file_utimes(const char *path, const struct timeval tv[2])
 {
-  char *datapath;
+  struct jfs_path_info info;
   int rc;
   
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
 	return rc;
   }
  
-  rc = utimes(datapath, tv);
-  free(datapath);
+  rc = utimes(info.datapath, tv);
+  if(rc) {
+	return -errno;
+  }
 
+  return 0;
+}
+
+int
+jfs_file_utimens(const char *path, const struct timespec ts[2])
+{
+  struct jfs_path_info info;
+  int rc;
+  
+  rc = jfs_util_classify_path(path, &info);
+  if(rc) {
+	return rc;
+  }
+ 
+  rc = utimensat(AT_FDCWD, info.datapath, ts, 0);
   if(rc) {
 	return -errno;
   }
@@ -656,18 +624,16 @@ jfs_file_utimes(const char *path, const struct timeval tv[2])
 int
 jfs_file_statfs(const char *path, struct statvfs *stbuf)
 {
-  char *datapath;
+  struct jfs_path_info info;
   
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
     return rc;
   }
 
-  rc = statvfs(datapath, stbuf);
-  free(datapath);
-
+  rc = statvfs(info.datapath, stbuf);
   if(rc) {
     return -errno;
   }
@@ -752,6 +718,7 @@ jfs_file_link(const char *from, const char *to)
     
     return -errno;
   }
+  jfs_stat_cache_remove(from);
   
   filename = jfs_util_get_filename(realpath_to);
   inode = jfs_util_get_inode(realpath_to);
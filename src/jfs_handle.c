@@ -0,0 +1,114 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_handle.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+jfs_handle_table_init(struct jfs_handle_table *table)
+{
+  int i;
+
+  memset(table->buckets, 0, sizeof(table->buckets));
+  for(i = 0; i < JFS_HANDLE_STRIPES; ++i) {
+    pthread_mutex_init(&table->locks[i], NULL);
+  }
+}
+
+void
+jfs_handle_table_destroy(struct jfs_handle_table *table)
+{
+  int i;
+
+  for(i = 0; i < JFS_HANDLE_STRIPES; ++i) {
+    pthread_mutex_destroy(&table->locks[i]);
+  }
+}
+
+pthread_mutex_t *
+jfs_handle_lock(struct jfs_handle_table *table, int fd)
+{
+  return &table->locks[(fd % JFS_HANDLE_BUCKETS) % JFS_HANDLE_STRIPES];
+}
+
+struct jfs_handle *
+jfs_handle_find(struct jfs_handle_table *table, int fd)
+{
+  struct jfs_handle *handle;
+
+  for(handle = table->buckets[fd % JFS_HANDLE_BUCKETS]; handle; handle = handle->next) {
+    if(handle->fd == fd) {
+      return handle;
+    }
+  }
+
+  return NULL;
+}
+
+void
+jfs_handle_insert(struct jfs_handle_table *table, struct jfs_handle *handle)
+{
+  handle->next = table->buckets[handle->fd % JFS_HANDLE_BUCKETS];
+  table->buckets[handle->fd % JFS_HANDLE_BUCKETS] = handle;
+}
+
+struct jfs_handle *
+jfs_handle_remove(struct jfs_handle_table *table, int fd)
+{
+  struct jfs_handle **prev;
+  struct jfs_handle *handle;
+
+  for(prev = &table->buckets[fd % JFS_HANDLE_BUCKETS]; *prev; prev = &(*prev)->next) {
+    if((*prev)->fd == fd) {
+      handle = *prev;
+      *prev = handle->next;
+
+      return handle;
+    }
+  }
+
+  return NULL;
+}
+
+void
+jfs_handle_table_foreach(struct jfs_handle_table *table,
+                         void (*fn)(struct jfs_handle *handle, void *arg),
+                         void *arg)
+{
+  struct jfs_handle *handle;
+  pthread_mutex_t *lock;
+
+  int i;
+
+  for(i = 0; i < JFS_HANDLE_BUCKETS; ++i) {
+    lock = &table->locks[i % JFS_HANDLE_STRIPES];
+
+    pthread_mutex_lock(lock);
+    for(handle = table->buckets[i]; handle; handle = handle->next) {
+      fn(handle, arg);
+    }
+    pthread_mutex_unlock(lock);
+  }
+}
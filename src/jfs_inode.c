@@ -0,0 +1,456 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_inode.h"
+#include "joinfs.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define JFS_INODE_MIN_BUCKETS 1024
+
+/*
+  Node ids are the node addresses, the root is JFS_INODE_ROOT.
+
+  A node is freed when the kernel holds no lookups and no child
+  points at it. Unlinked nodes leave the name table but live on
+  until they are forgotten, every node stays on the all list so
+  unmount can free them.
+ */
+struct jfs_inode {
+  struct jfs_inode *next;
+  struct jfs_inode *all_prev;
+  struct jfs_inode *all_next;
+  struct jfs_inode *parent;
+  uint64_t          nlookup;
+  unsigned long     children;
+  uint32_t          hash;
+  int               unlinked;
+  char             *name;
+};
+
+static struct jfs_inode jfs_root;
+
+static struct jfs_inode **buckets;
+static struct jfs_inode *all_nodes;
+static size_t bucket_count;
+static size_t node_count;
+
+static pthread_rwlock_t inode_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint32_t
+jfs_inode_hash(const struct jfs_inode *parent, const char *name)
+{
+  uintptr_t p = (uintptr_t)parent;
+  uint32_t hash = 2166136261u;
+
+  for(; *name; ++name) {
+	hash = (hash ^ (unsigned char)*name) * 16777619u;
+  }
+  hash ^= (uint32_t)(p >> 4) ^ (uint32_t)((uint64_t)p >> 32);
+
+  return hash * 16777619u;
+}
+
+static struct jfs_inode *
+jfs_inode_get(uint64_t ino)
+{
+  if(ino == JFS_INODE_ROOT) {
+	return &jfs_root;
+  }
+
+  return (struct jfs_inode *)(uintptr_t)ino;
+}
+
+static uint64_t
+jfs_inode_id(struct jfs_inode *node)
+{
+  if(node == &jfs_root) {
+	return JFS_INODE_ROOT;
+  }
+
+  return (uint64_t)(uintptr_t)node;
+}
+
+static struct jfs_inode *
+jfs_inode_find(struct jfs_inode *parent, const char *name, uint32_t hash)
+{
+  struct jfs_inode *node;
+
+  for(node = buckets[hash & (bucket_count - 1)]; node; node = node->next) {
+	if(node->hash == hash && node->parent == parent
+	   && !strcmp(node->name, name)) {
+	  return node;
+	}
+  }
+
+  return NULL;
+}
+
+static void
+jfs_inode_insert(struct jfs_inode *node)
+{
+  struct jfs_inode **slot;
+
+  slot = &buckets[node->hash & (bucket_count - 1)];
+  node->next = *slot;
+  *slot = node;
+}
+
+static void
+jfs_inode_detach(struct jfs_inode *node)
+{
+  struct jfs_inode **slot;
+
+  if(node->unlinked) {
+	return;
+  }
+
+  for(slot = &buckets[node->hash & (bucket_count - 1)]; *slot;
+	  slot = &(*slot)->next) {
+	if(*slot == node) {
+	  *slot = node->next;
+	  break;
+	}
+  }
+  node->next = NULL;
+  node->unlinked = 1;
+}
+
+/*
+ * Double the name table once it is fuller than one node per bucket.
+ */
+static void
+jfs_inode_grow(void)
+{
+  struct jfs_inode **old_buckets;
+  struct jfs_inode *node;
+  struct jfs_inode *next;
+
+  size_t old_count;
+  size_t i;
+
+  old_buckets = buckets;
+  old_count = bucket_count;
+
+  buckets = calloc(old_count * 2, sizeof(*buckets));
+  if(!buckets) {
+	buckets = old_buckets;
+	return;
+  }
+  bucket_count = old_count * 2;
+
+  for(i = 0; i < old_count; ++i) {
+	for(node = old_buckets[i]; node; node = next) {
+	  next = node->next;
+	  jfs_inode_insert(node);
+	}
+  }
+  free(old_buckets);
+}
+
+/*
+ * Free unreferenced nodes, walking up as parents lose their children.
+ */
+static void
+jfs_inode_release(struct jfs_inode *node)
+{
+  struct jfs_inode *parent;
+
+  while(node != &jfs_root && !node->nlookup && !node->children) {
+	parent = node->parent;
+	jfs_inode_detach(node);
+	if(node->all_prev) {
+	  node->all_prev->all_next = node->all_next;
+	}
+	else {
+	  all_nodes = node->all_next;
+	}
+	if(node->all_next) {
+	  node->all_next->all_prev = node->all_prev;
+	}
+	free(node->name);
+	free(node);
+	--node_count;
+
+	--parent->children;
+	node = parent;
+  }
+}
+
+int
+jfs_inode_init(void)
+{
+  buckets = calloc(JFS_INODE_MIN_BUCKETS, sizeof(*buckets));
+  if(!buckets) {
+	return -ENOMEM;
+  }
+  bucket_count = JFS_INODE_MIN_BUCKETS;
+  node_count = 0;
+  all_nodes = NULL;
+
+  memset(&jfs_root, 0, sizeof(jfs_root));
+  jfs_root.name = "";
+
+  return 0;
+}
+
+void
+jfs_inode_destroy(void)
+{
+  struct jfs_inode *node;
+  struct jfs_inode *next;
+
+  pthread_rwlock_wrlock(&inode_lock);
+  //unlinked nodes are only on the all list
+  for(node = all_nodes; node; node = next) {
+	next = node->all_next;
+	free(node->name);
+	free(node);
+  }
+  all_nodes = NULL;
+  node_count = 0;
+  free(buckets);
+  buckets = NULL;
+  bucket_count = 0;
+  pthread_rwlock_unlock(&inode_lock);
+}
+
+/*
+ * Build the path of a node from its names, caller holds the lock.
+ */
+static int
+jfs_inode_build_path(struct jfs_inode *node, const char *name,
+                     char *buf, size_t size)
+{
+  struct jfs_inode *walk;
+
+  size_t len;
+  size_t pos;
+  size_t root_len = joinfs_context.querypath_len;
+
+  for(walk = node; walk != &jfs_root; walk = walk->parent) {
+	if(walk->unlinked) {
+	  return -ENOENT;
+	}
+  }
+
+  len = root_len;
+  for(walk = node; walk != &jfs_root; walk = walk->parent) {
+	len += strlen(walk->name) + 1;
+  }
+  if(name) {
+	len += strlen(name) + 1;
+  }
+  if(len == root_len) {
+	len += 1;
+  }
+  if(len >= size) {
+	return -ENAMETOOLONG;
+  }
+
+  //fill in from the end
+  buf[len] = '\0';
+  pos = len;
+  if(name) {
+	pos -= strlen(name);
+	memcpy(buf + pos, name, strlen(name));
+	buf[--pos] = '/';
+  }
+  for(walk = node; walk != &jfs_root; walk = walk->parent) {
+	pos -= strlen(walk->name);
+	memcpy(buf + pos, walk->name, strlen(walk->name));
+	buf[--pos] = '/';
+  }
+
+  //the query root keeps its trailing slash
+  if(pos > root_len) {
+	buf[--pos] = '/';
+  }
+  memcpy(buf, joinfs_context.querypath, pos);
+
+  return 0;
+}
+
+int
+jfs_inode_path(uint64_t ino, char *buf, size_t size)
+{
+  int rc;
+
+  pthread_rwlock_rdlock(&inode_lock);
+  rc = jfs_inode_build_path(jfs_inode_get(ino), NULL, buf, size);
+  pthread_rwlock_unlock(&inode_lock);
+
+  return rc;
+}
+
+int
+jfs_inode_child_path(uint64_t parent, const char *name, char *buf, size_t size)
+{
+  int rc;
+
+  pthread_rwlock_rdlock(&inode_lock);
+  rc = jfs_inode_build_path(jfs_inode_get(parent), name, buf, size);
+  pthread_rwlock_unlock(&inode_lock);
+
+  return rc;
+}
+
+int
+jfs_inode_lookup(uint64_t parent, const char *name, uint64_t *ino)
+{
+  struct jfs_inode *dir;
+  struct jfs_inode *node;
+
+  uint32_t hash;
+
+  dir = jfs_inode_get(parent);
+  hash = jfs_inode_hash(dir, name);
+
+  pthread_rwlock_wrlock(&inode_lock);
+  node = jfs_inode_find(dir, name, hash);
+  if(!node) {
+	node = calloc(1, sizeof(*node));
+	if(!node) {
+	  pthread_rwlock_unlock(&inode_lock);
+	  return -ENOMEM;
+	}
+
+	node->name = strdup(name);
+	if(!node->name) {
+	  pthread_rwlock_unlock(&inode_lock);
+	  free(node);
+	  return -ENOMEM;
+	}
+	node->parent = dir;
+	node->hash = hash;
+	++dir->children;
+
+	node->all_next = all_nodes;
+	if(all_nodes) {
+	  all_nodes->all_prev = node;
+	}
+	all_nodes = node;
+
+	if(++node_count > bucket_count) {
+	  jfs_inode_grow();
+	}
+	jfs_inode_insert(node);
+  }
+  ++node->nlookup;
+  *ino = jfs_inode_id(node);
+  pthread_rwlock_unlock(&inode_lock);
+
+  return 0;
+}
+
+void
+jfs_inode_forget(uint64_t ino, uint64_t nlookup)
+{
+  struct jfs_inode *node;
+
+  node = jfs_inode_get(ino);
+  if(node == &jfs_root) {
+	return;
+  }
+
+  pthread_rwlock_wrlock(&inode_lock);
+  if(nlookup > node->nlookup) {
+	nlookup = node->nlookup;
+  }
+  node->nlookup -= nlookup;
+  jfs_inode_release(node);
+  pthread_rwlock_unlock(&inode_lock);
+}
+
+void
+jfs_inode_unlink(uint64_t parent, const char *name)
+{
+  struct jfs_inode *dir;
+  struct jfs_inode *node;
+
+  dir = jfs_inode_get(parent);
+
+  pthread_rwlock_wrlock(&inode_lock);
+  node = jfs_inode_find(dir, name, jfs_inode_hash(dir, name));
+  if(node) {
+	jfs_inode_detach(node);
+  }
+  pthread_rwlock_unlock(&inode_lock);
+}
+
+int
+jfs_inode_rename(uint64_t parent, const char *name,
+                 uint64_t newparent, const char *newname)
+{
+  struct jfs_inode *dir;
+  struct jfs_inode *newdir;
+  struct jfs_inode *node;
+  struct jfs_inode *target;
+  struct jfs_inode *old_parent;
+
+  char *new_name;
+
+  dir = jfs_inode_get(parent);
+  newdir = jfs_inode_get(newparent);
+
+  new_name = strdup(newname);
+  if(!new_name) {
+	return -ENOMEM;
+  }
+
+  pthread_rwlock_wrlock(&inode_lock);
+  node = jfs_inode_find(dir, name, jfs_inode_hash(dir, name));
+  target = jfs_inode_find(newdir, newname, jfs_inode_hash(newdir, newname));
+  if(target && target != node) {
+	jfs_inode_detach(target);
+  }
+
+  //never looked up, nothing to move
+  if(!node) {
+	pthread_rwlock_unlock(&inode_lock);
+	free(new_name);
+	return 0;
+  }
+
+  jfs_inode_detach(node);
+  node->unlinked = 0;
+  free(node->name);
+  node->name = new_name;
+  node->hash = jfs_inode_hash(newdir, newname);
+
+  old_parent = node->parent;
+  if(old_parent != newdir) {
+	node->parent = newdir;
+	++newdir->children;
+	--old_parent->children;
+	jfs_inode_release(old_parent);
+  }
+  jfs_inode_insert(node);
+  pthread_rwlock_unlock(&inode_lock);
+
+  return 0;
+}
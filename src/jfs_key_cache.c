@@ -22,111 +22,203 @@
 #endif
 
 #include "jfs_key_cache.h"
-#include "sglib.h"
+#include "jfs_epoch.h"
 
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <attr/xattr.h>
 #include <pthread.h>
 
-#define JFS_KEY_CACHE_SIZE 1000
+#define JFS_KEY_CACHE_MIN 256
 
-typedef struct jfs_key_cache jfs_key_cache_t;
-struct jfs_key_cache {
-  int              keyid;
-  char            *keytext;
+/*
+ * Keys are interned, an entry holds the only copy of its text
+ * and is never changed once it is in the table.
+ */
+struct jfs_key_entry {
+  int      keyid;
+  uint32_t hash;
+  size_t   len;
+  char     keytext[];
+};
 
-  jfs_key_cache_t *next;
+/*
+ * Open addressing table, the size is a power of two. Readers
+ * never lock, so a full table is copied and swapped in whole.
+ */
+struct jfs_key_table {
+  size_t                size;
+  size_t                count;
+  size_t                used;
+  struct jfs_key_entry *slots[];
 };
 
-static jfs_key_cache_t *hashtable[JFS_KEY_CACHE_SIZE];
+static struct jfs_key_entry jfs_key_deleted;
+#define JFS_KEY_DELETED (&jfs_key_deleted)
 
-#define JFS_KEY_CACHE_T_CMP(e1, e2) (strcmp(e1->keytext, e2->keytext))
+static struct jfs_key_table *key_table;
+static pthread_mutex_t key_lock;
 
-static unsigned int
-jfs_key_cache_t_hash(jfs_key_cache_t *item)
+static uint32_t
+jfs_key_hash(const char *keytext, size_t *len)
 {
-  size_t key_len;
-  unsigned int hash;
+  const unsigned char *pos;
+  uint32_t hash;
+
+  //FNV-1a
+  hash = 2166136261u;
+  for(pos = (const unsigned char *)keytext; *pos; ++pos) {
+    hash ^= *pos;
+    hash *= 16777619u;
+  }
+  *len = pos - (const unsigned char *)keytext;
 
-  key_len = strlen(item->keytext);
+  return hash;
+}
+
+static struct jfs_key_table *
+jfs_key_table_alloc(size_t size)
+{
+  struct jfs_key_table *table;
 
-  hash = (key_len * (key_len / 2) * 10) % JFS_KEY_CACHE_SIZE;
+  table = calloc(1, sizeof(*table) + sizeof(*table->slots) * size);
+  if(!table) {
+    return NULL;
+  }
+  table->size = size;
 
-  return hash;  
+  return table;
 }
 
 /*
- * SGLIB generator macros for jfs_key_cache_t lists.
+ * Find the slot holding a key, or the empty slot that ends its probe.
  */
-SGLIB_DEFINE_LIST_PROTOTYPES(jfs_key_cache_t, JFS_KEY_CACHE_T_CMP, next)
-SGLIB_DEFINE_LIST_FUNCTIONS(jfs_key_cache_t, JFS_KEY_CACHE_T_CMP, next)
+static size_t
+jfs_key_table_probe(struct jfs_key_table *table, const char *keytext,
+                    size_t len, uint32_t hash, struct jfs_key_entry **entry)
+{
+  struct jfs_key_entry *item;
+  size_t mask;
+  size_t i;
+
+  mask = table->size - 1;
+  for(i = hash & mask; ; i = (i + 1) & mask) {
+    item = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+    if(!item) {
+      break;
+    }
+    
+    if(item != JFS_KEY_DELETED && item->hash == hash && item->len == len
+       && !memcmp(item->keytext, keytext, len)) {
+      break;
+    }
+  }
+  *entry = item;
+
+  return i;
+}
 
 /*
- * SGLIB generator macros for hashtable function prototypes.
+ * Copy the live keys into a new table, dropping tombstones.
  */
-SGLIB_DEFINE_HASHED_CONTAINER_PROTOTYPES(jfs_key_cache_t, JFS_KEY_CACHE_SIZE,
-                                         jfs_key_cache_t_hash)
-SGLIB_DEFINE_HASHED_CONTAINER_FUNCTIONS(jfs_key_cache_t, JFS_KEY_CACHE_SIZE,
-                                        jfs_key_cache_t_hash)
+static struct jfs_key_table *
+jfs_key_table_rehash(struct jfs_key_table *old, size_t size)
+{
+  struct jfs_key_table *table;
+  struct jfs_key_entry *item;
+  size_t mask;
+  size_t i;
+  size_t j;
+
+  table = jfs_key_table_alloc(size);
+  if(!table) {
+    return NULL;
+  }
+  mask = size - 1;
+
+  for(i = 0; i < old->size; ++i) {
+    item = old->slots[i];
+    if(!item || item == JFS_KEY_DELETED) {
+      continue;
+    }
 
-static pthread_rwlock_t cache_lock;
+    for(j = item->hash & mask; table->slots[j]; j = (j + 1) & mask);
+    table->slots[j] = item;
+    table->count++;
+  }
+  table->used = table->count;
+
+  return table;
+}
 
 void
 jfs_key_cache_init()
 {
-  pthread_rwlock_init(&cache_lock, NULL);
-  sglib_hashed_jfs_key_cache_t_init(hashtable);
+  pthread_mutex_init(&key_lock, NULL);
+  key_table = jfs_key_table_alloc(JFS_KEY_CACHE_MIN);
 }
 
 void
 jfs_key_cache_destroy()
 {
-  struct sglib_hashed_jfs_key_cache_t_iterator it;
-  jfs_key_cache_t *item;
-
-  pthread_rwlock_wrlock(&cache_lock);
-  for(item = sglib_hashed_jfs_key_cache_t_it_init(&it, hashtable);
-      item != NULL; item = sglib_hashed_jfs_key_cache_t_it_next(&it)) {
-    free(item->keytext);
-    free(item);
+  struct jfs_key_entry *item;
+  size_t i;
+
+  pthread_mutex_lock(&key_lock);
+  if(key_table) {
+    for(i = 0; i < key_table->size; ++i) {
+      item = key_table->slots[i];
+      if(item && item != JFS_KEY_DELETED) {
+        free(item);
+      }
+    }
+    free(key_table);
+    key_table = NULL;
   }
 
-  pthread_rwlock_unlock(&cache_lock);
-  pthread_rwlock_destroy(&cache_lock);
+  pthread_mutex_unlock(&key_lock);
+  pthread_mutex_destroy(&key_lock);
 }
 
 int
 jfs_key_cache_get_keyid(const char *keytext)
 {
-  jfs_key_cache_t  check;
-  jfs_key_cache_t *result;
+  struct jfs_key_table *table;
+  struct jfs_key_entry *item;
 
-  size_t key_len;
+  uint32_t hash;
+  size_t len;
 
+  int locked;
   int keyid;
 
-  key_len = strlen(keytext) + 1;
-  check.keytext = malloc(sizeof(*check.keytext) * key_len);
-  if(!check.keytext) {
-    return -ENOMEM;
-  }
-  strncpy(check.keytext, keytext, key_len);
+  hash = jfs_key_hash(keytext, &len);
 
-  pthread_rwlock_rdlock(&cache_lock);
-  result = sglib_hashed_jfs_key_cache_t_find_member(hashtable, &check);
-  free(check.keytext);
+  //every reader slot is taken, keep writers out instead
+  locked = jfs_epoch_enter();
+  if(locked) {
+    pthread_mutex_lock(&key_lock);
+  }
 
-  if(!result) {
-    pthread_rwlock_unlock(&cache_lock);
+  keyid = -ENOATTR;
+  table = __atomic_load_n(&key_table, __ATOMIC_ACQUIRE);
+  if(table) {
+    jfs_key_table_probe(table, keytext, len, hash, &item);
+    if(item) {
+      keyid = item->keyid;
+    }
+  }
 
-    return -ENOATTR;
+  if(locked) {
+    pthread_mutex_unlock(&key_lock);
+  }
+  else {
+    jfs_epoch_exit();
   }
-  keyid = result->keyid;
-  pthread_rwlock_unlock(&cache_lock);
 
   return keyid;
 }
@@ -134,26 +226,72 @@ jfs_key_cache_get_keyid(const char *keytext)
 int
 jfs_key_cache_add(int keyid, const char *keytext)
 {
-  jfs_key_cache_t *item;
-  size_t key_len;
+  struct jfs_key_table *table;
+  struct jfs_key_table *old;
+  struct jfs_key_entry *item;
+  struct jfs_key_entry *found;
+
+  uint32_t hash;
+  size_t len;
+  size_t size;
+  size_t i;
+
+  hash = jfs_key_hash(keytext, &len);
+
+  pthread_mutex_lock(&key_lock);
+  table = key_table;
+  if(!table) {
+    pthread_mutex_unlock(&key_lock);
+
+    return -ENOMEM;
+  }
   
-  item = malloc(sizeof(*item));
+  jfs_key_table_probe(table, keytext, len, hash, &item);
+  if(item) {
+    pthread_mutex_unlock(&key_lock);
+
+    return 0;
+  }
+
+  item = malloc(sizeof(*item) + len + 1);
   if(!item) {
+    pthread_mutex_unlock(&key_lock);
+
     return -ENOMEM;
   }
   item->keyid = keyid;
-
-  key_len = strlen(keytext) + 1;
-  item->keytext = malloc(sizeof(*item->keytext) * key_len);
-  if(!item->keytext) {
-    free(item);
-    return -ENOMEM;
+  item->hash = hash;
+  item->len = len;
+  memcpy(item->keytext, keytext, len + 1);
+
+  //keep the load under 3/4, readers still see the old table
+  old = NULL;
+  if((table->used + 1) * 4 > table->size * 3) {
+    size = table->size;
+    if((table->count + 1) * 2 > size) {
+      size *= 2;
+    }
+
+    old = table;
+    table = jfs_key_table_rehash(old, size);
+    if(!table) {
+      pthread_mutex_unlock(&key_lock);
+      free(item);
+
+      return -ENOMEM;
+    }
   }
-  strncpy(item->keytext, keytext, key_len);
 
-  pthread_rwlock_wrlock(&cache_lock);
-  sglib_hashed_jfs_key_cache_t_add(hashtable, item);
-  pthread_rwlock_unlock(&cache_lock);
+  i = jfs_key_table_probe(table, keytext, len, hash, &found);
+  __atomic_store_n(&table->slots[i], item, __ATOMIC_RELEASE);
+  table->count++;
+  table->used++;
+
+  if(old) {
+    __atomic_store_n(&key_table, table, __ATOMIC_RELEASE);
+    jfs_epoch_retire(old, free);
+  }
+  pthread_mutex_unlock(&key_lock);
 
   return 0;
 }
@@ -161,29 +299,31 @@ jfs_key_cache_add(int keyid, const char *keytext)
 int
 jfs_key_cache_remove(const char *keytext)
 {
-  jfs_key_cache_t check;
-  jfs_key_cache_t *elem;
-  
-  size_t key_len;
+  struct jfs_key_entry *item;
 
-  int rc;
+  uint32_t hash;
+  size_t len;
+  size_t i;
 
-  key_len = strlen(keytext) + 1;
-  check.keytext = malloc(sizeof(*check.keytext) * key_len);
-  if(!check.keytext) {
-    return -ENOMEM;
-  }
-  strncpy(check.keytext, keytext, key_len);
+  hash = jfs_key_hash(keytext, &len);
 
-  pthread_rwlock_wrlock(&cache_lock);
-  rc = sglib_hashed_jfs_key_cache_t_delete_if_member(hashtable, &check, &elem);
-  pthread_rwlock_unlock(&cache_lock);
+  pthread_mutex_lock(&key_lock);
+  if(!key_table) {
+    pthread_mutex_unlock(&key_lock);
 
-  free(check.keytext);
+    return 0;
+  }
+
+  //the tombstone keeps later probes intact until the next rehash
+  i = jfs_key_table_probe(key_table, keytext, len, hash, &item);
+  if(item) {
+    __atomic_store_n(&key_table->slots[i], JFS_KEY_DELETED, __ATOMIC_RELEASE);
+    key_table->count--;
+  }
+  pthread_mutex_unlock(&key_lock);
 
-  if(rc) {
-    free(elem->keytext);
-    free(elem);
+  if(item) {
+    jfs_epoch_retire(item, free);
   }
   
   return 0;
@@ -0,0 +1,1365 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#define FUSE_USE_VERSION 31
+
+/* For copy_file_range() */
+#define _GNU_SOURCE
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "error_log.h"
+#include "jfs_dir.h"
+#include "jfs_file.h"
+#include "jfs_meta.h"
+#include "jfs_security.h"
+#include "jfs_pending.h"
+#include "jfs_stat_cache.h"
+#include "jfs_page_cache.h"
+#include "jfs_inode.h"
+#include "jfs_uring.h"
+#include "jfs_prefetch.h"
+#include "jfs_lowlevel.h"
+#include "joinfs.h"
+
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define JFS_DIRENT_INC 64
+
+/*
+  A read, write or fsync in flight on the io_uring engine,
+  answered from its completion instead of a blocked worker.
+ */
+struct jfs_ll_io {
+  struct jfs_uring_req io;
+  fuse_req_t           req;
+  fuse_ino_t           ino;
+  char                 data[];
+};
+
+struct jfs_ll_dirent {
+  char       *name;
+  struct stat st;
+};
+
+/*
+  An open directory, read once on the first readdir and then
+  handed out in slices as the kernel asks for more. Offsets
+  are entry indexes.
+ */
+struct jfs_ll_dir {
+  DIR                  *dp;
+  struct jfs_ll_dirent *entries;
+  size_t                count;
+  size_t                alloc;
+  char                  path[PATH_MAX];
+};
+
+/*
+ * Reply with the attributes of a new or looked up name.
+ */
+static void
+jfs_ll_reply_entry(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+  struct fuse_entry_param e;
+  char path[PATH_MAX];
+
+  uint64_t ino;
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	memset(&e, 0, sizeof(e));
+	rc = jfs_file_getattr(path, &e.attr);
+  }
+  if(!rc) {
+	rc = jfs_inode_lookup(parent, name, &ino);
+  }
+  if(rc) {
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  e.ino = ino;
+  e.attr_timeout = joinfs_context.attr_timeout;
+  e.entry_timeout = joinfs_context.entry_timeout;
+
+  //the kernel counts a lookup for every entry it is given
+  if(fuse_reply_entry(req, &e)) {
+	jfs_inode_forget(ino, 1);
+  }
+}
+
+static void
+jfs_ll_init(void *userdata, struct fuse_conn_info *conn)
+{
+  (void) userdata;
+
+  jfs_mount_init(conn->proto_major, conn->proto_minor);
+
+  /* let reads and writes splice instead of copying,
+     io_uring needs the data in memory */
+  if(!joinfs_context.uring) {
+	if(conn->capable & FUSE_CAP_SPLICE_READ) {
+	  conn->want |= FUSE_CAP_SPLICE_READ;
+	}
+	if(conn->capable & FUSE_CAP_SPLICE_WRITE) {
+	  conn->want |= FUSE_CAP_SPLICE_WRITE;
+	}
+	if(conn->capable & FUSE_CAP_SPLICE_MOVE) {
+	  conn->want |= FUSE_CAP_SPLICE_MOVE;
+	}
+  }
+
+  if(conn->capable & FUSE_CAP_READDIRPLUS) {
+	conn->want |= FUSE_CAP_READDIRPLUS;
+  }
+
+  /* the kernel gathers small writes in its page cache */
+  if(joinfs_context.writeback) {
+	if(conn->capable & FUSE_CAP_WRITEBACK_CACHE) {
+	  conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+	  joinfs_context.page_cache = 1;
+	}
+	else {
+	  log_error("Kernel writeback caching is unsupported, writes go straight through.\n");
+	  joinfs_context.writeback = 0;
+	}
+  }
+
+  conn->max_write = joinfs_context.max_write;
+  conn->max_readahead = joinfs_context.max_readahead;
+}
+
+static void
+jfs_ll_destroy(void *userdata)
+{
+  (void) userdata;
+
+  jfs_mount_destroy();
+}
+
+static void
+jfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+  jfs_ll_reply_entry(req, parent, name);
+}
+
+static void
+jfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup)
+{
+  jfs_inode_forget(ino, nlookup);
+  fuse_reply_none(req);
+}
+
+static void
+jfs_ll_forget_multi(fuse_req_t req, size_t count,
+                    struct fuse_forget_data *forgets)
+{
+  size_t i;
+
+  for(i = 0; i < count; ++i) {
+	jfs_inode_forget(forgets[i].ino, forgets[i].nlookup);
+  }
+  fuse_reply_none(req);
+}
+
+static void
+jfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  struct stat st;
+  char path[PATH_MAX];
+
+  int rc;
+
+  if(fi) {
+	rc = fstat(fi->fh, &st) ? -errno : 0;
+  }
+  else {
+	rc = jfs_inode_path(ino, path, sizeof(path));
+	if(!rc) {
+	  rc = jfs_file_getattr(path, &st);
+	}
+  }
+
+  if(rc) {
+	if(rc != -ENOENT) {
+	  log_error("jfs_ll_getattr---ino:%lu, error:%d\n", (unsigned long)ino, rc);
+	}
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  fuse_reply_attr(req, &st, joinfs_context.attr_timeout);
+}
+
+/*
+ * Set the times setattr asks for, leaving the other one alone.
+ */
+static int
+jfs_ll_utimens(const char *path, struct stat *attr, int to_set,
+               struct fuse_file_info *fi)
+{
+  struct timespec ts[2];
+
+  ts[0].tv_sec = 0;
+  ts[0].tv_nsec = UTIME_OMIT;
+  ts[1].tv_sec = 0;
+  ts[1].tv_nsec = UTIME_OMIT;
+
+  if(to_set & FUSE_SET_ATTR_ATIME_NOW) {
+	ts[0].tv_nsec = UTIME_NOW;
+  }
+  else if(to_set & FUSE_SET_ATTR_ATIME) {
+	ts[0] = attr->st_atim;
+  }
+
+  if(to_set & FUSE_SET_ATTR_MTIME_NOW) {
+	ts[1].tv_nsec = UTIME_NOW;
+  }
+  else if(to_set & FUSE_SET_ATTR_MTIME) {
+	ts[1] = attr->st_mtim;
+  }
+
+  if(fi) {
+	return futimens(fi->fh, ts) ? -errno : 0;
+  }
+
+  return jfs_file_utimens(path, ts);
+}
+
+static void
+jfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+               int to_set, struct fuse_file_info *fi)
+{
+  struct stat st;
+  char path[PATH_MAX];
+
+  uid_t uid;
+  gid_t gid;
+
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(rc) {
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  if(to_set & FUSE_SET_ATTR_MODE) {
+	rc = jfs_security_chmod(path, attr->st_mode);
+  }
+  if(!rc && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID))) {
+	uid = (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t)-1;
+	gid = (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t)-1;
+	rc = jfs_security_chown(path, uid, gid);
+  }
+  if(!rc && (to_set & FUSE_SET_ATTR_SIZE)) {
+	if(fi) {
+	  rc = ftruncate(fi->fh, attr->st_size) ? -errno : 0;
+	}
+	else {
+	  rc = jfs_file_truncate(path, attr->st_size);
+	}
+  }
+  if(!rc && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME
+                       | FUSE_SET_ATTR_ATIME_NOW | FUSE_SET_ATTR_MTIME_NOW))) {
+	rc = jfs_ll_utimens(path, attr, to_set, fi);
+  }
+  jfs_stat_cache_remove(path);
+
+  if(!rc) {
+	rc = jfs_file_getattr(path, &st);
+  }
+  if(rc) {
+	log_error("jfs_ll_setattr---path:%s, to_set:%d, error:%d\n", path, to_set, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  fuse_reply_attr(req, &st, joinfs_context.attr_timeout);
+}
+
+static void
+jfs_ll_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+  char path[PATH_MAX];
+  char buf[PATH_MAX];
+
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_file_readlink(path, buf, sizeof(buf));
+  }
+  if(rc) {
+	log_error("jfs_ll_readlink---ino:%lu, error:%d\n", (unsigned long)ino, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  fuse_reply_readlink(req, buf);
+}
+
+static void
+jfs_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+             mode_t mode, dev_t rdev)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_file_mknod(path, mode, rdev);
+  }
+  if(rc) {
+	log_error("jfs_ll_mknod---name:%s, mode:%d, error:%d\n", name, mode, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  jfs_ll_reply_entry(req, parent, name);
+}
+
+static void
+jfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+             mode_t mode)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_dir_mkdir(path, mode);
+  }
+  if(rc) {
+	log_error("jfs_ll_mkdir---name:%s, mode:%d, error:%d\n", name, mode, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  jfs_ll_reply_entry(req, parent, name);
+}
+
+static void
+jfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_file_unlink(path);
+  }
+  if(rc) {
+	log_error("jfs_ll_unlink---path:%s, error:%d\n", path, rc);
+  }
+  else {
+	jfs_inode_unlink(parent, name);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static void
+jfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_dir_rmdir(path);
+  }
+  if(rc) {
+	log_error("jfs_ll_rmdir---path:%s, error:%d\n", path, rc);
+  }
+  else {
+	jfs_inode_unlink(parent, name);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static void
+jfs_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+               const char *name)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_file_symlink(link, path);
+  }
+  if(rc) {
+	log_error("jfs_ll_symlink---from:%s, to:%s, error:%d\n", link, name, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  jfs_ll_reply_entry(req, parent, name);
+}
+
+static void
+jfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+              fuse_ino_t newparent, const char *newname, unsigned int flags)
+{
+  char from[PATH_MAX];
+  char to[PATH_MAX];
+
+  int rc;
+
+  //RENAME_EXCHANGE and RENAME_NOREPLACE have no joinFS equivalent
+  if(flags) {
+	fuse_reply_err(req, EINVAL);
+	return;
+  }
+
+  rc = jfs_inode_child_path(parent, name, from, sizeof(from));
+  if(!rc) {
+	rc = jfs_inode_child_path(newparent, newname, to, sizeof(to));
+  }
+  if(!rc) {
+	rc = jfs_file_rename(from, to);
+  }
+  if(!rc) {
+	rc = jfs_inode_rename(parent, name, newparent, newname);
+  }
+  if(rc) {
+	log_error("jfs_ll_rename---from:%s, to:%s, error:%d\n", name, newname, rc);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static void
+jfs_ll_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
+            const char *newname)
+{
+  char from[PATH_MAX];
+  char to[PATH_MAX];
+
+  int rc;
+
+  rc = jfs_inode_path(ino, from, sizeof(from));
+  if(!rc) {
+	rc = jfs_inode_child_path(newparent, newname, to, sizeof(to));
+  }
+  if(!rc) {
+	rc = jfs_file_link(from, to);
+  }
+  if(rc) {
+	log_error("jfs_ll_link---to:%s, error:%d\n", newname, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  jfs_ll_reply_entry(req, newparent, newname);
+}
+
+/*
+ * A writeback cache may read pages of write-only files,
+ * and positions appends itself.
+ */
+static int
+jfs_ll_open_flags(int flags)
+{
+  if(!joinfs_context.writeback) {
+	return flags;
+  }
+
+  if((flags & O_ACCMODE) == O_WRONLY) {
+	flags = (flags & ~O_ACCMODE) | O_RDWR;
+  }
+
+  return flags & ~O_APPEND;
+}
+
+static void
+jfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  char path[PATH_MAX];
+  int fd;
+
+  fd = jfs_inode_path(ino, path, sizeof(path));
+  if(!fd) {
+	fd = jfs_file_open(path, jfs_ll_open_flags(fi->flags), 0);
+  }
+  if(fd < 0) {
+	log_error("jfs_ll_open---ino:%lu, error:%d\n", (unsigned long)ino, fd);
+	fuse_reply_err(req, -fd);
+	return;
+  }
+
+  fi->fh = fd;
+  jfs_set_io_mode(fi, ino);
+
+  if(fuse_reply_open(req, fi)) {
+	close(fd);
+  }
+}
+
+static void
+jfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+              mode_t mode, struct fuse_file_info *fi)
+{
+  struct fuse_entry_param e;
+  char path[PATH_MAX];
+
+  uint64_t ino;
+  int fd;
+
+  fd = jfs_inode_child_path(parent, name, path, sizeof(path));
+  if(!fd) {
+	fd = jfs_file_open(path, jfs_ll_open_flags(fi->flags), mode);
+  }
+  if(fd < 0) {
+	log_error("jfs_ll_create---name:%s, flags:%d, mode:%d, error:%d\n",
+	          name, fi->flags, mode, fd);
+	fuse_reply_err(req, -fd);
+	return;
+  }
+
+  memset(&e, 0, sizeof(e));
+  if(fstat(fd, &e.attr) || jfs_inode_lookup(parent, name, &ino)) {
+	close(fd);
+	fuse_reply_err(req, EIO);
+	return;
+  }
+  e.ino = ino;
+  e.attr_timeout = joinfs_context.attr_timeout;
+  e.entry_timeout = joinfs_context.entry_timeout;
+
+  fi->fh = fd;
+  jfs_set_io_mode(fi, ino);
+
+  if(fuse_reply_create(req, &e, fi)) {
+	jfs_inode_forget(ino, 1);
+	close(fd);
+  }
+}
+
+static struct jfs_ll_io *
+jfs_ll_io_new(fuse_req_t req, fuse_ino_t ino, enum jfs_uring_op op,
+              struct fuse_file_info *fi, size_t size, off_t off,
+              void (*done)(struct jfs_uring_req *, ssize_t))
+{
+  struct jfs_ll_io *io;
+
+  io = malloc(sizeof(*io) + size);
+  if(!io) {
+	return NULL;
+  }
+
+  io->io.op = op;
+  io->io.fd = fi->fh;
+  io->io.buf = io->data;
+  io->io.len = size;
+  io->io.offset = off;
+  io->io.done = done;
+  io->req = req;
+  io->ino = ino;
+
+  return io;
+}
+
+static void
+jfs_ll_read_done(struct jfs_uring_req *req, ssize_t res)
+{
+  struct jfs_ll_io *io = (struct jfs_ll_io *)req;
+
+  if(res < 0) {
+	log_error("jfs_ll_read---error:%d\n", (int)res);
+	fuse_reply_err(io->req, -res);
+  }
+  else {
+	fuse_reply_buf(io->req, io->data, res);
+  }
+  free(io);
+}
+
+static void
+jfs_ll_write_done(struct jfs_uring_req *req, ssize_t res)
+{
+  struct jfs_ll_io *io = (struct jfs_ll_io *)req;
+  char path[PATH_MAX];
+
+  if(res < 0) {
+	log_error("jfs_ll_write_buf---error:%d\n", (int)res);
+	fuse_reply_err(io->req, -res);
+	free(io);
+	return;
+  }
+
+  //the open file keeps its node alive until release
+  if(!jfs_inode_path(io->ino, path, sizeof(path))) {
+	jfs_stat_cache_remove(path);
+  }
+
+  fuse_reply_write(io->req, res);
+  free(io);
+}
+
+static void
+jfs_ll_fsync_done(struct jfs_uring_req *req, ssize_t res)
+{
+  struct jfs_ll_io *io = (struct jfs_ll_io *)req;
+
+  if(res < 0) {
+	log_error("jfs_ll_fsync---error:%d\n", (int)res);
+  }
+
+  fuse_reply_err(io->req, res < 0 ? -res : 0);
+  free(io);
+}
+
+/*
+ * Hand FUSE the backing file instead of the data, so it
+ * can splice straight from the file to /dev/fuse.
+ */
+static void
+jfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+            struct fuse_file_info *fi)
+{
+  struct fuse_bufvec buf = FUSE_BUFVEC_INIT(size);
+  struct jfs_ll_io *io;
+
+  jfs_prefetch_read(fi->fh, off, size);
+
+  if(jfs_uring_enabled()) {
+	io = jfs_ll_io_new(req, ino, jfs_uring_op_read, fi, size, off,
+	                   jfs_ll_read_done);
+	if(!io) {
+	  fuse_reply_err(req, ENOMEM);
+	  return;
+	}
+
+	jfs_uring_submit(&io->io);
+	return;
+  }
+
+  buf.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+  buf.buf[0].fd = fi->fh;
+  buf.buf[0].pos = off;
+
+  fuse_reply_data(req, &buf, FUSE_BUF_SPLICE_MOVE);
+}
+
+static void
+jfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf,
+                 off_t off, struct fuse_file_info *fi)
+{
+  struct fuse_bufvec dst = FUSE_BUFVEC_INIT(fuse_buf_size(in_buf));
+  struct jfs_ll_io *io;
+  char path[PATH_MAX];
+
+  ssize_t rc;
+
+  //the request buffer is gone once we return, so the data is copied
+  if(jfs_uring_enabled()) {
+	io = jfs_ll_io_new(req, ino, jfs_uring_op_write, fi,
+	                   fuse_buf_size(in_buf), off, jfs_ll_write_done);
+	if(!io) {
+	  fuse_reply_err(req, ENOMEM);
+	  return;
+	}
+
+	dst.buf[0].flags = 0;
+	dst.buf[0].mem = io->data;
+	rc = fuse_buf_copy(&dst, in_buf, 0);
+	if(rc < 0) {
+	  free(io);
+	  fuse_reply_err(req, -rc);
+	  return;
+	}
+	io->io.len = rc;
+
+	jfs_uring_submit(&io->io);
+	return;
+  }
+
+  dst.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+  dst.buf[0].fd = fi->fh;
+  dst.buf[0].pos = off;
+
+  rc = fuse_buf_copy(&dst, in_buf, FUSE_BUF_SPLICE_NONBLOCK);
+  if(rc < 0) {
+	log_error("jfs_ll_write_buf---error:%d\n", (int)rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  //unlinked files have no path left to cache
+  if(!jfs_inode_path(ino, path, sizeof(path))) {
+	jfs_stat_cache_remove(path);
+  }
+
+  fuse_reply_write(req, rc);
+}
+
+static void
+jfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  int rc;
+
+  (void) ino;
+
+  rc = close(dup(fi->fh));
+  fuse_reply_err(req, rc ? errno : 0);
+}
+
+static void
+jfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  struct stat st;
+
+  //our own writes went through this node's page cache, so it is still current
+  if(joinfs_context.page_cache && (fi->flags & O_ACCMODE) != O_RDONLY
+     && !fstat(fi->fh, &st)) {
+	jfs_page_cache_update(ino, &st);
+  }
+  jfs_prefetch_release(fi->fh);
+  close(fi->fh);
+
+  fuse_reply_err(req, 0);
+}
+
+static void
+jfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+             struct fuse_file_info *fi)
+{
+  struct jfs_ll_io *io;
+
+  char path[PATH_MAX];
+  int rc;
+
+  /* the file's metadata must be on disk too */
+  if(joinfs_context.async_writes) {
+	//an unlinked file has no path left to report failures for
+	if(jfs_inode_path(ino, path, sizeof(path))) {
+	  path[0] = '\0';
+	}
+	rc = jfs_pending_flush(path);
+	if(rc) {
+	  log_error("jfs_ll_fsync---queued write error:%d\n", rc);
+	  fuse_reply_err(req, -rc);
+	  return;
+	}
+  }
+
+  if(jfs_uring_enabled()) {
+	io = jfs_ll_io_new(req, ino, datasync ? jfs_uring_op_fdatasync
+	                   : jfs_uring_op_fsync, fi, 0, 0, jfs_ll_fsync_done);
+	if(!io) {
+	  fuse_reply_err(req, ENOMEM);
+	  return;
+	}
+
+	jfs_uring_submit(&io->io);
+	return;
+  }
+
+#ifndef HAVE_FDATASYNC
+  (void) datasync;
+
+#else
+  if(datasync)
+	rc = fdatasync(fi->fh);
+  else
+#endif
+	rc = fsync(fi->fh);
+
+  if(rc < 0) {
+	log_error("jfs_ll_fsync---error:%d\n", -errno);
+	fuse_reply_err(req, errno);
+	return;
+  }
+
+  fuse_reply_err(req, 0);
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+/*
+ * Copy between backing files without the data passing through
+ * joinFS. A whole file copied into an empty one is cloned, so
+ * reflink capable filesystems share the extents instead.
+ *
+ * The links table is left alone, the target got its row when it
+ * was created and a data copy does not change which file it is.
+ */
+static void
+jfs_ll_copy_file_range(fuse_req_t req, fuse_ino_t ino_in, off_t off_in,
+                       struct fuse_file_info *fi_in, fuse_ino_t ino_out,
+                       off_t off_out, struct fuse_file_info *fi_out,
+                       size_t len, int flags)
+{
+#ifdef FICLONE
+  struct stat st_in;
+  struct stat st_out;
+#endif
+  char path[PATH_MAX];
+
+  ssize_t rc;
+
+  (void) ino_in;
+
+  if(flags) {
+	fuse_reply_err(req, EINVAL);
+	return;
+  }
+
+  rc = -1;
+#ifdef FICLONE
+  if(!off_in && !off_out && !fstat(fi_in->fh, &st_in)
+     && !fstat(fi_out->fh, &st_out) && !st_out.st_size
+     && (off_t)len >= st_in.st_size
+     && !ioctl(fi_out->fh, FICLONE, fi_in->fh)) {
+	rc = st_in.st_size;
+  }
+#endif
+
+  if(rc < 0) {
+	rc = copy_file_range(fi_in->fh, &off_in, fi_out->fh, &off_out, len, 0);
+  }
+  if(rc < 0) {
+	rc = -errno;
+
+	//the kernel copies through read and write itself on these
+	if(rc == -ENOSYS || rc == -EINVAL) {
+	  rc = -EOPNOTSUPP;
+	}
+	if(rc != -EOPNOTSUPP && rc != -EXDEV) {
+	  log_error("jfs_ll_copy_file_range---error:%d\n", (int)rc);
+	}
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  if(!jfs_inode_path(ino_out, path, sizeof(path))) {
+	jfs_stat_cache_remove(path);
+  }
+
+  fuse_reply_write(req, rc);
+}
+#endif
+
+static void
+jfs_ll_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset,
+                 off_t length, struct fuse_file_info *fi)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = fallocate(fi->fh, mode, offset, length);
+  if(rc) {
+	fuse_reply_err(req, errno);
+	return;
+  }
+
+  if(!jfs_inode_path(ino, path, sizeof(path))) {
+	jfs_stat_cache_remove(path);
+  }
+
+  fuse_reply_err(req, 0);
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+/*
+ * Let SEEK_DATA and SEEK_HOLE find the extents of sparse files,
+ * so copies can skip the holes instead of reading zeros.
+ */
+static void
+jfs_ll_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
+             struct fuse_file_info *fi)
+{
+  off_t rc;
+
+  (void) ino;
+
+  rc = lseek(fi->fh, off, whence);
+  if(rc == -1) {
+	fuse_reply_err(req, errno);
+	return;
+  }
+
+  fuse_reply_lseek(req, rc);
+}
+#endif
+
+static void
+jfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  struct jfs_ll_dir *d;
+
+  int rc;
+
+  d = calloc(1, sizeof(*d));
+  if(!d) {
+	fuse_reply_err(req, ENOMEM);
+	return;
+  }
+
+  rc = jfs_inode_path(ino, d->path, sizeof(d->path));
+  if(!rc) {
+	rc = jfs_dir_opendir(d->path, &d->dp);
+  }
+  if(rc) {
+	log_error("jfs_ll_opendir---ino:%lu, error:%d\n", (unsigned long)ino, rc);
+	free(d);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  fi->fh = (uintptr_t)d;
+  if(fuse_reply_open(req, fi)) {
+	closedir(d->dp);
+	free(d);
+  }
+}
+
+static void
+jfs_ll_dir_clear(struct jfs_ll_dir *d)
+{
+  size_t i;
+
+  for(i = 0; i < d->count; ++i) {
+	free(d->entries[i].name);
+  }
+  d->count = 0;
+}
+
+/*
+ * Keep one entry, dynamic entries come with their full attributes.
+ */
+static int
+jfs_ll_fill(void *buf, const char *name, const struct stat *stbuf, off_t off)
+{
+  struct jfs_ll_dir *d = buf;
+  struct jfs_ll_dirent *grown;
+
+  (void) off;
+
+  if(d->count == d->alloc) {
+	grown = realloc(d->entries, sizeof(*grown) * (d->alloc + JFS_DIRENT_INC));
+	if(!grown) {
+	  return 1;
+	}
+	d->entries = grown;
+	d->alloc += JFS_DIRENT_INC;
+  }
+
+  d->entries[d->count].name = strdup(name);
+  if(!d->entries[d->count].name) {
+	return 1;
+  }
+  memcpy(&d->entries[d->count].st, stbuf, sizeof(*stbuf));
+  ++d->count;
+
+  return 0;
+}
+
+/*
+ * Add one readdirplus entry, counting the lookup the kernel will hold.
+ */
+static size_t
+jfs_ll_add_plus(fuse_req_t req, fuse_ino_t ino, struct jfs_ll_dirent *ent,
+                char *buf, size_t size, off_t next)
+{
+  struct fuse_entry_param e;
+  char path[PATH_MAX];
+
+  size_t entsize;
+  uint64_t child;
+
+  int rc;
+
+  entsize = fuse_add_direntry_plus(req, NULL, 0, ent->name, NULL, 0);
+  if(entsize > size) {
+	return entsize;
+  }
+
+  memset(&e, 0, sizeof(e));
+  e.attr = ent->st;
+
+  //a zero node id only names the entry, as for . and ..
+  if(!strcmp(ent->name, ".") || !strcmp(ent->name, "..")) {
+	return fuse_add_direntry_plus(req, buf, size, ent->name, &e, next);
+  }
+
+  //entries of real folders only carry their inode and type
+  rc = 0;
+  if(!ent->st.st_nlink) {
+	rc = jfs_inode_child_path(ino, ent->name, path, sizeof(path));
+	if(!rc) {
+	  rc = jfs_file_getattr(path, &e.attr);
+	}
+  }
+  if(!rc) {
+	rc = jfs_inode_lookup(ino, ent->name, &child);
+  }
+  if(!rc) {
+	e.ino = child;
+	e.attr_timeout = joinfs_context.attr_timeout;
+	e.entry_timeout = joinfs_context.entry_timeout;
+  }
+
+  return fuse_add_direntry_plus(req, buf, size, ent->name, &e, next);
+}
+
+static void
+jfs_ll_do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                  struct fuse_file_info *fi, int plus)
+{
+  struct jfs_ll_dir *d;
+  struct jfs_ll_dirent *ent;
+
+  char *buf;
+
+  size_t entsize;
+  size_t pos;
+  size_t i;
+
+  int rc;
+
+  d = (struct jfs_ll_dir *)(uintptr_t)fi->fh;
+
+  //the listing is read once per pass, a rewind starts a new one
+  if(!off) {
+	jfs_ll_dir_clear(d);
+	rewinddir(d->dp);
+
+	rc = jfs_dir_readdir(d->path, d->dp, d, jfs_ll_fill);
+	if(rc) {
+	  log_error("jfs_ll_readdir---path:%s, error:%d\n", d->path, rc);
+	  fuse_reply_err(req, -rc);
+	  return;
+	}
+  }
+
+  buf = malloc(size);
+  if(!buf) {
+	fuse_reply_err(req, ENOMEM);
+	return;
+  }
+
+  pos = 0;
+  for(i = off; i < d->count; ++i) {
+	ent = &d->entries[i];
+
+	if(plus) {
+	  entsize = jfs_ll_add_plus(req, ino, ent, buf + pos, size - pos, i + 1);
+	}
+	else {
+	  entsize = fuse_add_direntry(req, buf + pos, size - pos, ent->name,
+	                              &ent->st, i + 1);
+	}
+	if(entsize > size - pos) {
+	  break;
+	}
+	pos += entsize;
+  }
+
+  fuse_reply_buf(req, buf, pos);
+  free(buf);
+}
+
+static void
+jfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+               struct fuse_file_info *fi)
+{
+  jfs_ll_do_readdir(req, ino, size, off, fi, 0);
+}
+
+/*
+ * Hand back the attributes with the names, so listing a query
+ * folder does not cost a lookup per entry afterwards.
+ */
+static void
+jfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                   struct fuse_file_info *fi)
+{
+  jfs_ll_do_readdir(req, ino, size, off, fi, 1);
+}
+
+static void
+jfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+  struct jfs_ll_dir *d;
+
+  (void) ino;
+
+  d = (struct jfs_ll_dir *)(uintptr_t)fi->fh;
+  closedir(d->dp);
+  jfs_ll_dir_clear(d);
+  free(d->entries);
+  free(d);
+
+  fuse_reply_err(req, 0);
+}
+
+static void
+jfs_ll_statfs(fuse_req_t req, fuse_ino_t ino)
+{
+  struct statvfs stbuf;
+  char path[PATH_MAX];
+
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_file_statfs(path, &stbuf);
+  }
+  if(rc) {
+	log_error("jfs_ll_statfs---ino:%lu, error:%d\n", (unsigned long)ino, rc);
+	fuse_reply_err(req, -rc);
+	return;
+  }
+
+  fuse_reply_statfs(req, &stbuf);
+}
+
+static void
+jfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                const char *value, size_t size, int flags)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_meta_setxattr(path, name, value, size, flags);
+  }
+  if(rc) {
+	log_error("jfs_ll_setxattr---ino:%lu, name:%s, error:%d\n",
+	          (unsigned long)ino, name, rc);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static void
+jfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                size_t size)
+{
+  char path[PATH_MAX];
+  char *value = NULL;
+
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc && size) {
+	value = malloc(size);
+	if(!value) {
+	  rc = -ENOMEM;
+	}
+  }
+  if(!rc) {
+	rc = jfs_meta_getxattr(path, name, value, size);
+  }
+
+  if(rc < 0) {
+	log_error("jfs_ll_getxattr---ino:%lu, name:%s, error:%d\n",
+	          (unsigned long)ino, name, rc);
+	fuse_reply_err(req, -rc);
+  }
+  else if(!size) {
+	fuse_reply_xattr(req, rc);
+  }
+  else {
+	fuse_reply_buf(req, value, rc);
+  }
+  free(value);
+}
+
+static void
+jfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+{
+  char path[PATH_MAX];
+  char *list = NULL;
+
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc && size) {
+	list = malloc(size);
+	if(!list) {
+	  rc = -ENOMEM;
+	}
+  }
+  if(!rc) {
+	rc = jfs_meta_listxattr(path, list, size);
+  }
+
+  if(rc < 0) {
+	log_error("jfs_ll_listxattr---ino:%lu, error:%d\n", (unsigned long)ino, rc);
+	fuse_reply_err(req, -rc);
+  }
+  else if(!size) {
+	fuse_reply_xattr(req, rc);
+  }
+  else {
+	fuse_reply_buf(req, list, rc);
+  }
+  free(list);
+}
+
+static void
+jfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_meta_removexattr(path, name);
+  }
+  if(rc) {
+	log_error("jfs_ll_removexattr---ino:%lu, name:%s, error:%d\n",
+	          (unsigned long)ino, name, rc);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static void
+jfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask)
+{
+  char path[PATH_MAX];
+  int rc;
+
+  rc = jfs_inode_path(ino, path, sizeof(path));
+  if(!rc) {
+	rc = jfs_security_access(path, mask);
+  }
+  if(rc && rc != -EACCES) {
+	log_error("jfs_ll_access---path:%s, mask:%d, error:%d\n", path, mask, rc);
+  }
+
+  fuse_reply_err(req, -rc);
+}
+
+static struct fuse_lowlevel_ops jfs_ll_oper = {
+  .init         = jfs_ll_init,
+  .destroy      = jfs_ll_destroy,
+  .lookup       = jfs_ll_lookup,
+  .forget       = jfs_ll_forget,
+  .forget_multi = jfs_ll_forget_multi,
+  .getattr      = jfs_ll_getattr,
+  .setattr      = jfs_ll_setattr,
+  .readlink     = jfs_ll_readlink,
+  .mknod        = jfs_ll_mknod,
+  .mkdir        = jfs_ll_mkdir,
+  .unlink       = jfs_ll_unlink,
+  .rmdir        = jfs_ll_rmdir,
+  .symlink      = jfs_ll_symlink,
+  .rename       = jfs_ll_rename,
+  .link         = jfs_ll_link,
+  .open         = jfs_ll_open,
+  .create       = jfs_ll_create,
+  .read         = jfs_ll_read,
+  .write_buf    = jfs_ll_write_buf,
+  .fallocate    = jfs_ll_fallocate,
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+  .copy_file_range = jfs_ll_copy_file_range,
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+  .lseek        = jfs_ll_lseek,
+#endif
+  .flush        = jfs_ll_flush,
+  .release      = jfs_ll_release,
+  .fsync        = jfs_ll_fsync,
+  .opendir      = jfs_ll_opendir,
+  .readdir      = jfs_ll_readdir,
+  .readdirplus  = jfs_ll_readdirplus,
+  .releasedir   = jfs_ll_releasedir,
+  .statfs       = jfs_ll_statfs,
+  .setxattr     = jfs_ll_setxattr,
+  .getxattr     = jfs_ll_getxattr,
+  .listxattr    = jfs_ll_listxattr,
+  .removexattr  = jfs_ll_removexattr,
+  .access       = jfs_ll_access,
+};
+
+int
+jfs_lowlevel_main(struct fuse_args *args)
+{
+  struct fuse_cmdline_opts opts;
+  struct fuse_session *se;
+
+  int rc;
+
+  if(fuse_parse_cmdline(args, &opts)) {
+	return 1;
+  }
+  if(!opts.mountpoint) {
+	printf("joinFS needs a mount point.\n");
+	return 1;
+  }
+
+  rc = jfs_inode_init();
+  if(rc) {
+	free(opts.mountpoint);
+	return 1;
+  }
+
+  rc = 1;
+  se = fuse_session_new(args, &jfs_ll_oper, sizeof(jfs_ll_oper), NULL);
+  if(!se) {
+	goto out_inode;
+  }
+  if(fuse_set_signal_handlers(se)) {
+	goto out_session;
+  }
+  if(fuse_session_mount(se, opts.mountpoint)) {
+	goto out_signal;
+  }
+
+  fuse_daemonize(opts.foreground);
+
+  if(opts.singlethread) {
+	rc = fuse_session_loop(se);
+  }
+  else {
+	rc = fuse_session_loop_mt(se, opts.clone_fd);
+  }
+  fuse_session_unmount(se);
+
+ out_signal:
+  fuse_remove_signal_handlers(se);
+ out_session:
+  fuse_session_destroy(se);
+ out_inode:
+  jfs_inode_destroy();
+  free(opts.mountpoint);
+
+  return rc;
+}
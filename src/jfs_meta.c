@@ -27,6 +27,8 @@
 #include "jfs_meta.h"
 #include "jfs_meta_cache.h"
 #include "jfs_key_cache.h"
+#include "jfs_pending.h"
+#include "jfs_query_cache.h"
 #include "sqlitedb.h"
 #include "joinfs.h"
 
@@ -47,6 +49,22 @@ jfs_meta_setxattr(const char *path, const char *key, const char *value,
   int keyid;
   int rc;
   
+  //creates must fail on an existing key, so they can not be queued
+  if(joinfs_context.async_writes && flags != XATTR_CREATE) {
+    keyid = jfs_util_get_keyid(key);
+    if(keyid < 1) {
+      return keyid;
+    }
+
+    rc = jfs_pending_meta_write(flags == XATTR_REPLACE ? jfs_meta_replace_stmt : jfs_meta_set_stmt,
+                                path, keyid, value, size);
+    if(rc) {
+      return rc;
+    }
+    
+    return jfs_meta_cache_remove(path, keyid);
+  }
+
   safe_value = malloc(sizeof(*safe_value) * (size + 1));
   if(!safe_value) {
 	return -ENOMEM;
@@ -61,25 +79,22 @@ jfs_meta_setxattr(const char *path, const char *key, const char *value,
   }
   
   if(flags == XATTR_CREATE) {
-	rc = jfs_db_op_create(&db_op, jfs_write_op,
-                          "INSERT OR ROLLBACK INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=\"%s\"),%d,\"%s\");",
-                          path, keyid, safe_value);
+	rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_meta_create_stmt);
   }
   else if(flags == XATTR_REPLACE) {
-	rc = jfs_db_op_create(&db_op, jfs_write_op,
-                          "REPLACE INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=\"%s\"),%d,\"%s\");",
-                          path, keyid, safe_value);
+	rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_meta_replace_stmt);
   }
   else {
-	rc = jfs_db_op_create(&db_op, jfs_write_op,
-                          "INSERT OR REPLACE INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=\"%s\"),%d,\"%s\");",
-                          path, keyid, safe_value);
+	rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_meta_set_stmt);
   }
   
   if(rc) {
     free(safe_value);
     return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
+  jfs_db_op_bind_int(db_op, keyid);
+  jfs_db_op_bind_text_len(db_op, safe_value, size);
   
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -89,6 +104,7 @@ jfs_meta_setxattr(const char *path, const char *key, const char *value,
     free(safe_value);
 	return rc;
   }
+  jfs_query_cache_invalidate_key(keyid);
   
   rc = jfs_meta_cache_add(path, keyid, safe_value);
   free(safe_value);
@@ -129,29 +145,45 @@ jfs_meta_do_getxattr(const char *path, const char *key, char **value)
   char *cache_value;
   
   size_t size;
+
+  unsigned long generation;
   
   int keyid;
   int rc;
 
-  keyid = jfs_util_get_keyid(key);
+  //an unknown key can not be set on any file
+  keyid = jfs_util_find_keyid(key);
   if(keyid < 1) {
     return keyid;
   }
+  generation = jfs_meta_cache_generation(path);
   
-  //try the cache first
+  //writes that have not committed come first
+  rc = jfs_pending_meta_get(path, keyid, &cache_value);
+  if(rc != -ENOENT) {
+    if(!rc) {
+      *value = cache_value;
+    }
+    return rc;
+  }
+
+  //try the cache first, it also remembers missing keys
   rc = jfs_meta_cache_get_value(path, keyid, &cache_value);
   if(!rc) {
     *value = cache_value;
     return 0;    
   }
+  else if(rc != -ENOENT) {
+    return rc;
+  }
   
   //cache miss, go out to the db
-  rc = jfs_db_op_create(&db_op, jfs_meta_cache_op,
-                        "SELECT keyvalue FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\") and keyid=%d;",
-                        path, keyid);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_meta_cache_op, jfs_meta_lookup_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
+  jfs_db_op_bind_int(db_op, keyid);
   
   jfs_read_pool_queue(db_op);
 
@@ -165,6 +197,7 @@ jfs_meta_do_getxattr(const char *path, const char *key, char **value)
   if(db_op->result == NULL) {
     db_op->rc = 1;
     jfs_db_op_destroy(db_op);
+    jfs_meta_cache_fill(path, keyid, NULL, generation);
 
 	return -ENOATTR;
   }
@@ -179,7 +212,7 @@ jfs_meta_do_getxattr(const char *path, const char *key, char **value)
   strncpy(cache_value, db_op->result->value, size);
   jfs_db_op_destroy(db_op);
 
-  rc = jfs_meta_cache_add(path, keyid, cache_value);
+  rc = jfs_meta_cache_fill(path, keyid, cache_value, generation);
   if(rc) {
     free(cache_value);
 
@@ -204,12 +237,14 @@ jfs_meta_listxattr(const char *path, char *list, size_t buffer_size)
   char *list_pos;
   int rc;
   
-  rc = jfs_db_op_create(&db_op, jfs_listattr_op,
-                        "SELECT k.keyid, k.keytext FROM keys AS k, metadata AS m WHERE k.keyid=m.keyid and m.jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\");",
-                        path);
+  //the listing comes from the db, let queued writes land
+  jfs_pending_wait();
+
+  rc = jfs_db_op_create_stmt(&db_op, jfs_listattr_op, jfs_listattr_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
   
   jfs_read_pool_queue(db_op);
 
@@ -254,17 +289,26 @@ jfs_meta_removexattr(const char *path, const char *key)
   int keyid;
   int rc;
   
-  keyid = jfs_util_get_keyid(key);
+  keyid = jfs_util_find_keyid(key);
   if(keyid < 1) {
     return keyid;
   }
   
-  rc = jfs_db_op_create(&db_op, jfs_write_op,
-                        "DELETE FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=\"%s\") and keyid=%d;",
-                        path, keyid);
+  if(joinfs_context.async_writes) {
+    rc = jfs_pending_meta_write(jfs_meta_remove_stmt, path, keyid, NULL, 0);
+    if(rc) {
+      return rc;
+    }
+    
+    return jfs_meta_cache_remove(path, keyid);
+  }
+
+  rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_meta_remove_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_text(db_op, path);
+  jfs_db_op_bind_int(db_op, keyid);
   
   jfs_write_pool_queue(db_op);
   rc = jfs_db_op_wait(db_op);
@@ -273,6 +317,7 @@ jfs_meta_removexattr(const char *path, const char *key)
   if(rc) {
 	return rc;
   }
+  jfs_query_cache_invalidate_key(keyid);
 
   rc = jfs_meta_cache_remove(path, keyid);
   if(rc) {
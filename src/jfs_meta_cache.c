@@ -21,8 +21,9 @@
 #define	_REENTRANT
 #endif
 
+#include "error_log.h"
 #include "jfs_meta_cache.h"
-#include "sglib.h"
+#include "joinfs.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -32,187 +33,572 @@
 #include <attr/xattr.h>
 #include <pthread.h>
 
-#define JFS_META_CACHE_SIZE 10000
+#define JFS_META_CACHE_STRIPES     64
+#define JFS_META_CACHE_BUCKETS_MIN 64
 
-typedef struct jfs_meta_cache jfs_meta_cache_t;
-struct jfs_meta_cache {
+/*
+  A cached key of a path. A NULL value records that the path
+  has no such key.
+ */
+typedef struct jfs_meta_attr jfs_meta_attr_t;
+struct jfs_meta_attr {
   int               keyid;
   char             *value;
+
+  jfs_meta_attr_t  *next;
+};
+
+/*
+  Every cached key of one path.
+ */
+typedef struct jfs_meta_node jfs_meta_node_t;
+struct jfs_meta_node {
+  unsigned int      hash;
   char             *path;
-  
-  jfs_meta_cache_t *next;
+  size_t            bytes;
+
+  jfs_meta_attr_t  *attrs;
+
+  jfs_meta_node_t  *next;
+  jfs_meta_node_t  *lru_prev;
+  jfs_meta_node_t  *lru_next;
 };
 
-static jfs_meta_cache_t *hashtable[JFS_META_CACHE_SIZE];
+/*
+  Paths are spread over stripes, each with its own lock, chained
+  table and LRU list. The least recently used paths are evicted
+  once a stripe holds more than its share of the budget.
+ */
+typedef struct jfs_meta_stripe jfs_meta_stripe_t;
+struct jfs_meta_stripe {
+  pthread_mutex_t   lock;
+
+  jfs_meta_node_t **buckets;
+  size_t            num_buckets;
+  size_t            num_nodes;
+  size_t            bytes;
+
+  jfs_meta_node_t   lru;
+
+  unsigned long     generation;
+  unsigned long     hits;
+  unsigned long     negative_hits;
+  unsigned long     misses;
+  unsigned long     evictions;
+} __attribute__((aligned(64)));
 
-#define JFS_META_CACHE_T_CMP(e1, e2) (!((strcmp(e1->path, e2->path) == 0) && ((e1->keyid - e2->keyid) == 0)))
+static jfs_meta_stripe_t stripes[JFS_META_CACHE_STRIPES];
+static size_t stripe_budget;
 
+/*
+  FNV-1a over the path.
+ */
 static unsigned int
-jfs_meta_cache_t_hash(jfs_meta_cache_t *item)
+jfs_meta_cache_hash(const char *path)
 {
   unsigned int hash;
+  const unsigned char *c;
+
+  hash = 2166136261u;
+  for(c = (const unsigned char *)path; *c; ++c) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static jfs_meta_stripe_t *
+jfs_meta_cache_stripe(unsigned int hash)
+{
+  return &stripes[hash % JFS_META_CACHE_STRIPES];
+}
+
+static size_t
+jfs_meta_cache_bucket(jfs_meta_stripe_t *stripe, unsigned int hash)
+{
+  return (hash / JFS_META_CACHE_STRIPES) & (stripe->num_buckets - 1);
+}
+
+static size_t
+jfs_meta_attr_cost(jfs_meta_attr_t *attr)
+{
+  return sizeof(*attr) + (attr->value ? strlen(attr->value) + 1 : 0);
+}
+
+static void
+jfs_meta_lru_unlink(jfs_meta_node_t *node)
+{
+  node->lru_prev->lru_next = node->lru_next;
+  node->lru_next->lru_prev = node->lru_prev;
+}
+
+static void
+jfs_meta_lru_push(jfs_meta_stripe_t *stripe, jfs_meta_node_t *node)
+{
+  node->lru_next = stripe->lru.lru_next;
+  node->lru_prev = &stripe->lru;
+  stripe->lru.lru_next->lru_prev = node;
+  stripe->lru.lru_next = node;
+}
+
+/*
+  HOLD THE STRIPE LOCK
+ */
+static jfs_meta_node_t *
+jfs_meta_cache_find(jfs_meta_stripe_t *stripe, const char *path, unsigned int hash)
+{
+  jfs_meta_node_t *node;
 
-  hash = (strlen(item->path) + item->keyid) % JFS_META_CACHE_SIZE;
+  if(!stripe->num_buckets) {
+    return NULL;
+  }
+
+  for(node = stripe->buckets[jfs_meta_cache_bucket(stripe, hash)]; 
+      node != NULL; node = node->next) {
+    if(node->hash == hash && !strcmp(node->path, path)) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+static jfs_meta_attr_t **
+jfs_meta_attr_find(jfs_meta_node_t *node, int keyid)
+{
+  jfs_meta_attr_t **attr;
+
+  for(attr = &node->attrs; *attr != NULL; attr = &(*attr)->next) {
+    if((*attr)->keyid == keyid) {
+      return attr;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+jfs_meta_node_free(jfs_meta_node_t *node)
+{
+  jfs_meta_attr_t *attr;
 
-  return hash;  
+  while(node->attrs) {
+    attr = node->attrs;
+    node->attrs = attr->next;
+
+    free(attr->value);
+    free(attr);
+  }
+  free(node->path);
+  free(node);
 }
 
 /*
- * SGLIB generator macros for jfs_meta_cache_t lists.
+  HOLD THE STRIPE LOCK
+
+  Unlink a node from its bucket and the LRU list, and free it.
  */
-SGLIB_DEFINE_LIST_PROTOTYPES(jfs_meta_cache_t, JFS_META_CACHE_T_CMP, next)
-SGLIB_DEFINE_LIST_FUNCTIONS(jfs_meta_cache_t, JFS_META_CACHE_T_CMP, next)
+static void
+jfs_meta_cache_delete(jfs_meta_stripe_t *stripe, jfs_meta_node_t *node)
+{
+  jfs_meta_node_t **prev;
+
+  prev = &stripe->buckets[jfs_meta_cache_bucket(stripe, node->hash)];
+  while(*prev != node) {
+    prev = &(*prev)->next;
+  }
+  *prev = node->next;
+
+  jfs_meta_lru_unlink(node);
+  --stripe->num_nodes;
+  stripe->bytes -= node->bytes;
+
+  jfs_meta_node_free(node);
+}
 
 /*
- * SGLIB generator macros for hashtable function prototypes.
+  HOLD THE STRIPE LOCK
+
+  Double the bucket array, allocating it on first use.
  */
-SGLIB_DEFINE_HASHED_CONTAINER_PROTOTYPES(jfs_meta_cache_t, JFS_META_CACHE_SIZE,
-                                         jfs_meta_cache_t_hash)
-SGLIB_DEFINE_HASHED_CONTAINER_FUNCTIONS(jfs_meta_cache_t, JFS_META_CACHE_SIZE,
-                                        jfs_meta_cache_t_hash)
+static int
+jfs_meta_cache_grow(jfs_meta_stripe_t *stripe)
+{
+  jfs_meta_node_t **old;
+  jfs_meta_node_t  *node;
+  jfs_meta_node_t  *next;
+
+  size_t old_buckets;
+  size_t bucket;
+  size_t i;
+
+  old = stripe->buckets;
+  old_buckets = stripe->num_buckets;
+  stripe->num_buckets = old_buckets ? old_buckets * 2 : JFS_META_CACHE_BUCKETS_MIN;
+
+  stripe->buckets = calloc(stripe->num_buckets, sizeof(*stripe->buckets));
+  if(!stripe->buckets) {
+    stripe->buckets = old;
+    stripe->num_buckets = old_buckets;
+
+    return -ENOMEM;
+  }
 
-static pthread_rwlock_t cache_lock;
+  for(i = 0; i < old_buckets; ++i) {
+    for(node = old[i]; node != NULL; node = next) {
+      next = node->next;
+
+      bucket = jfs_meta_cache_bucket(stripe, node->hash);
+      node->next = stripe->buckets[bucket];
+      stripe->buckets[bucket] = node;
+    }
+  }
+  free(old);
+
+  return 0;
+}
+
+/*
+  HOLD THE STRIPE LOCK
+
+  Evict least recently used paths until the stripe fits its
+  budget. The most recent path is always kept.
+ */
+static void
+jfs_meta_cache_evict(jfs_meta_stripe_t *stripe)
+{
+  while(stripe->bytes > stripe_budget && stripe->num_nodes > 1) {
+    jfs_meta_cache_delete(stripe, stripe->lru.lru_prev);
+    ++stripe->evictions;
+  }
+}
 
 void
 jfs_meta_cache_init()
 {
-  pthread_rwlock_init(&cache_lock, NULL);
-  sglib_hashed_jfs_meta_cache_t_init(hashtable);
+  jfs_meta_stripe_t *stripe;
+
+  int i;
+
+  stripe_budget = (size_t)joinfs_context.meta_cache_kb * 1024 / JFS_META_CACHE_STRIPES;
+
+  for(i = 0; i < JFS_META_CACHE_STRIPES; ++i) {
+    stripe = &stripes[i];
+
+    pthread_mutex_init(&stripe->lock, NULL);
+    stripe->buckets = NULL;
+    stripe->num_buckets = 0;
+    stripe->num_nodes = 0;
+    stripe->bytes = 0;
+    stripe->lru.lru_next = &stripe->lru;
+    stripe->lru.lru_prev = &stripe->lru;
+    stripe->generation = 0;
+    stripe->hits = 0;
+    stripe->negative_hits = 0;
+    stripe->misses = 0;
+    stripe->evictions = 0;
+  }
 }
 
 void
 jfs_meta_cache_destroy()
 {
-  struct sglib_hashed_jfs_meta_cache_t_iterator it;
-  jfs_meta_cache_t *item;
+  jfs_meta_stripe_t *stripe;
+
+  int i;
+
+  for(i = 0; i < JFS_META_CACHE_STRIPES; ++i) {
+    stripe = &stripes[i];
 
-  pthread_rwlock_wrlock(&cache_lock);
-  for(item = sglib_hashed_jfs_meta_cache_t_it_init(&it, hashtable);
-      item != NULL; item = sglib_hashed_jfs_meta_cache_t_it_next(&it)) {
-    free(item->path);
-    free(item->value);
-    free(item);
+    pthread_mutex_lock(&stripe->lock);
+    while(stripe->num_nodes) {
+      jfs_meta_cache_delete(stripe, stripe->lru.lru_next);
+    }
+    free(stripe->buckets);
+    stripe->buckets = NULL;
+    stripe->num_buckets = 0;
+    pthread_mutex_unlock(&stripe->lock);
+
+    pthread_mutex_destroy(&stripe->lock);
+  }
+}
+
+void
+jfs_meta_cache_get_stats(struct jfs_meta_cache_stats *stats)
+{
+  jfs_meta_stripe_t *stripe;
+
+  int i;
+
+  memset(stats, 0, sizeof(*stats));
+  for(i = 0; i < JFS_META_CACHE_STRIPES; ++i) {
+    stripe = &stripes[i];
+
+    pthread_mutex_lock(&stripe->lock);
+    stats->hits += stripe->hits;
+    stats->negative_hits += stripe->negative_hits;
+    stats->misses += stripe->misses;
+    stats->evictions += stripe->evictions;
+    stats->paths += stripe->num_nodes;
+    stats->bytes += stripe->bytes;
+    pthread_mutex_unlock(&stripe->lock);
   }
+}
+
+unsigned long
+jfs_meta_cache_generation(const char *path)
+{
+  jfs_meta_stripe_t *stripe;
+
+  unsigned long generation;
 
-  pthread_rwlock_unlock(&cache_lock);
-  pthread_rwlock_destroy(&cache_lock);
+  stripe = jfs_meta_cache_stripe(jfs_meta_cache_hash(path));
+
+  pthread_mutex_lock(&stripe->lock);
+  generation = stripe->generation;
+  pthread_mutex_unlock(&stripe->lock);
+
+  return generation;
 }
 
 int
 jfs_meta_cache_get_value(const char *path, int keyid, char **value)
 {
-  jfs_meta_cache_t  check;
-  jfs_meta_cache_t *result;
+  jfs_meta_stripe_t *stripe;
+  jfs_meta_node_t   *node;
+  jfs_meta_attr_t  **attr;
+
+  unsigned int hash;
 
   char *val;
 
-  size_t val_len;
-  size_t path_len;
+  hash = jfs_meta_cache_hash(path);
+  stripe = jfs_meta_cache_stripe(hash);
 
-  check.keyid = keyid;
+  pthread_mutex_lock(&stripe->lock);
+  node = jfs_meta_cache_find(stripe, path, hash);
+  attr = node ? jfs_meta_attr_find(node, keyid) : NULL;
 
-  path_len = strlen(path) + 1;
-  check.path = malloc(sizeof(*check.path) * path_len);
-  if(!check.path) {
-    return -ENOMEM;
+  if(!attr) {
+    ++stripe->misses;
+    pthread_mutex_unlock(&stripe->lock);
+
+    return -ENOENT;
   }
-  strncpy(check.path, path, path_len);
 
-  pthread_rwlock_rdlock(&cache_lock);
-  result = sglib_hashed_jfs_meta_cache_t_find_member(hashtable, &check);
-  free(check.path);
-  
-  if(!result) {
-    pthread_rwlock_unlock(&cache_lock);
-    
-	return -ENOATTR;
+  jfs_meta_lru_unlink(node);
+  jfs_meta_lru_push(stripe, node);
+
+  if(!(*attr)->value) {
+    ++stripe->negative_hits;
+    pthread_mutex_unlock(&stripe->lock);
+
+    return -ENOATTR;
   }
+  ++stripe->hits;
 
-  val_len = strlen(result->value) + 1;
-  val = malloc(sizeof(*val) * val_len);
-  if(!val) {
-    free(val);
-    pthread_rwlock_unlock(&cache_lock);
+  val = strdup((*attr)->value);
+  pthread_mutex_unlock(&stripe->lock);
 
+  if(!val) {
     return -ENOMEM;
   }
-  strncpy(val, result->value, val_len);
-  pthread_rwlock_unlock(&cache_lock);
-
   *value = val;
 
   return 0;
 }
 
-int
-jfs_meta_cache_add(const char *path, int keyid, const char *value)
+/*
+  Store value, or a negative entry when value is NULL. Fills from the
+  database are dropped if the stripe was written since generation,
+  everything else starts a new generation.
+ */
+static int
+jfs_meta_cache_store(const char *path, int keyid, const char *value, 
+                     int fill, unsigned long generation)
 {
-  jfs_meta_cache_t *item;
-  
-  size_t val_len;
-  size_t path_len;
+  jfs_meta_stripe_t *stripe;
+  jfs_meta_node_t   *node;
+  jfs_meta_attr_t  **found;
+  jfs_meta_attr_t   *attr;
 
-  jfs_meta_cache_remove(path, keyid);
+  unsigned int hash;
 
-  item = malloc(sizeof(*item));
-  if(!item) {
-	return -ENOMEM;
-  }
+  int rc;
 
-  path_len = strlen(path) + 1;
-  item->path = malloc(sizeof(*item->path) * path_len);
-  if(!item->path) {
-    free(item);
+  attr = malloc(sizeof(*attr));
+  if(!attr) {
     return -ENOMEM;
   }
-  strncpy(item->path, path, path_len);
+  attr->keyid = keyid;
+  attr->value = NULL;
+  attr->next = NULL;
 
-  val_len = strlen(value) + 1;
-  item->value = malloc(sizeof(*item->value) * val_len);
-  if(!item->value) {
-    free(item);
-    free(item->path);
-    return -ENOMEM;
+  if(value) {
+    attr->value = strdup(value);
+    if(!attr->value) {
+      free(attr);
+
+      return -ENOMEM;
+    }
+  }
+
+  hash = jfs_meta_cache_hash(path);
+  stripe = jfs_meta_cache_stripe(hash);
+
+  pthread_mutex_lock(&stripe->lock);
+  if(fill) {
+    //a write landed while the value was being read
+    if(stripe->generation != generation) {
+      pthread_mutex_unlock(&stripe->lock);
+      free(attr->value);
+      free(attr);
+
+      return 0;
+    }
+  }
+  else {
+    ++stripe->generation;
+  }
+
+  found = NULL;
+  node = jfs_meta_cache_find(stripe, path, hash);
+  if(!node) {
+    if(stripe->num_nodes + 1 > stripe->num_buckets) {
+      rc = jfs_meta_cache_grow(stripe);
+      if(rc) {
+        pthread_mutex_unlock(&stripe->lock);
+        free(attr->value);
+        free(attr);
+
+        return rc;
+      }
+    }
+
+    node = calloc(1, sizeof(*node));
+    if(node) {
+      node->path = strdup(path);
+    }
+    if(!node || !node->path) {
+      pthread_mutex_unlock(&stripe->lock);
+      free(node);
+      free(attr->value);
+      free(attr);
+
+      return -ENOMEM;
+    }
+    node->hash = hash;
+    node->bytes = sizeof(*node) + strlen(path) + 1;
+
+    node->next = stripe->buckets[jfs_meta_cache_bucket(stripe, hash)];
+    stripe->buckets[jfs_meta_cache_bucket(stripe, hash)] = node;
+    jfs_meta_lru_push(stripe, node);
+
+    ++stripe->num_nodes;
+    stripe->bytes += node->bytes;
+  }
+  else {
+    jfs_meta_lru_unlink(node);
+    jfs_meta_lru_push(stripe, node);
+
+    found = jfs_meta_attr_find(node, keyid);
+  }
+
+  //replace the value in place, or link in the new key
+  if(found) {
+    node->bytes -= jfs_meta_attr_cost(*found);
+    stripe->bytes -= jfs_meta_attr_cost(*found);
+
+    free((*found)->value);
+    (*found)->value = attr->value;
+    free(attr);
+
+    attr = *found;
   }
-  strncpy(item->value, value, val_len);
-  item->keyid = keyid;
+  else {
+    attr->next = node->attrs;
+    node->attrs = attr;
+  }
+  node->bytes += jfs_meta_attr_cost(attr);
+  stripe->bytes += jfs_meta_attr_cost(attr);
 
-  pthread_rwlock_wrlock(&cache_lock);
-  sglib_hashed_jfs_meta_cache_t_add(hashtable, item);
-  pthread_rwlock_unlock(&cache_lock);
+  jfs_meta_cache_evict(stripe);
+  pthread_mutex_unlock(&stripe->lock);
 
   return 0;
 }
 
+int
+jfs_meta_cache_add(const char *path, int keyid, const char *value)
+{
+  return jfs_meta_cache_store(path, keyid, value, 0, 0);
+}
+
+int
+jfs_meta_cache_fill(const char *path, int keyid, const char *value,
+                    unsigned long generation)
+{
+  return jfs_meta_cache_store(path, keyid, value, 1, generation);
+}
+
 int
 jfs_meta_cache_remove(const char *path, int keyid)
 {
-  jfs_meta_cache_t check;
-  jfs_meta_cache_t *elem;
+  jfs_meta_stripe_t *stripe;
+  jfs_meta_node_t   *node;
+  jfs_meta_attr_t  **found;
+  jfs_meta_attr_t   *attr;
 
-  size_t path_len;
+  unsigned int hash;
 
-  int rc;
-  
-  check.keyid = keyid;
+  hash = jfs_meta_cache_hash(path);
+  stripe = jfs_meta_cache_stripe(hash);
 
-  path_len = strlen(path) + 1;
-  check.path = malloc(sizeof(*check.path) * path_len);
-  if(!check.path) {
-    return -ENOMEM;
-  }
-  strncpy(check.path, path, path_len);
+  pthread_mutex_lock(&stripe->lock);
+  ++stripe->generation;
 
-  pthread_rwlock_wrlock(&cache_lock);
-  rc = sglib_hashed_jfs_meta_cache_t_delete_if_member(hashtable, &check, &elem);
-  pthread_rwlock_unlock(&cache_lock);
-  free(check.path);
+  node = jfs_meta_cache_find(stripe, path, hash);
+  found = node ? jfs_meta_attr_find(node, keyid) : NULL;
 
-  if(rc) {
-    free(elem->path);
-	free(elem->value);
-    free(elem);
+  if(found) {
+    attr = *found;
+    *found = attr->next;
+
+    node->bytes -= jfs_meta_attr_cost(attr);
+    stripe->bytes -= jfs_meta_attr_cost(attr);
+
+    free(attr->value);
+    free(attr);
+
+    if(!node->attrs) {
+      jfs_meta_cache_delete(stripe, node);
+    }
   }
+  pthread_mutex_unlock(&stripe->lock);
   
   return 0;
 }
+
+int
+jfs_meta_cache_remove_path(const char *path)
+{
+  jfs_meta_stripe_t *stripe;
+  jfs_meta_node_t   *node;
+
+  unsigned int hash;
+
+  hash = jfs_meta_cache_hash(path);
+  stripe = jfs_meta_cache_stripe(hash);
+
+  pthread_mutex_lock(&stripe->lock);
+  ++stripe->generation;
+
+  node = jfs_meta_cache_find(stripe, path, hash);
+  if(node) {
+    jfs_meta_cache_delete(stripe, node);
+  }
+  pthread_mutex_unlock(&stripe->lock);
+
+  return 0;
+}
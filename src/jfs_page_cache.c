@@ -0,0 +1,149 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_page_cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define JFS_PAGE_CACHE_SIZE    4096
+#define JFS_PAGE_CACHE_STRIPES 16
+
+/*
+  The version of a backing file when a node's pages were last cached.
+  Slots are direct mapped by node, losing one only costs a reread.
+ */
+struct jfs_page_version {
+  unsigned long long node;
+  dev_t           dev;
+  ino_t           ino;
+  off_t           size;
+  struct timespec mtime;
+};
+
+static struct jfs_page_version versions[JFS_PAGE_CACHE_SIZE];
+static pthread_mutex_t stripe_locks[JFS_PAGE_CACHE_STRIPES];
+
+static size_t
+jfs_page_cache_slot(unsigned long long node)
+{
+  node *= 0x9e3779b97f4a7c15ULL;
+
+  return (node >> 32) % JFS_PAGE_CACHE_SIZE;
+}
+
+static pthread_mutex_t *
+jfs_page_cache_lock(size_t slot)
+{
+  return &stripe_locks[slot % JFS_PAGE_CACHE_STRIPES];
+}
+
+static void
+jfs_page_cache_store(struct jfs_page_version *version, unsigned long long node,
+                     const struct stat *st)
+{
+  version->node = node;
+  version->dev = st->st_dev;
+  version->ino = st->st_ino;
+  version->size = st->st_size;
+  version->mtime = st->st_mtim;
+}
+
+int
+jfs_page_cache_init(void)
+{
+  int i;
+
+  memset(versions, 0, sizeof(versions));
+  for(i = 0; i < JFS_PAGE_CACHE_STRIPES; ++i) {
+    pthread_mutex_init(&stripe_locks[i], NULL);
+  }
+
+  return 0;
+}
+
+void
+jfs_page_cache_destroy(void)
+{
+  int i;
+
+  for(i = 0; i < JFS_PAGE_CACHE_STRIPES; ++i) {
+    pthread_mutex_destroy(&stripe_locks[i]);
+  }
+}
+
+unsigned long long
+jfs_page_cache_node(const char *path)
+{
+  unsigned long long hash;
+  const char *c;
+
+  //64 bit FNV-1a, node keys of distinct paths must not meet
+  hash = 0xcbf29ce484222325ULL;
+  for(c = path; *c; ++c) {
+    hash ^= (unsigned char)*c;
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+int
+jfs_page_cache_keep(unsigned long long node, const struct stat *st)
+{
+  struct jfs_page_version *version;
+  pthread_mutex_t *lock;
+  
+  size_t slot;
+  int keep;
+
+  slot = jfs_page_cache_slot(node);
+  version = &versions[slot];
+  lock = jfs_page_cache_lock(slot);
+
+  pthread_mutex_lock(lock);
+  keep = version->node == node
+    && version->ino == st->st_ino && version->dev == st->st_dev
+    && version->size == st->st_size
+    && version->mtime.tv_sec == st->st_mtim.tv_sec
+    && version->mtime.tv_nsec == st->st_mtim.tv_nsec;
+
+  jfs_page_cache_store(version, node, st);
+  pthread_mutex_unlock(lock);
+
+  return keep;
+}
+
+void
+jfs_page_cache_update(unsigned long long node, const struct stat *st)
+{
+  size_t slot;
+
+  slot = jfs_page_cache_slot(node);
+
+  pthread_mutex_lock(jfs_page_cache_lock(slot));
+  jfs_page_cache_store(&versions[slot], node, st);
+  pthread_mutex_unlock(jfs_page_cache_lock(slot));
+}
@@ -0,0 +1,532 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "error_log.h"
+#include "jfs_pending.h"
+#include "jfs_query_cache.h"
+#include "sqlitedb.h"
+#include "joinfs.h"
+#include "sglib.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <attr/xattr.h>
+#include <pthread.h>
+
+#define JFS_PENDING_SIZE 1024
+
+/*
+ * A queued write. The write owns the values bound to its
+ * db op, metadata writes are also kept in the hashtable
+ * until they commit. Every write is on the in flight list
+ * in queue order until it finishes.
+ */
+typedef struct jfs_pending jfs_pending_t;
+struct jfs_pending {
+  int            keyid;
+  char          *path;
+  char          *value;
+  size_t         size;
+
+  int            in_table;
+  unsigned long  seq;
+
+  jfs_pending_t *next;
+  jfs_pending_t *queue_prev;
+  jfs_pending_t *queue_next;
+};
+
+/*
+ * A path with a queued write that failed, kept until
+ * a flush covering the path reports it.
+ */
+struct jfs_pending_error {
+  char                     *path;
+  struct jfs_pending_error *next;
+};
+
+static jfs_pending_t *hashtable[JFS_PENDING_SIZE];
+
+#define JFS_PENDING_T_CMP(e1, e2) (jfs_pending_t_cmp(e1, e2))
+
+/*
+ * Order writes by path, then by keyid.
+ */
+static int
+jfs_pending_t_cmp(jfs_pending_t *e1, jfs_pending_t *e2)
+{
+  int rc;
+
+  rc = strcmp(e1->path, e2->path);
+  if(rc) {
+    return rc;
+  }
+
+  return e1->keyid - e2->keyid;
+}
+
+static unsigned int
+jfs_pending_t_hash(jfs_pending_t *item)
+{
+  unsigned int hash;
+  const char *c;
+
+  hash = 5381;
+  for(c = item->path; *c; ++c) {
+    hash = ((hash << 5) + hash) + *c;
+  }
+
+  return (hash + item->keyid) % JFS_PENDING_SIZE;
+}
+
+/*
+ * SGLIB generator macros for jfs_pending_t lists.
+ */
+SGLIB_DEFINE_LIST_PROTOTYPES(jfs_pending_t, JFS_PENDING_T_CMP, next)
+SGLIB_DEFINE_LIST_FUNCTIONS(jfs_pending_t, JFS_PENDING_T_CMP, next)
+
+/*
+ * SGLIB generator macros for hashtable function prototypes.
+ */
+SGLIB_DEFINE_HASHED_CONTAINER_PROTOTYPES(jfs_pending_t, JFS_PENDING_SIZE,
+                                         jfs_pending_t_hash)
+SGLIB_DEFINE_HASHED_CONTAINER_FUNCTIONS(jfs_pending_t, JFS_PENDING_SIZE,
+                                        jfs_pending_t_hash)
+
+static pthread_mutex_t pending_lock;
+static pthread_cond_t pending_cv;
+
+static jfs_pending_t *queue_head;
+static jfs_pending_t *queue_tail;
+static unsigned long queue_seq;
+
+static struct jfs_pending_error *pending_errors;
+
+static unsigned long commit_count;
+static unsigned long synced_count;
+
+static void jfs_pending_done(struct jfs_db_op *db_op);
+static void jfs_pending_free(jfs_pending_t *item);
+static void jfs_pending_add_error(jfs_pending_t *item);
+static void jfs_pending_wait_seq(unsigned long seq);
+static int jfs_pending_sync_file(const char *path);
+
+void
+jfs_pending_init(void)
+{
+  pthread_mutex_init(&pending_lock, NULL);
+  pthread_cond_init(&pending_cv, NULL);
+  sglib_hashed_jfs_pending_t_init(hashtable);
+
+  queue_head = NULL;
+  queue_tail = NULL;
+  queue_seq = 0;
+  pending_errors = NULL;
+  commit_count = 0;
+  synced_count = 0;
+}
+
+void
+jfs_pending_destroy(void)
+{
+  struct jfs_pending_error *error;
+
+  jfs_pending_wait();
+
+  while(pending_errors) {
+    error = pending_errors;
+    pending_errors = error->next;
+    free(error->path);
+    free(error);
+  }
+
+  pthread_cond_destroy(&pending_cv);
+  pthread_mutex_destroy(&pending_lock);
+}
+
+/*
+ * Queue a write, the op is destroyed by jfs_pending_done.
+ */
+static int
+jfs_pending_queue(struct jfs_db_op *db_op, jfs_pending_t *item)
+{
+  jfs_pending_t *old;
+
+  int rc;
+
+  db_op->callback = jfs_pending_done;
+  db_op->callback_arg = item;
+
+  pthread_mutex_lock(&pending_lock);
+  if(item->keyid) {
+    //the newest write for a path and key is the visible one
+    if(sglib_hashed_jfs_pending_t_delete_if_member(hashtable, item, &old)) {
+      old->in_table = 0;
+    }
+    sglib_hashed_jfs_pending_t_add(hashtable, item);
+    item->in_table = 1;
+  }
+
+  item->seq = ++queue_seq;
+  item->queue_next = NULL;
+  item->queue_prev = queue_tail;
+  if(queue_tail) {
+    queue_tail->queue_next = item;
+  }
+  else {
+    queue_head = item;
+  }
+  queue_tail = item;
+  pthread_mutex_unlock(&pending_lock);
+
+  rc = jfs_write_pool_queue(db_op);
+  if(rc) {
+    db_op->rc = -ENOMEM;
+    jfs_pending_done(db_op);
+
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+/*
+ * Called by the write pool when a queued write finishes.
+ */
+static void
+jfs_pending_done(struct jfs_db_op *db_op)
+{
+  jfs_pending_t *item;
+  jfs_pending_t *elem;
+
+  item = db_op->callback_arg;
+
+  pthread_mutex_lock(&pending_lock);
+  if(item->in_table) {
+    sglib_hashed_jfs_pending_t_delete_if_member(hashtable, item, &elem);
+  }
+
+  if(db_op->rc) {
+    log_error("Queued write failed for path:%s, keyid:%d, error:%d\n", 
+              item->path, item->keyid, db_op->rc);
+    jfs_pending_add_error(item);
+  }
+  else {
+    ++commit_count;
+  }
+
+  pthread_mutex_unlock(&pending_lock);
+
+  //folders reading the key must see the committed write
+  if(item->keyid) {
+    jfs_query_cache_invalidate_key(item->keyid);
+  }
+
+  pthread_mutex_lock(&pending_lock);
+  if(item->queue_prev) {
+    item->queue_prev->queue_next = item->queue_next;
+  }
+  else {
+    queue_head = item->queue_next;
+    pthread_cond_broadcast(&pending_cv);
+  }
+  if(item->queue_next) {
+    item->queue_next->queue_prev = item->queue_prev;
+  }
+  else {
+    queue_tail = item->queue_prev;
+  }
+  pthread_mutex_unlock(&pending_lock);
+
+  db_op->rc = 1;
+  jfs_db_op_destroy(db_op);
+  jfs_pending_free(item);
+}
+
+/*
+ * Remember a failed write's path, the pending lock must be held.
+ */
+static void
+jfs_pending_add_error(jfs_pending_t *item)
+{
+  struct jfs_pending_error *error;
+
+  for(error = pending_errors; error; error = error->next) {
+    if(strcmp(error->path, item->path) == 0) {
+      return;
+    }
+  }
+
+  error = malloc(sizeof(*error));
+  if(!error) {
+    return;
+  }
+
+  //the path moves to the error, the write is freed after this
+  error->path = item->path;
+  item->path = NULL;
+  error->next = pending_errors;
+  pending_errors = error;
+}
+
+static void
+jfs_pending_free(jfs_pending_t *item)
+{
+  free(item->path);
+  free(item->value);
+  free(item);
+}
+
+/*
+ * Allocate a write holding copies of the path and value.
+ */
+static jfs_pending_t *
+jfs_pending_alloc(const char *path, int keyid, const char *value, size_t size)
+{
+  jfs_pending_t *item;
+
+  item = malloc(sizeof(*item));
+  if(!item) {
+    return NULL;
+  }
+  item->keyid = keyid;
+  item->size = size;
+  item->in_table = 0;
+  item->value = NULL;
+
+  item->path = strdup(path);
+  if(!item->path) {
+    free(item);
+    return NULL;
+  }
+
+  if(value) {
+    item->value = malloc(sizeof(*item->value) * (size + 1));
+    if(!item->value) {
+      jfs_pending_free(item);
+      return NULL;
+    }
+    memcpy(item->value, value, size);
+    item->value[size] = '\0';
+  }
+
+  return item;
+}
+
+int
+jfs_pending_link_add(int inode, const char *path, const char *filename)
+{
+  struct jfs_db_op *db_op;
+  jfs_pending_t *item;
+
+  int rc;
+
+  //the filename is the tail of the path, it is stored as the value
+  item = jfs_pending_alloc(path, 0, filename, strlen(filename));
+  if(!item) {
+    return -ENOMEM;
+  }
+
+  rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_link_insert_stmt);
+  if(rc) {
+    jfs_pending_free(item);
+    return rc;
+  }
+  jfs_db_op_bind_int(db_op, inode);
+  jfs_db_op_bind_text(db_op, item->path);
+  jfs_db_op_bind_text(db_op, item->value);
+
+  return jfs_pending_queue(db_op, item);
+}
+
+int
+jfs_pending_meta_write(enum jfs_db_stmts stmt_id, const char *path, int keyid,
+                       const char *value, size_t size)
+{
+  struct jfs_db_op *db_op;
+  jfs_pending_t *item;
+
+  int rc;
+
+  item = jfs_pending_alloc(path, keyid, value, size);
+  if(!item) {
+    return -ENOMEM;
+  }
+
+  rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, stmt_id);
+  if(rc) {
+    jfs_pending_free(item);
+    return rc;
+  }
+  jfs_db_op_bind_text(db_op, item->path);
+  jfs_db_op_bind_int(db_op, keyid);
+  if(value) {
+    jfs_db_op_bind_text_len(db_op, item->value, size);
+  }
+
+  return jfs_pending_queue(db_op, item);
+}
+
+int
+jfs_pending_meta_get(const char *path, int keyid, char **value)
+{
+  jfs_pending_t check;
+  jfs_pending_t *result;
+
+  char *val;
+
+  pthread_mutex_lock(&pending_lock);
+  if(!queue_head) {
+    pthread_mutex_unlock(&pending_lock);
+    return -ENOENT;
+  }
+
+  check.path = (char *)path;
+  check.keyid = keyid;
+  result = sglib_hashed_jfs_pending_t_find_member(hashtable, &check);
+  if(!result) {
+    pthread_mutex_unlock(&pending_lock);
+    return -ENOENT;
+  }
+
+  if(!result->value) {
+    pthread_mutex_unlock(&pending_lock);
+    return -ENOATTR;
+  }
+
+  val = strdup(result->value);
+  pthread_mutex_unlock(&pending_lock);
+  if(!val) {
+    return -ENOMEM;
+  }
+  *value = val;
+
+  return 0;
+}
+
+/*
+ * Wait for the writes queued up to seq, the pending lock
+ * must be held. Writes queued later do not hold up the wait.
+ */
+static void
+jfs_pending_wait_seq(unsigned long seq)
+{
+  while(queue_head && queue_head->seq <= seq) {
+    pthread_cond_wait(&pending_cv, &pending_lock);
+  }
+}
+
+void
+jfs_pending_wait(void)
+{
+  pthread_mutex_lock(&pending_lock);
+  jfs_pending_wait_seq(queue_seq);
+  pthread_mutex_unlock(&pending_lock);
+}
+
+int
+jfs_pending_flush(const char *path)
+{
+  struct jfs_pending_error **prev;
+  struct jfs_pending_error *error;
+
+  char wal_path[PATH_MAX];
+
+  unsigned long commits;
+  int dirty;
+  int sync_rc;
+  int rc;
+
+  rc = 0;
+
+  pthread_mutex_lock(&pending_lock);
+  jfs_pending_wait_seq(queue_seq);
+
+  prev = &pending_errors;
+  while(*prev) {
+    error = *prev;
+    if(!path || strcmp(error->path, path) == 0) {
+      *prev = error->next;
+      free(error->path);
+      free(error);
+      rc = -EIO;
+    }
+    else {
+      prev = &error->next;
+    }
+  }
+  commits = commit_count;
+  dirty = commits != synced_count;
+  pthread_mutex_unlock(&pending_lock);
+
+  //commits are not synced, push them to disk
+  if(dirty) {
+    if(joinfs_context.wal) {
+      snprintf(wal_path, sizeof(wal_path), "%s-wal", joinfs_context.dbpath);
+      sync_rc = jfs_pending_sync_file(wal_path);
+      if(sync_rc && sync_rc != -ENOENT) {
+        return sync_rc;
+      }
+    }
+
+    sync_rc = jfs_pending_sync_file(joinfs_context.dbpath);
+    if(sync_rc) {
+      return sync_rc;
+    }
+
+    //a racing flush may have synced a later count already
+    pthread_mutex_lock(&pending_lock);
+    if((long)(commits - synced_count) > 0) {
+      synced_count = commits;
+    }
+    pthread_mutex_unlock(&pending_lock);
+  }
+
+  return rc;
+}
+
+static int
+jfs_pending_sync_file(const char *path)
+{
+  int fd;
+  int rc;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return -errno;
+  }
+
+  rc = 0;
+  if(fsync(fd)) {
+    rc = -errno;
+  }
+  close(fd);
+
+  return rc;
+}
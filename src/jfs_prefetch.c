@@ -0,0 +1,140 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_prefetch.h"
+#include "jfs_handle.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define JFS_PREFETCH_MIN     (128 * 1024)
+
+/*
+  The stream of one file handle. Everything below ahead
+  has been asked for already.
+ */
+struct jfs_prefetch_stream {
+  struct jfs_handle handle;
+  off_t             next_offset;
+  off_t             ahead;
+  size_t            window;
+};
+
+static struct jfs_handle_table streams;
+static size_t window_min;
+static size_t window_max;
+
+int
+jfs_prefetch_init(size_t max_window)
+{
+  jfs_handle_table_init(&streams);
+  window_max = max_window;
+  window_min = max_window < JFS_PREFETCH_MIN ? max_window : JFS_PREFETCH_MIN;
+
+  return 0;
+}
+
+void
+jfs_prefetch_destroy(void)
+{
+  jfs_handle_table_destroy(&streams);
+}
+
+void
+jfs_prefetch_read(int fd, off_t offset, size_t size)
+{
+  struct jfs_prefetch_stream *stream;
+  pthread_mutex_t *lock;
+
+  off_t advise_offset;
+  off_t advise_len;
+  off_t end;
+
+  if(!window_max) {
+    return;
+  }
+
+  end = offset + size;
+  advise_len = 0;
+  advise_offset = 0;
+  lock = jfs_handle_lock(&streams, fd);
+
+  pthread_mutex_lock(lock);
+  stream = (struct jfs_prefetch_stream *)jfs_handle_find(&streams, fd);
+
+  //the first read of a handle only starts watching
+  if(!stream) {
+    stream = malloc(sizeof(*stream));
+    if(stream) {
+      stream->handle.fd = fd;
+      stream->next_offset = end;
+      stream->ahead = end;
+      stream->window = window_min;
+      jfs_handle_insert(&streams, &stream->handle);
+    }
+    pthread_mutex_unlock(lock);
+    return;
+  }
+
+  if(offset != stream->next_offset) {
+    //a seek ends the stream
+    stream->window = window_min;
+    stream->ahead = end;
+  }
+  else if(end + (off_t)stream->window / 2 > stream->ahead) {
+    //the reader is halfway into the window, ask for the next one
+    if(stream->ahead < end) {
+      stream->ahead = end;
+    }
+    advise_offset = stream->ahead;
+    advise_len = stream->window;
+
+    stream->ahead += stream->window;
+    if(stream->window < window_max) {
+      stream->window *= 2;
+      if(stream->window > window_max) {
+        stream->window = window_max;
+      }
+    }
+  }
+  stream->next_offset = end;
+  pthread_mutex_unlock(lock);
+
+  if(advise_len) {
+    posix_fadvise(fd, advise_offset, advise_len, POSIX_FADV_WILLNEED);
+  }
+}
+
+void
+jfs_prefetch_release(int fd)
+{
+  pthread_mutex_t *lock;
+
+  lock = jfs_handle_lock(&streams, fd);
+
+  pthread_mutex_lock(lock);
+  free(jfs_handle_remove(&streams, fd));
+  pthread_mutex_unlock(lock);
+}
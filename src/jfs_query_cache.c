@@ -0,0 +1,322 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_query_cache.h"
+#include "sglib.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define JFS_QUERY_CACHE_SIZE 1024
+#define JFS_QUERY_CACHE_MAX  256
+
+typedef struct jfs_query_cache jfs_query_cache_t;
+struct jfs_query_cache {
+  char              *query;
+  int               *keyids;
+  int                num_keyids;
+  jfs_list_t        *result;
+
+  jfs_query_cache_t *next;
+};
+
+static jfs_query_cache_t *hashtable[JFS_QUERY_CACHE_SIZE];
+
+#define JFS_QUERY_CACHE_T_CMP(e1, e2) (strcmp(e1->query, e2->query))
+
+static unsigned int
+jfs_query_cache_t_hash(jfs_query_cache_t *item)
+{
+  unsigned int hash;
+  const char *c;
+
+  hash = 5381;
+  for(c = item->query; *c; ++c) {
+    hash = ((hash << 5) + hash) + *c;
+  }
+
+  return hash % JFS_QUERY_CACHE_SIZE;
+}
+
+/*
+ * SGLIB generator macros for jfs_query_cache_t lists.
+ */
+SGLIB_DEFINE_LIST_PROTOTYPES(jfs_query_cache_t, JFS_QUERY_CACHE_T_CMP, next)
+SGLIB_DEFINE_LIST_FUNCTIONS(jfs_query_cache_t, JFS_QUERY_CACHE_T_CMP, next)
+
+/*
+ * SGLIB generator macros for hashtable function prototypes.
+ */
+SGLIB_DEFINE_HASHED_CONTAINER_PROTOTYPES(jfs_query_cache_t, JFS_QUERY_CACHE_SIZE,
+                                         jfs_query_cache_t_hash)
+SGLIB_DEFINE_HASHED_CONTAINER_FUNCTIONS(jfs_query_cache_t, JFS_QUERY_CACHE_SIZE,
+                                        jfs_query_cache_t_hash)
+
+static pthread_rwlock_t cache_lock;
+
+static unsigned long cache_generation;
+static int cache_count;
+
+static int jfs_query_cache_copy(jfs_list_t *src, jfs_list_t **dst);
+static void jfs_query_cache_free(jfs_query_cache_t *item);
+static void jfs_query_cache_clear(void);
+
+void
+jfs_query_cache_init(void)
+{
+  pthread_rwlock_init(&cache_lock, NULL);
+  sglib_hashed_jfs_query_cache_t_init(hashtable);
+
+  cache_generation = 0;
+  cache_count = 0;
+}
+
+void
+jfs_query_cache_destroy(void)
+{
+  pthread_rwlock_wrlock(&cache_lock);
+  jfs_query_cache_clear();
+  pthread_rwlock_unlock(&cache_lock);
+  pthread_rwlock_destroy(&cache_lock);
+}
+
+unsigned long
+jfs_query_cache_generation(void)
+{
+  unsigned long generation;
+
+  pthread_rwlock_rdlock(&cache_lock);
+  generation = cache_generation;
+  pthread_rwlock_unlock(&cache_lock);
+
+  return generation;
+}
+
+int
+jfs_query_cache_get(const char *query, jfs_list_t **result)
+{
+  jfs_query_cache_t check;
+  jfs_query_cache_t *item;
+
+  int rc;
+
+  check.query = (char *)query;
+
+  pthread_rwlock_rdlock(&cache_lock);
+  item = sglib_hashed_jfs_query_cache_t_find_member(hashtable, &check);
+  if(!item) {
+    pthread_rwlock_unlock(&cache_lock);
+
+    return -ENOENT;
+  }
+
+  rc = jfs_query_cache_copy(item->result, result);
+  pthread_rwlock_unlock(&cache_lock);
+
+  return rc;
+}
+
+int
+jfs_query_cache_add(const char *query, const int *keyids, int num_keyids,
+                    unsigned long generation, jfs_list_t *result)
+{
+  jfs_query_cache_t *item;
+  jfs_query_cache_t *elem;
+
+  int rc;
+
+  item = malloc(sizeof(*item));
+  if(!item) {
+    return -ENOMEM;
+  }
+  item->result = NULL;
+  item->keyids = NULL;
+
+  item->query = strdup(query);
+  if(!item->query) {
+    jfs_query_cache_free(item);
+    return -ENOMEM;
+  }
+
+  item->num_keyids = num_keyids;
+  item->keyids = malloc(sizeof(*item->keyids) * (num_keyids + 1));
+  if(!item->keyids) {
+    jfs_query_cache_free(item);
+    return -ENOMEM;
+  }
+  memcpy(item->keyids, keyids, sizeof(*item->keyids) * num_keyids);
+
+  rc = jfs_query_cache_copy(result, &item->result);
+  if(rc) {
+    jfs_query_cache_free(item);
+    return rc;
+  }
+
+  pthread_rwlock_wrlock(&cache_lock);
+
+  //a write landed while the query ran, the result may be stale
+  if(generation != cache_generation) {
+    pthread_rwlock_unlock(&cache_lock);
+    jfs_query_cache_free(item);
+
+    return 0;
+  }
+
+  if(sglib_hashed_jfs_query_cache_t_delete_if_member(hashtable, item, &elem)) {
+    jfs_query_cache_free(elem);
+    --cache_count;
+  }
+
+  //results are cheap to rebuild, start over when full
+  if(cache_count >= JFS_QUERY_CACHE_MAX) {
+    jfs_query_cache_clear();
+  }
+
+  sglib_hashed_jfs_query_cache_t_add(hashtable, item);
+  ++cache_count;
+  pthread_rwlock_unlock(&cache_lock);
+
+  return 0;
+}
+
+void
+jfs_query_cache_invalidate_key(int keyid)
+{
+  struct sglib_hashed_jfs_query_cache_t_iterator it;
+  jfs_query_cache_t *item;
+  jfs_query_cache_t *elem;
+  jfs_query_cache_t *stale;
+
+  int i;
+
+  stale = NULL;
+
+  pthread_rwlock_wrlock(&cache_lock);
+  ++cache_generation;
+  for(item = sglib_hashed_jfs_query_cache_t_it_init(&it, hashtable);
+      item != NULL; item = sglib_hashed_jfs_query_cache_t_it_next(&it)) {
+    for(i = 0; i < item->num_keyids; ++i) {
+      if(item->keyids[i] == keyid) {
+        break;
+      }
+    }
+
+    //collect first, deleting would break the iterator
+    if(i < item->num_keyids) {
+      elem = malloc(sizeof(*elem));
+      if(elem) {
+        elem->query = item->query;
+        elem->next = stale;
+        stale = elem;
+      }
+    }
+  }
+
+  while(stale) {
+    elem = stale;
+    stale = stale->next;
+    if(sglib_hashed_jfs_query_cache_t_delete_if_member(hashtable, elem, &item)) {
+      jfs_query_cache_free(item);
+      --cache_count;
+    }
+    free(elem);
+  }
+  pthread_rwlock_unlock(&cache_lock);
+}
+
+void
+jfs_query_cache_invalidate_all(void)
+{
+  pthread_rwlock_wrlock(&cache_lock);
+  ++cache_generation;
+  jfs_query_cache_clear();
+  pthread_rwlock_unlock(&cache_lock);
+}
+
+/*
+ * Free every entry, the cache lock must be held.
+ */
+static void
+jfs_query_cache_clear(void)
+{
+  struct sglib_hashed_jfs_query_cache_t_iterator it;
+  jfs_query_cache_t *item;
+
+  for(item = sglib_hashed_jfs_query_cache_t_it_init(&it, hashtable);
+      item != NULL; item = sglib_hashed_jfs_query_cache_t_it_next(&it)) {
+    jfs_query_cache_free(item);
+  }
+  sglib_hashed_jfs_query_cache_t_init(hashtable);
+  cache_count = 0;
+}
+
+static void
+jfs_query_cache_free(jfs_query_cache_t *item)
+{
+  jfs_list_destroy(item->result, jfs_readdir_op);
+  free(item->keyids);
+  free(item->query);
+  free(item);
+}
+
+/*
+ * Copy a readdir result list.
+ */
+static int
+jfs_query_cache_copy(jfs_list_t *src, jfs_list_t **dst)
+{
+  jfs_list_t *head;
+  jfs_list_t *item;
+  jfs_list_t *row;
+
+  head = NULL;
+  for(item = src; item != NULL; item = item->next) {
+    row = calloc(1, sizeof(*row));
+    if(!row) {
+      jfs_list_destroy(head, jfs_readdir_op);
+      return -ENOMEM;
+    }
+    jfs_list_add(&head, row);
+
+    row->jfs_id = item->jfs_id;
+    if(item->filename) {
+      row->filename = strdup(item->filename);
+      if(!row->filename) {
+        jfs_list_destroy(head, jfs_readdir_op);
+        return -ENOMEM;
+      }
+    }
+    if(item->datapath) {
+      row->datapath = strdup(item->datapath);
+      if(!row->datapath) {
+        jfs_list_destroy(head, jfs_readdir_op);
+        return -ENOMEM;
+      }
+    }
+  }
+  *dst = head;
+
+  return 0;
+}
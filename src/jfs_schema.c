@@ -0,0 +1,146 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "error_log.h"
+#include "jfs_schema.h"
+
+#include <stdlib.h>
+#include <sqlite3.h>
+
+/*
+ * Migrations indexed by the version they upgrade from.
+ * New migrations are only ever appended, joinfs.sql
+ * creates the latest schema.
+ */
+static const char *jfs_schema_migrations[] = {
+  /* 0 -> 1: indexes for the dynamic folder queries */
+  "CREATE INDEX IF NOT EXISTS metadata_keyid_value ON metadata(keyid, keyvalue, jfs_id);"
+  "CREATE INDEX IF NOT EXISTS links_inode ON links(inode);",
+
+  /* 1 -> 2: metadata is only ever reached through its key */
+  "CREATE TABLE metadata_new(jfs_id INTEGER NOT NULL,"
+  " keyid INTEGER NOT NULL,"
+  " keyvalue TEXT NOT NULL,"
+  " FOREIGN KEY(jfs_id) REFERENCES links(jfs_id) ON DELETE CASCADE ON UPDATE CASCADE,"
+  " FOREIGN KEY(keyid) REFERENCES keys(keyid) ON DELETE RESTRICT ON UPDATE CASCADE,"
+  " PRIMARY KEY(jfs_id, keyid)) WITHOUT ROWID;"
+  "INSERT INTO metadata_new SELECT jfs_id, keyid, keyvalue FROM metadata;"
+  "DROP TABLE metadata;"
+  "ALTER TABLE metadata_new RENAME TO metadata;"
+  "CREATE INDEX metadata_keyid_value ON metadata(keyid, keyvalue, jfs_id);"
+};
+
+#define JFS_SCHEMA_VERSION (int)(sizeof(jfs_schema_migrations) / sizeof(jfs_schema_migrations[0]))
+
+/*
+ * Get the schema version of the database.
+ */
+static int
+jfs_schema_get_version(sqlite3 *db, int *version)
+{
+  sqlite3_stmt *stmt;
+
+  int rc;
+
+  rc = sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL);
+  if(rc) {
+    return rc;
+  }
+
+  rc = sqlite3_step(stmt);
+  if(rc != SQLITE_ROW) {
+    sqlite3_finalize(stmt);
+    return rc;
+  }
+  *version = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return 0;
+}
+
+/*
+ * Run one migration and record the new version.
+ */
+static int
+jfs_schema_do_migration(sqlite3 *db, int version)
+{
+  char *query;
+
+  int rc;
+
+  rc = sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION;", NULL, NULL, NULL);
+  if(rc) {
+    return rc;
+  }
+
+  rc = sqlite3_exec(db, jfs_schema_migrations[version], NULL, NULL, NULL);
+  if(rc) {
+    sqlite3_exec(db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+    return rc;
+  }
+
+  query = sqlite3_mprintf("PRAGMA user_version=%d;", version + 1);
+  if(!query) {
+    sqlite3_exec(db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_exec(db, query, NULL, NULL, NULL);
+  sqlite3_free(query);
+  if(rc) {
+    sqlite3_exec(db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+    return rc;
+  }
+
+  return sqlite3_exec(db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+}
+
+int
+jfs_schema_migrate(sqlite3 *db)
+{
+  int version;
+  int rc;
+
+  version = 0;
+  rc = jfs_schema_get_version(db, &version);
+  if(rc) {
+    return rc;
+  }
+
+  if(version > JFS_SCHEMA_VERSION) {
+    log_error("Database schema version %d is newer than joinFS supports (%d).\n",
+              version, JFS_SCHEMA_VERSION);
+    return SQLITE_MISMATCH;
+  }
+
+  for(; version < JFS_SCHEMA_VERSION; ++version) {
+    rc = jfs_schema_do_migration(db, version);
+    if(rc) {
+      log_error("Schema migration to version %d failed, error:%d, %s\n", 
+                version + 1, rc, sqlite3_errmsg(db));
+      return rc;
+    }
+    log_msg("Database schema migrated to version %d.\n", version + 1);
+  }
+
+  return 0;
+}
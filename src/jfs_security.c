@@ -23,6 +23,7 @@
 
 #include "jfs_security.h"
 #include "jfs_util.h"
+#include "jfs_stat_cache.h"
 
 #include <stdlib.h>
 #include <errno.h>
@@ -33,20 +34,22 @@
 int 
 jfs_security_chmod(const char *path, mode_t mode)
 {
-  char *datapath;
+  struct jfs_path_info info;
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
 	return rc;
   }
 
-  rc = chmod(datapath, mode);
-  free(datapath);
-
+  rc = chmod(info.datapath, mode);
   if(rc) {
 	return -errno;
   }
+  jfs_stat_cache_remove(info.datapath);
+  if(info.type == jfs_path_dynamic) {
+    jfs_stat_cache_remove(path);
+  }
 
   return 0;
 }
@@ -54,20 +57,22 @@ jfs_security_chmod(const char *path, mode_t mode)
 int 
 jfs_security_chown(const char *path, uid_t uid, gid_t gid)
 {
-  char *datapath;
+  struct jfs_path_info info;
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
 	return rc;
   }
 
-  rc = lchown(datapath, uid, gid);
-  free(datapath);
-
+  rc = lchown(info.datapath, uid, gid);
   if(rc) {
 	return -errno;
   }
+  jfs_stat_cache_remove(info.datapath);
+  if(info.type == jfs_path_dynamic) {
+    jfs_stat_cache_remove(path);
+  }
 
   return 0;
 }
@@ -75,17 +80,15 @@ jfs_security_chown(const char *path, uid_t uid, gid_t gid)
 int 
 jfs_security_access(const char *path, int mask)
 {
-  char *datapath;
+  struct jfs_path_info info;
   int rc;
 
-  rc = jfs_util_get_datapath(path, &datapath);
+  rc = jfs_util_classify_path(path, &info);
   if(rc) {
 	return rc;
   }
 
-  rc = access(datapath, mask);
-  free(datapath);
-
+  rc = access(info.datapath, mask);
   if(rc) {
 	return -errno;
   }
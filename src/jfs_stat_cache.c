@@ -0,0 +1,371 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_stat_cache.h"
+#include "joinfs.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+#define JFS_STAT_CACHE_SIZE    16384
+#define JFS_STAT_CACHE_STRIPES 64
+
+/*
+  One direct mapped slot, a colliding path simply replaces it.
+ */
+struct jfs_stat_slot {
+  unsigned int   hash;
+  char          *path;
+  size_t         path_size;
+
+  unsigned long  epoch;
+  uint64_t       expires;
+  struct stat    st;
+};
+
+/*
+  Slot i is guarded by stripe i % JFS_STAT_CACHE_STRIPES. The
+  generation changes whenever a path in the stripe is invalidated.
+ */
+struct jfs_stat_stripe {
+  pthread_mutex_t lock;
+
+  unsigned long   generation;
+  unsigned long   hits;
+  unsigned long   misses;
+  unsigned long   expired;
+} __attribute__((aligned(64)));
+
+static struct jfs_stat_stripe stripes[JFS_STAT_CACHE_STRIPES];
+static struct jfs_stat_slot *slots;
+static size_t num_slots;
+static uint64_t ttl_ns;
+
+//entries filled before the last invalidate_all are stale
+static unsigned long stat_epoch;
+
+static unsigned int
+jfs_stat_cache_hash(const char *path, size_t *size)
+{
+  const unsigned char *c;
+  unsigned int hash;
+
+  //FNV-1a
+  hash = 2166136261u;
+  for(c = (const unsigned char *)path; *c; ++c) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+  *size = (const char *)c - path + 1;
+
+  return hash;
+}
+
+static uint64_t
+jfs_stat_cache_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static struct jfs_stat_slot *
+jfs_stat_cache_slot(unsigned int hash, struct jfs_stat_stripe **stripe)
+{
+  size_t i;
+
+  i = hash & (num_slots - 1);
+  *stripe = &stripes[i % JFS_STAT_CACHE_STRIPES];
+
+  return &slots[i];
+}
+
+static int
+jfs_stat_slot_match(struct jfs_stat_slot *slot, const char *path,
+                    unsigned int hash, size_t size)
+{
+  return slot->path && slot->hash == hash && slot->path_size == size
+    && !memcmp(slot->path, path, size);
+}
+
+static void
+jfs_stat_slot_clear(struct jfs_stat_slot *slot)
+{
+  free(slot->path);
+  slot->path = NULL;
+  slot->path_size = 0;
+}
+
+int
+jfs_stat_cache_init(void)
+{
+  size_t i;
+
+  stat_epoch = 0;
+  ttl_ns = (uint64_t)joinfs_context.stat_timeout_ms * 1000000ULL;
+  if(!ttl_ns) {
+    return 0;
+  }
+
+  num_slots = JFS_STAT_CACHE_SIZE;
+  slots = calloc(num_slots, sizeof(*slots));
+  if(!slots) {
+    return -ENOMEM;
+  }
+
+  for(i = 0; i < JFS_STAT_CACHE_STRIPES; ++i) {
+    pthread_mutex_init(&stripes[i].lock, NULL);
+    stripes[i].generation = 0;
+    stripes[i].hits = 0;
+    stripes[i].misses = 0;
+    stripes[i].expired = 0;
+  }
+
+  return 0;
+}
+
+void
+jfs_stat_cache_destroy(void)
+{
+  size_t i;
+
+  if(!slots) {
+    return;
+  }
+
+  for(i = 0; i < num_slots; ++i) {
+    free(slots[i].path);
+  }
+  free(slots);
+  slots = NULL;
+
+  for(i = 0; i < JFS_STAT_CACHE_STRIPES; ++i) {
+    pthread_mutex_destroy(&stripes[i].lock);
+  }
+}
+
+void
+jfs_stat_cache_get_stats(struct jfs_stat_cache_stats *stats)
+{
+  size_t i;
+
+  memset(stats, 0, sizeof(*stats));
+  if(!slots) {
+    return;
+  }
+
+  for(i = 0; i < JFS_STAT_CACHE_STRIPES; ++i) {
+    pthread_mutex_lock(&stripes[i].lock);
+    stats->hits += stripes[i].hits;
+    stats->misses += stripes[i].misses;
+    stats->expired += stripes[i].expired;
+    pthread_mutex_unlock(&stripes[i].lock);
+  }
+}
+
+int
+jfs_stat_cache_get(const char *path, struct stat *stbuf)
+{
+  struct jfs_stat_stripe *stripe;
+  struct jfs_stat_slot *slot;
+
+  unsigned int hash;
+  size_t size;
+
+  if(!slots) {
+    return -ENOENT;
+  }
+
+  hash = jfs_stat_cache_hash(path, &size);
+  slot = jfs_stat_cache_slot(hash, &stripe);
+
+  pthread_mutex_lock(&stripe->lock);
+  if(!jfs_stat_slot_match(slot, path, hash, size)) {
+    stripe->misses++;
+    pthread_mutex_unlock(&stripe->lock);
+
+    return -ENOENT;
+  }
+
+  if(slot->epoch != __atomic_load_n(&stat_epoch, __ATOMIC_ACQUIRE)
+     || slot->expires <= jfs_stat_cache_now()) {
+    jfs_stat_slot_clear(slot);
+    stripe->expired++;
+    pthread_mutex_unlock(&stripe->lock);
+
+    return -ENOENT;
+  }
+  memcpy(stbuf, &slot->st, sizeof(*stbuf));
+  stripe->hits++;
+  pthread_mutex_unlock(&stripe->lock);
+
+  return 0;
+}
+
+unsigned long
+jfs_stat_cache_generation(const char *path)
+{
+  struct jfs_stat_stripe *stripe;
+  unsigned int hash;
+  size_t size;
+
+  if(!slots) {
+    return 0;
+  }
+
+  hash = jfs_stat_cache_hash(path, &size);
+  jfs_stat_cache_slot(hash, &stripe);
+
+  return __atomic_load_n(&stripe->generation, __ATOMIC_ACQUIRE);
+}
+
+void
+jfs_stat_cache_fill(const char *path, const struct stat *stbuf,
+                    unsigned long generation)
+{
+  struct jfs_stat_stripe *stripe;
+  struct jfs_stat_slot *slot;
+
+  unsigned int hash;
+  size_t size;
+  char *copy;
+
+  if(!slots) {
+    return;
+  }
+
+  hash = jfs_stat_cache_hash(path, &size);
+  slot = jfs_stat_cache_slot(hash, &stripe);
+
+  pthread_mutex_lock(&stripe->lock);
+  //an invalidation raced with the lstat
+  if(stripe->generation != generation) {
+    pthread_mutex_unlock(&stripe->lock);
+
+    return;
+  }
+
+  if(!jfs_stat_slot_match(slot, path, hash, size)) {
+    copy = malloc(size);
+    if(!copy) {
+      pthread_mutex_unlock(&stripe->lock);
+
+      return;
+    }
+    memcpy(copy, path, size);
+
+    jfs_stat_slot_clear(slot);
+    slot->path = copy;
+    slot->path_size = size;
+    slot->hash = hash;
+  }
+  slot->epoch = __atomic_load_n(&stat_epoch, __ATOMIC_ACQUIRE);
+  slot->expires = jfs_stat_cache_now() + ttl_ns;
+  memcpy(&slot->st, stbuf, sizeof(slot->st));
+  pthread_mutex_unlock(&stripe->lock);
+}
+
+void
+jfs_stat_cache_remove(const char *path)
+{
+  struct jfs_stat_stripe *stripe;
+  struct jfs_stat_slot *slot;
+
+  unsigned int hash;
+  size_t size;
+
+  if(!slots || !path) {
+    return;
+  }
+
+  hash = jfs_stat_cache_hash(path, &size);
+  slot = jfs_stat_cache_slot(hash, &stripe);
+
+  pthread_mutex_lock(&stripe->lock);
+  __atomic_add_fetch(&stripe->generation, 1, __ATOMIC_RELEASE);
+  if(jfs_stat_slot_match(slot, path, hash, size)) {
+    jfs_stat_slot_clear(slot);
+  }
+  pthread_mutex_unlock(&stripe->lock);
+}
+
+void
+jfs_stat_cache_remove_dirent(const char *path)
+{
+  char parent[PATH_MAX];
+  char *terminator;
+  size_t size;
+
+  if(!slots || !path) {
+    return;
+  }
+  jfs_stat_cache_remove(path);
+
+  size = strlen(path) + 1;
+  if(size > sizeof(parent)) {
+    jfs_stat_cache_invalidate_all();
+
+    return;
+  }
+  memcpy(parent, path, size);
+
+  terminator = strrchr(parent, '/');
+  if(!terminator) {
+    return;
+  }
+  
+  //getattr sees the query directory with its trailing slash
+  if(terminator - parent == joinfs_context.querypath_len
+     || terminator == parent) {
+    terminator[1] = '\0';
+  }
+  else {
+    *terminator = '\0';
+  }
+  jfs_stat_cache_remove(parent);
+}
+
+void
+jfs_stat_cache_invalidate_all(void)
+{
+  size_t i;
+
+  if(!slots) {
+    return;
+  }
+
+  //fills racing with this see a new generation, earlier ones a new epoch
+  for(i = 0; i < JFS_STAT_CACHE_STRIPES; ++i) {
+    pthread_mutex_lock(&stripes[i].lock);
+    __atomic_add_fetch(&stripes[i].generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&stripes[i].lock);
+  }
+  __atomic_add_fetch(&stat_epoch, 1, __ATOMIC_RELEASE);
+}
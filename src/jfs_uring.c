@@ -0,0 +1,333 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_uring.h"
+#include "error_log.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+static struct io_uring ring;
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slot_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t reaper;
+
+/*
+  Operations queued but not reaped, kept at or below the
+  submission depth. The completion queue is twice as deep,
+  so it can never overflow.
+ */
+static unsigned inflight;
+static unsigned ring_slots;
+
+//entries left queued by a failed submit, the reaper retries them too
+static int submit_failed;
+#endif
+
+static int ring_live;
+
+/*
+  A synchronous caller parked until its operation completes.
+ */
+struct jfs_uring_wait {
+  struct jfs_uring_req req;
+  pthread_mutex_t      lock;
+  pthread_cond_t       cond;
+  int                  finished;
+  ssize_t              res;
+};
+
+/*
+ * The blocking fallback.
+ */
+static void
+jfs_uring_run(struct jfs_uring_req *req)
+{
+  ssize_t res;
+
+  switch(req->op) {
+  case jfs_uring_op_read:
+    res = pread(req->fd, req->buf, req->len, req->offset);
+    break;
+  case jfs_uring_op_write:
+    res = pwrite(req->fd, req->buf, req->len, req->offset);
+    break;
+  case jfs_uring_op_fsync:
+    res = fsync(req->fd);
+    break;
+  default:
+    res = fdatasync(req->fd);
+    break;
+  }
+
+  req->done(req, res < 0 ? -errno : res);
+}
+
+#ifdef HAVE_LIBURING
+/*
+ * Hand completions back to their owners until the NULL sentinel.
+ */
+static void *
+jfs_uring_reap(void *arg)
+{
+  struct jfs_uring_req *req;
+  struct io_uring_cqe *cqe;
+
+  ssize_t res;
+  int rc;
+
+  (void) arg;
+
+  for(;;) {
+    rc = io_uring_wait_cqe(&ring, &cqe);
+    if(rc) {
+      if(rc == -EINTR) {
+        continue;
+      }
+      log_error("io_uring completion wait failed, error:%d\n", rc);
+      break;
+    }
+
+    req = io_uring_cqe_get_data(cqe);
+    res = cqe->res;
+    io_uring_cqe_seen(&ring, cqe);
+
+    if(!req) {
+      break;
+    }
+
+    pthread_mutex_lock(&submit_lock);
+    --inflight;
+    pthread_cond_signal(&slot_cond);
+    if(submit_failed && io_uring_submit(&ring) >= 0) {
+      submit_failed = 0;
+    }
+    pthread_mutex_unlock(&submit_lock);
+
+    req->done(req, res);
+  }
+
+  return NULL;
+}
+#endif
+
+int
+jfs_uring_init(unsigned entries)
+{
+#ifdef HAVE_LIBURING
+  int rc;
+
+  rc = io_uring_queue_init(entries, &ring, 0);
+  if(rc) {
+    log_error("io_uring is unavailable, data operations block, error:%d\n", rc);
+    return 0;
+  }
+
+  rc = pthread_create(&reaper, NULL, jfs_uring_reap, NULL);
+  if(rc) {
+    io_uring_queue_exit(&ring);
+    return -rc;
+  }
+  inflight = 0;
+  ring_slots = entries;
+  submit_failed = 0;
+  ring_live = 1;
+#else
+  (void) entries;
+#endif
+
+  return 0;
+}
+
+void
+jfs_uring_destroy(void)
+{
+#ifdef HAVE_LIBURING
+  struct io_uring_sqe *sqe;
+
+  if(!ring_live) {
+    return;
+  }
+
+  //a no-op without an owner stops the completion thread
+  pthread_mutex_lock(&submit_lock);
+  while(!(sqe = io_uring_get_sqe(&ring))) {
+    io_uring_submit(&ring);
+  }
+  io_uring_prep_nop(sqe);
+  io_uring_sqe_set_data(sqe, NULL);
+  io_uring_submit(&ring);
+  pthread_mutex_unlock(&submit_lock);
+
+  pthread_join(reaper, NULL);
+  io_uring_queue_exit(&ring);
+  ring_live = 0;
+#endif
+}
+
+int
+jfs_uring_enabled(void)
+{
+  return ring_live;
+}
+
+void
+jfs_uring_submit(struct jfs_uring_req *req)
+{
+#ifdef HAVE_LIBURING
+  struct io_uring_sqe *sqe;
+  int rc;
+
+  if(!ring_live) {
+    jfs_uring_run(req);
+    return;
+  }
+
+  pthread_mutex_lock(&submit_lock);
+  while(inflight >= ring_slots) {
+    pthread_cond_wait(&slot_cond, &submit_lock);
+  }
+
+  sqe = io_uring_get_sqe(&ring);
+  if(!sqe) {
+    //the queue is full of unsubmitted entries, push them out first
+    io_uring_submit(&ring);
+    sqe = io_uring_get_sqe(&ring);
+  }
+  if(!sqe) {
+    pthread_mutex_unlock(&submit_lock);
+    jfs_uring_run(req);
+    return;
+  }
+
+  switch(req->op) {
+  case jfs_uring_op_read:
+    io_uring_prep_read(sqe, req->fd, req->buf, req->len, req->offset);
+    break;
+  case jfs_uring_op_write:
+    io_uring_prep_write(sqe, req->fd, req->buf, req->len, req->offset);
+    break;
+  case jfs_uring_op_fsync:
+    io_uring_prep_fsync(sqe, req->fd, 0);
+    break;
+  default:
+    io_uring_prep_fsync(sqe, req->fd, IORING_FSYNC_DATASYNC);
+    break;
+  }
+  io_uring_sqe_set_data(sqe, req);
+  ++inflight;
+
+  //the entry belongs to the ring now, a failed submit leaves it queued
+  do {
+    rc = io_uring_submit(&ring);
+  } while(rc == -EINTR || rc == -EAGAIN);
+  if(rc < 0) {
+    log_error("io_uring submit failed, retrying on the next submit, error:%d\n", rc);
+    submit_failed = 1;
+  }
+  pthread_mutex_unlock(&submit_lock);
+#else
+  jfs_uring_run(req);
+#endif
+}
+
+static void
+jfs_uring_wake(struct jfs_uring_req *req, ssize_t res)
+{
+  struct jfs_uring_wait *wait = (struct jfs_uring_wait *)req;
+
+  pthread_mutex_lock(&wait->lock);
+  wait->res = res;
+  wait->finished = 1;
+  pthread_cond_signal(&wait->cond);
+  pthread_mutex_unlock(&wait->lock);
+}
+
+static void
+jfs_uring_store(struct jfs_uring_req *req, ssize_t res)
+{
+  ((struct jfs_uring_wait *)req)->res = res;
+}
+
+static ssize_t
+jfs_uring_wait(enum jfs_uring_op op, int fd, void *buf, size_t len, off_t offset)
+{
+  struct jfs_uring_wait wait;
+
+  memset(&wait, 0, sizeof(wait));
+  wait.req.op = op;
+  wait.req.fd = fd;
+  wait.req.buf = buf;
+  wait.req.len = len;
+  wait.req.offset = offset;
+
+  //without a ring the result is ready on return
+  if(!ring_live) {
+    wait.req.done = jfs_uring_store;
+    jfs_uring_run(&wait.req);
+
+    return wait.res;
+  }
+
+  wait.req.done = jfs_uring_wake;
+  pthread_mutex_init(&wait.lock, NULL);
+  pthread_cond_init(&wait.cond, NULL);
+
+  jfs_uring_submit(&wait.req);
+
+  pthread_mutex_lock(&wait.lock);
+  while(!wait.finished) {
+    pthread_cond_wait(&wait.cond, &wait.lock);
+  }
+  pthread_mutex_unlock(&wait.lock);
+
+  pthread_cond_destroy(&wait.cond);
+  pthread_mutex_destroy(&wait.lock);
+
+  return wait.res;
+}
+
+ssize_t
+jfs_uring_pread(int fd, void *buf, size_t len, off_t offset)
+{
+  return jfs_uring_wait(jfs_uring_op_read, fd, buf, len, offset);
+}
+
+ssize_t
+jfs_uring_pwrite(int fd, const void *buf, size_t len, off_t offset)
+{
+  return jfs_uring_wait(jfs_uring_op_write, fd, (void *)buf, len, offset);
+}
+
+int
+jfs_uring_fsync(int fd, int datasync)
+{
+  return jfs_uring_wait(datasync ? jfs_uring_op_fdatasync : jfs_uring_op_fsync,
+                        fd, NULL, 0, 0);
+}
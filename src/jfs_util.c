@@ -28,7 +28,6 @@
 #include "jfs_util.h"
 #include "joinfs.h"
 
-#include <fuse.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
@@ -38,6 +37,7 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <limits.h>
 
 int 
 jfs_util_get_inode(const char *path)
@@ -71,123 +71,129 @@ jfs_util_get_inode_and_mode(const char *path, int *inode, mode_t *mode)
   return 0;
 }
 
-int
-jfs_util_is_realpath(const char *path)
+/*
+ * Resolve a new file in a .jfs_sub_query folder, whose data lives
+ * under the folder's datapath.
+ */
+static int
+jfs_util_classify_sub_query(const char *path, struct jfs_path_info *info)
 {
-  int mask;
+  char subpath[PATH_MAX];
+  char *filename;
+
+  size_t sub_len;
+  size_t data_len;
+
+  int rc;
+
+  filename = jfs_util_get_filename(path);
+  if(!filename || *filename == '\0') {
+    return -ENOENT;
+  }
 
-  mask = F_OK;
+  sub_len = filename - path;
+  if(sub_len >= sizeof(subpath)) {
+    return -ENAMETOOLONG;
+  }
+  memcpy(subpath, path, sub_len);
+  subpath[sub_len] = '\0';
 
-  if(!access(path, mask)) {
-    return 1;
+  rc = jfs_dynamic_path_resolve(subpath, info->datapath, sizeof(info->datapath),
+                                &info->jfs_id);
+  if(rc) {
+    return rc;
   }
 
-  return 0;
+  data_len = strlen(info->datapath);
+  rc = snprintf(info->datapath + data_len, sizeof(info->datapath) - data_len,
+                "/%s", filename);
+  if(rc >= (int)(sizeof(info->datapath) - data_len)) {
+    return -ENAMETOOLONG;
+  }
+      
+  //does it actually exist?
+  if(lstat(info->datapath, &info->st)) {
+    return -ENOENT;
+  }
+  info->has_stat = 1;
+
+  //cache it for next time
+  return jfs_dynamic_hierarchy_add_file(path, info->datapath, info->jfs_id);
 }
 
 int
-jfs_util_is_path_dynamic(const char *path)
+jfs_util_classify_path(const char *path, struct jfs_path_info *info)
 {
-  char *datapath;
-  int jfs_id;
+  size_t path_len;
   int rc;
 
-  datapath = NULL;
-  if(jfs_util_is_realpath(path)) {
+  info->type = jfs_path_missing;
+  info->jfs_id = 0;
+  info->has_stat = 0;
+
+  //one lstat answers both whether the path is real and its attributes
+  if(!lstat(path, &info->st)) {
+    path_len = strlen(path) + 1;
+    if(path_len > sizeof(info->datapath)) {
+      return -ENAMETOOLONG;
+    }
+    memcpy(info->datapath, path, path_len);
+
+    info->type = jfs_path_static;
+    info->has_stat = 1;
+
     return 0;
   }
 
-  rc = jfs_dynamic_path_resolution(path, &datapath, &jfs_id); 
+  //only a path missing on disk can be dynamic
+  if(errno != ENOENT) {
+    return -errno;
+  }
+
+  rc = jfs_dynamic_path_resolve(path, info->datapath, sizeof(info->datapath),
+                                &info->jfs_id);
+  if(rc == -ENOENT) {
+    rc = jfs_util_classify_sub_query(path, info);
+  }
+  else if(!rc) {
+    //dynamic folders without a datapath only exist in memory
+    info->has_stat = !lstat(info->datapath, &info->st);
+  }
+
   if(rc) {
-    return 0;
+    info->jfs_id = 0;
+    info->has_stat = 0;
+
+    return rc;
   }
-  free(datapath);
+  info->type = jfs_path_dynamic;
 
-  return 1;
+  return 0;
 }
 
 int
 jfs_util_get_datapath(const char *path, char **datapath)
 {
-  char *filename;
-  char *r_path;
-  char *subpath;
-  char *d_path;
+  struct jfs_path_info info;
+  size_t datapath_len;
 
-  size_t realpath_len;
-  
-  int jfs_id;
   int rc;
 
-  jfs_id = 0;
-  if(!jfs_util_is_realpath(path)) {
-	rc = jfs_dynamic_path_resolution(path, &d_path, &jfs_id);
-
-    //check if it is stored in a .jfs_sub_query folder
-	if(rc) {
-      rc = jfs_util_get_subpath(path, &subpath);
-      if(rc) {
-        return rc;
-      }
-      
-      rc = jfs_dynamic_path_resolution(subpath, &d_path, &jfs_id);
-      free(subpath);
-
-      if(rc) {
-        return rc;
-      }
-
-      filename = jfs_util_get_filename(path);
-      realpath_len = strlen(d_path) + strlen(filename) + 2; //null and '/'
-
-      r_path = malloc(sizeof(*r_path) * realpath_len);
-      if(!r_path) {
-        free(d_path);
-        
-        return -ENOMEM;
-      }
-      snprintf(r_path, realpath_len, "%s/%s", d_path, filename);
-      free(d_path);
-      
-      //does it actually exist?
-      if(!jfs_util_is_realpath(r_path)) {
-        free(r_path);
-        
-        return -ENOENT;
-      }
-
-      //cache it for next time
-      rc = jfs_dynamic_hierarchy_add_file(path, r_path, jfs_id);
-      if(rc) {
-        free(r_path);
-        
-        return rc;
-      }
-      
-      if(datapath) {
-        *datapath = r_path;
-      }
-      else {
-        free(r_path);
-      }
-
-      return 0;
-    }
-    else {
-      *datapath = d_path;
-    }
+  rc = jfs_util_classify_path(path, &info);
+  if(rc) {
+    return rc;
+  }
 
+  if(!datapath) {
     return 0;
   }
-  
-  realpath_len = strlen(path) + 1;
-  r_path = malloc(sizeof(*r_path) * realpath_len);
-  if(!r_path) {
+
+  datapath_len = strlen(info.datapath) + 1;
+  *datapath = malloc(sizeof(**datapath) * datapath_len);
+  if(!*datapath) {
     return -ENOMEM;
   }
-  strncpy(r_path, path, realpath_len);
-  
-  *datapath = r_path;
+  memcpy(*datapath, info.datapath, datapath_len);
 
   return 0;
 }
@@ -244,19 +250,18 @@ jfs_util_get_keyid(const char *key)
   int keyid;
   int rc;
 
-  //hit the cache first
+  //every key is cached at mount, only new keys reach the db
   keyid = jfs_key_cache_get_keyid(key);
   if(keyid > 0) {
     return keyid;
   }
 
-  //cache miss, insert, but ignore if it exists
-  rc = jfs_db_op_create(&db_op, jfs_write_op,
-                        "INSERT OR IGNORE INTO keys VALUES(NULL, \"%s\");",
-                        key);
+  //new key, insert, but ignore if another thread beat us to it
+  rc = jfs_db_op_create_stmt(&db_op, jfs_write_op, jfs_key_insert_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_text(db_op, key);
   
   jfs_write_pool_queue(db_op);
 
@@ -268,12 +273,11 @@ jfs_util_get_keyid(const char *key)
   jfs_db_op_destroy(db_op);
 
   //go out to the database for the keyid
-  rc = jfs_db_op_create(&db_op, jfs_key_cache_op,
-                        "SELECT keyid FROM keys WHERE keytext=\"%s\";",
-                        key);
+  rc = jfs_db_op_create_stmt(&db_op, jfs_key_cache_op, jfs_keyid_lookup_stmt);
   if(rc) {
 	return rc;
   }
+  jfs_db_op_bind_text(db_op, key);
   
   jfs_read_pool_queue(db_op);
 
@@ -285,6 +289,7 @@ jfs_util_get_keyid(const char *key)
 
   //this should never happen
   if(db_op->result == NULL) {
+    jfs_db_op_destroy(db_op);
 	return -EINVAL;
   }
 
@@ -296,6 +301,15 @@ jfs_util_get_keyid(const char *key)
   return keyid;
 }
 
+/*
+ * Returns the keyid of a key that already exists, never adding it.
+ */
+int
+jfs_util_find_keyid(const char *key)
+{
+  return jfs_key_cache_get_keyid(key);
+}
+
 int
 jfs_util_strip_last_path_item(char *path)
 {
@@ -344,49 +358,46 @@ jfs_util_get_subpath(const char *path, char **new_path)
 int
 jfs_util_resolve_new_path(const char *path, char **new_path)
 {
-  char *sub_datapath;
-  char *subpath;
+  struct jfs_path_info info;
+
+  char subpath[PATH_MAX];
+  const char *slash;
   char *realpath;
   char *filename;
 
   size_t realpath_len;
+  size_t sub_len;
   
   int rc;
   
-  subpath = NULL;
-  sub_datapath = NULL;
-  realpath = NULL;
-  
   filename = jfs_util_get_filename(path);
   if(!filename || *filename == '\0') {
     return -ENOENT;
   }
+
+  sub_len = filename - path;
+  if(sub_len >= sizeof(subpath)) {
+    return -ENAMETOOLONG;
+  }
+  memcpy(subpath, path, sub_len);
+  subpath[sub_len] = '\0';
   
-  rc = jfs_util_get_subpath(path, &subpath); 
-  if(rc){
+  //a real subpath keeps its trailing slash, a dynamic one its datapath
+  rc = jfs_util_classify_path(subpath, &info);
+  if(rc) {
     return rc;
   }
-  
-  //if the subpath isn't real, get the sub_datapath
-  if(!jfs_util_is_realpath(subpath)) {
-    rc = jfs_util_get_datapath(subpath, &sub_datapath);
-    free(subpath);
 
-    if(rc) {
-      return rc;
-    }
-    subpath = sub_datapath;
-  }
+  //dynamic folder datapaths have no trailing slash
+  sub_len = strlen(info.datapath);
+  slash = sub_len && info.datapath[sub_len - 1] == '/' ? "" : "/";
 
-  realpath_len = strlen(subpath) + strlen(filename) + 1;
+  realpath_len = sub_len + strlen(slash) + strlen(filename) + 1;
   realpath = malloc(sizeof(*realpath) * realpath_len);
   if(!realpath) {
-    free(subpath);
-
     return -ENOMEM;
   }
-  snprintf(realpath, realpath_len, "%s%s", subpath, filename);
-  free(subpath);
+  snprintf(realpath, realpath_len, "%s%s%s", info.datapath, slash, filename);
   
   *new_path = realpath;
 
@@ -0,0 +1,275 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_writeback.h"
+#include "jfs_handle.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+  The pending run of one file handle, data covers
+  [offset, offset + len) of the backing file.
+ */
+struct jfs_writeback_buf {
+  struct jfs_handle handle;
+  pthread_mutex_t   lock;
+  int               error;
+  dev_t             dev;
+  ino_t             ino;
+  off_t             offset;
+  size_t            len;
+  char              data[];
+};
+
+/*
+  A file whose buffers getattr writes out.
+ */
+struct jfs_writeback_file {
+  dev_t dev;
+  ino_t ino;
+  int   flushed;
+};
+
+static struct jfs_handle_table bufs;
+static size_t buf_size;
+
+//buffers holding a run, path lookups skip the scan when there are none
+static int pending_runs;
+
+/*
+ * Find the buffer of a handle, creating it if asked to.
+ */
+static struct jfs_writeback_buf *
+jfs_writeback_find(int fd, int create)
+{
+  struct jfs_writeback_buf *wb;
+  struct stat st;
+  pthread_mutex_t *lock;
+
+  lock = jfs_handle_lock(&bufs, fd);
+
+  pthread_mutex_lock(lock);
+  wb = (struct jfs_writeback_buf *)jfs_handle_find(&bufs, fd);
+
+  if(!wb && create) {
+    wb = malloc(sizeof(*wb) + buf_size);
+    if(wb) {
+      //lets getattr on a path find the buffers of the file
+      if(fstat(fd, &st)) {
+        memset(&st, 0, sizeof(st));
+      }
+
+      pthread_mutex_init(&wb->lock, NULL);
+      wb->handle.fd = fd;
+      wb->error = 0;
+      wb->dev = st.st_dev;
+      wb->ino = st.st_ino;
+      wb->offset = 0;
+      wb->len = 0;
+      jfs_handle_insert(&bufs, &wb->handle);
+    }
+  }
+  pthread_mutex_unlock(lock);
+
+  return wb;
+}
+
+/*
+ * Write out a pending run, the caller holds the buffer lock.
+ */
+static int
+jfs_writeback_drain(struct jfs_writeback_buf *wb)
+{
+  ssize_t rc;
+  size_t done;
+
+  if(wb->len) {
+    __atomic_sub_fetch(&pending_runs, 1, __ATOMIC_RELEASE);
+  }
+
+  for(done = 0; done < wb->len; done += rc) {
+    rc = pwrite(wb->handle.fd, wb->data + done, wb->len - done, wb->offset + done);
+    if(rc < 0) {
+      if(errno == EINTR) {
+        rc = 0;
+        continue;
+      }
+      wb->error = -errno;
+      break;
+    }
+  }
+  wb->len = 0;
+
+  return wb->error;
+}
+
+int
+jfs_writeback_init(size_t size)
+{
+  jfs_handle_table_init(&bufs);
+  pending_runs = 0;
+  buf_size = size;
+
+  return 0;
+}
+
+void
+jfs_writeback_destroy(void)
+{
+  jfs_handle_table_destroy(&bufs);
+}
+
+ssize_t
+jfs_writeback_write(int fd, const char *buf, size_t size, off_t offset)
+{
+  struct jfs_writeback_buf *wb;
+  ssize_t rc;
+
+  //large writes gain nothing from a copy
+  if(size >= buf_size) {
+    rc = jfs_writeback_flush(fd);
+    if(rc) {
+      return rc;
+    }
+
+    rc = pwrite(fd, buf, size, offset);
+    return rc < 0 ? -errno : rc;
+  }
+
+  wb = jfs_writeback_find(fd, 1);
+  if(!wb) {
+    return -ENOMEM;
+  }
+
+  pthread_mutex_lock(&wb->lock);
+
+  //only a write that extends the run, and fits, joins it
+  if(wb->len && (offset != wb->offset + (off_t)wb->len
+                 || wb->len + size > buf_size)) {
+    jfs_writeback_drain(wb);
+  }
+  if(wb->error) {
+    rc = wb->error;
+    wb->error = 0;
+    pthread_mutex_unlock(&wb->lock);
+
+    return rc;
+  }
+
+  if(!wb->len) {
+    wb->offset = offset;
+    __atomic_add_fetch(&pending_runs, 1, __ATOMIC_RELEASE);
+  }
+  memcpy(wb->data + wb->len, buf, size);
+  wb->len += size;
+  pthread_mutex_unlock(&wb->lock);
+
+  return size;
+}
+
+int
+jfs_writeback_flush(int fd)
+{
+  struct jfs_writeback_buf *wb;
+  int rc;
+
+  wb = jfs_writeback_find(fd, 0);
+  if(!wb) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&wb->lock);
+  rc = jfs_writeback_drain(wb);
+  wb->error = 0;
+  pthread_mutex_unlock(&wb->lock);
+
+  return rc;
+}
+
+/*
+ * Write out a buffer of the file getattr asked about.
+ */
+static void
+jfs_writeback_flush_match(struct jfs_handle *handle, void *arg)
+{
+  struct jfs_writeback_buf *wb = (struct jfs_writeback_buf *)handle;
+  struct jfs_writeback_file *file = arg;
+
+  if(wb->dev != file->dev || wb->ino != file->ino) {
+    return;
+  }
+
+  //a failure stays with the buffer for its handle to report
+  pthread_mutex_lock(&wb->lock);
+  if(wb->len) {
+    jfs_writeback_drain(wb);
+    file->flushed = 1;
+  }
+  pthread_mutex_unlock(&wb->lock);
+}
+
+int
+jfs_writeback_flush_file(dev_t dev, ino_t ino)
+{
+  struct jfs_writeback_file file;
+
+  if(!__atomic_load_n(&pending_runs, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+
+  file.dev = dev;
+  file.ino = ino;
+  file.flushed = 0;
+  jfs_handle_table_foreach(&bufs, jfs_writeback_flush_match, &file);
+
+  return file.flushed;
+}
+
+int
+jfs_writeback_release(int fd)
+{
+  struct jfs_writeback_buf *wb;
+  pthread_mutex_t *lock;
+
+  int rc;
+
+  rc = jfs_writeback_flush(fd);
+
+  lock = jfs_handle_lock(&bufs, fd);
+
+  pthread_mutex_lock(lock);
+  wb = (struct jfs_writeback_buf *)jfs_handle_remove(&bufs, fd);
+  pthread_mutex_unlock(lock);
+
+  if(wb) {
+    pthread_mutex_destroy(&wb->lock);
+    free(wb);
+  }
+
+  return rc;
+}
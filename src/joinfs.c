@@ -20,8 +20,25 @@
 #define JFS_THREAD_MIN    12
 #define JFS_THREAD_MAX    256
 #define JFS_THREAD_LINGER 512
-
-#define FUSE_USE_VERSION  27
+#define JFS_WRITE_BATCH   JFS_POOL_BATCH_MAX
+#define JFS_WAL_AUTOCHECKPOINT 1000
+#define JFS_DATAPATH_CACHE_KB 65536
+#define JFS_META_CACHE_KB 32768
+#define JFS_STAT_TIMEOUT_MS 1000
+#define JFS_ATTR_TIMEOUT  1.0
+#define JFS_ENTRY_TIMEOUT 1.0
+#define JFS_MAX_WRITE     131072
+#define JFS_MAX_READAHEAD 131072
+#define JFS_WRITEBACK_SIZE 262144
+#define JFS_URING_ENTRIES 256
+#define JFS_PREFETCH_MAX  (8 * 1024 * 1024)
+
+/* JFS_FUSE3 selects the FUSE 3 low-level backend */
+#ifdef JFS_FUSE3
+#define FUSE_USE_VERSION  31
+#else
+#define FUSE_USE_VERSION  29
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -30,6 +47,8 @@
 #ifdef linux
 /* For pread()/pwrite() */
 #define _XOPEN_SOURCE 500
+/* For fallocate() */
+#define _GNU_SOURCE
 #endif
 
 #include "error_log.h"
@@ -41,22 +60,39 @@
 #include "jfs_key_cache.h"
 #include "jfs_meta_cache.h"
 #include "jfs_dynamic_paths.h"
+#include "jfs_pending.h"
+#include "jfs_checkpoint.h"
+#include "jfs_query_cache.h"
+#include "jfs_epoch.h"
+#include "jfs_stat_cache.h"
+#include "jfs_page_cache.h"
+#include "jfs_writeback.h"
+#include "jfs_uring.h"
+#include "jfs_prefetch.h"
 #include "thr_pool.h"
 #include "sqlitedb.h"
 #include "joinfs.h"
 
+#ifdef JFS_FUSE3
+#include "jfs_lowlevel.h"
+
+#include <fuse_lowlevel.h>
+#else
 #include <fuse.h>
+#include <ulockmgr.h>
+#endif
 #include <stdio.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <ulockmgr.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
 #include <sys/time.h>
 #include <sys/xattr.h>
+#include <stddef.h>
+#include <limits.h>
 
 struct jfs_context joinfs_context;
 
@@ -65,6 +101,33 @@ static thr_pool_t *jfs_write_pool;
 
 #define ABS_PATH_INC 512
 
+#define JFS_OPT(t, p, v) { t, offsetof(struct jfs_context, p), v }
+
+/*
+ * joinFS mount options, everything else is passed to FUSE.
+ */
+static struct fuse_opt jfs_opts[] = {
+  JFS_OPT("jfs_async", async_writes, 1),
+  JFS_OPT("jfs_wal", wal, 1),
+  JFS_OPT("wal_autocheckpoint=%d", wal_autocheckpoint, 0),
+  JFS_OPT("mmap_size=%lld", mmap_size, 0),
+  JFS_OPT("cache_size=%d", cache_size, 0),
+  JFS_OPT("datapath_cache=%d", datapath_cache_kb, 0),
+  JFS_OPT("meta_cache=%d", meta_cache_kb, 0),
+  JFS_OPT("stat_timeout=%d", stat_timeout_ms, 0),
+  JFS_OPT("attr_timeout=%lf", attr_timeout, 0),
+  JFS_OPT("entry_timeout=%lf", entry_timeout, 0),
+  JFS_OPT("jfs_page_cache", page_cache, 1),
+  JFS_OPT("max_write=%d", max_write, 0),
+  JFS_OPT("max_readahead=%d", max_readahead, 0),
+  JFS_OPT("jfs_writeback", writeback, 1),
+  JFS_OPT("writeback_size=%d", writeback_size, 0),
+  JFS_OPT("jfs_uring", uring, 1),
+  JFS_OPT("prefetch_max=%d", prefetch_max, 0),
+  FUSE_OPT_END
+};
+
+#ifndef JFS_FUSE3
 /*
  * Get a joinFS real path.
  *
@@ -95,6 +158,7 @@ jfs_realpath(const char *path)
   
   return jfs_path;
 }
+#endif
 
 /*
  * Perform a database read operation.
@@ -115,23 +179,54 @@ jfs_write_pool_queue(struct jfs_db_op *db_op)
 }
 
 /*
- * Initialize joinFS.
+ * Choose between direct and page cached I/O for a new handle.
  */
-static void * 
-jfs_init(struct fuse_conn_info *conn)
+void
+jfs_set_io_mode(struct fuse_file_info *fi, unsigned long long node)
+{
+  struct stat st;
+
+  if(!joinfs_context.page_cache) {
+    fi->direct_io = 1;
+
+    return;
+  }
+  fi->direct_io = 0;
+
+  //pages cached by an earlier open are still good if nobody changed the file
+  if(!fstat(fi->fh, &st)) {
+    fi->keep_cache = jfs_page_cache_keep(node, &st);
+  }
+}
+
+/*
+ * Start the caches, the database and the thread pools.
+ */
+void
+jfs_mount_init(unsigned proto_major, unsigned proto_minor)
 {
   struct sched_param param;
   pthread_attr_t wattr;
 
   log_init();
   log_msg("Starting joinFS. FUSE Major=%d Minor=%d\n",
-          conn->proto_major, conn->proto_minor);
+          proto_major, proto_minor);
 
   /* initialize caches */
+  jfs_epoch_init();
   jfs_dynamic_path_init();
   jfs_datapath_cache_init();
   jfs_key_cache_init();
   jfs_meta_cache_init();
+  jfs_stat_cache_init();
+  jfs_page_cache_init();
+  jfs_writeback_init(joinfs_context.writeback_size);
+  if(joinfs_context.uring) {
+    jfs_uring_init(JFS_URING_ENTRIES);
+  }
+  jfs_prefetch_init(joinfs_context.prefetch_max);
+  jfs_pending_init();
+  jfs_query_cache_init();
   jfs_init_db();
 
   jfs_read_pool = jfs_pool_create(JFS_THREAD_MIN, JFS_THREAD_MAX, 
@@ -158,21 +253,39 @@ jfs_init(struct fuse_conn_info *conn)
 
 	exit(EXIT_FAILURE);
   }
+
+  /* commit queued writes together */
+  jfs_pool_set_batch(jfs_write_pool, JFS_WRITE_BATCH);
+
+  /* autocheckpoints still run if this fails */
+  if(joinfs_context.wal && jfs_checkpoint_start(jfs_write_pool)) {
+    log_error("Failed to start the WAL checkpointer.\n");
+  }
   
   log_msg("joinFS Thread pools started.\n");
-  
-  return NULL;
 }
 
-static void 
-jfs_destroy(void *arg)
+/*
+ * Let queued writes land and tear everything down.
+ */
+void
+jfs_mount_destroy(void)
 {
+  struct jfs_datapath_cache_stats stats;
+  struct jfs_meta_cache_stats meta_stats;
+  struct jfs_stat_cache_stats stat_stats;
   int rc;
 
+  jfs_checkpoint_stop();
+
   /* stop all reads */
   jfs_pool_destroy(jfs_read_pool);
   
   /* let writes propogate */
+  rc = jfs_pending_flush(NULL);
+  if(rc) {
+    log_error("Queued writes failed before shutdown, error:%d\n", rc);
+  }
   jfs_pool_wait(jfs_write_pool);
   jfs_pool_destroy(jfs_write_pool);
 
@@ -181,29 +294,111 @@ jfs_destroy(void *arg)
 	log_error("SQLITE shutdown FAILED!!!\n");
   }
   
+  jfs_datapath_cache_get_stats(&stats);
+  log_msg("Datapath cache hits:%lu, misses:%lu, evictions:%lu\n",
+          stats.hits, stats.misses, stats.evictions);
   jfs_datapath_cache_destroy();
   jfs_key_cache_destroy();
+  jfs_meta_cache_get_stats(&meta_stats);
+  log_msg("Meta cache hits:%lu, negative hits:%lu, misses:%lu, evictions:%lu\n",
+          meta_stats.hits, meta_stats.negative_hits, meta_stats.misses, 
+          meta_stats.evictions);
   jfs_meta_cache_destroy();
+  jfs_stat_cache_get_stats(&stat_stats);
+  log_msg("Stat cache hits:%lu, misses:%lu, expired:%lu\n",
+          stat_stats.hits, stat_stats.misses, stat_stats.expired);
+  jfs_stat_cache_destroy();
+  jfs_page_cache_destroy();
+  jfs_writeback_destroy();
+  jfs_uring_destroy();
+  jfs_prefetch_destroy();
+  jfs_pending_destroy();
+  jfs_query_cache_destroy();
   jfs_dynamic_hierarchy_destroy();
+  jfs_epoch_destroy();
 
   free(joinfs_context.querypath);
   free(joinfs_context.mountpath);
   free(joinfs_context.logpath);
   free(joinfs_context.dbpath);
 
-  log_msg("joinFS shutdown completed successfully.\n", arg);
+  log_msg("joinFS shutdown completed successfully.\n");
   log_destroy();
 }
 
+#ifndef JFS_FUSE3
+/*
+ * Drop the cached attributes of a file changed through its handle.
+ */
+static void
+jfs_stat_invalidate(const char *path)
+{
+  char jfs_path[PATH_MAX];
+  int rc;
+
+  //unlinked files have no path left to cache
+  if(!path) {
+    return;
+  }
+
+  rc = snprintf(jfs_path, sizeof(jfs_path), "%s%s", joinfs_context.querypath, path);
+  if(rc < (int)sizeof(jfs_path)) {
+    jfs_stat_cache_remove(jfs_path);
+  }
+}
+
+/*
+ * Write out coalesced writes before the backing file is used directly.
+ */
+static int
+jfs_writeback_sync(struct fuse_file_info *fi)
+{
+  if(!joinfs_context.writeback) {
+    return 0;
+  }
+
+  return jfs_writeback_flush(fi->fh);
+}
+
+/*
+ * Initialize joinFS.
+ */
+static void * 
+jfs_init(struct fuse_conn_info *conn)
+{
+  jfs_mount_init(conn->proto_major, conn->proto_minor);
+
+  return NULL;
+}
+
+static void 
+jfs_destroy(void *arg)
+{
+  (void) arg;
+
+  jfs_mount_destroy();
+}
+
 static int 
 jfs_getattr(const char *path, struct stat *stbuf)
 {
-  char *jfs_path;
+  char jfs_path[PATH_MAX];
   int rc;
   
-  jfs_path = jfs_realpath(path);
+  //hottest call, so build the path on the stack
+  rc = snprintf(jfs_path, sizeof(jfs_path), "%s%s", joinfs_context.querypath, path);
+  if(rc >= (int)sizeof(jfs_path)) {
+    return -ENAMETOOLONG;
+  }
+
   rc = jfs_file_getattr(jfs_path, stbuf);
-  free(jfs_path);
+
+  //writes still buffered by open handles change the size
+  if(!rc && joinfs_context.writeback && S_ISREG(stbuf->st_mode)
+     && jfs_writeback_flush_file(stbuf->st_dev, stbuf->st_ino)) {
+    jfs_stat_cache_remove(jfs_path);
+    rc = jfs_file_getattr(jfs_path, stbuf);
+  }
 
   if(rc) {
     if(rc != -ENOENT) {
@@ -333,7 +528,7 @@ jfs_create(const char *path, mode_t mode, struct fuse_file_info *fi)
   }
 
   fi->fh = fd;
-  fi->direct_io = 1;
+  jfs_set_io_mode(fi, jfs_page_cache_node(path));
 
   return 0;
 }
@@ -555,6 +750,7 @@ jfs_utimens(const char *path, const struct timespec ts[2])
 
   jfs_path = jfs_realpath(path);
   rc = utimes(jfs_path, tv);
+  jfs_stat_cache_remove(jfs_path);
   free(jfs_path);
 
   if(rc) {
@@ -581,7 +777,7 @@ jfs_open(const char *path, struct fuse_file_info *fi)
   }
 
   fi->fh = fd;
-  fi->direct_io = 1;
+  jfs_set_io_mode(fi, jfs_page_cache_node(path));
 
   return 0;
 }
@@ -593,11 +789,25 @@ jfs_read(const char *path, char *buf, size_t size, off_t offset,
   int rc;
 
   (void) path;
+
+  rc = jfs_writeback_sync(fi);
+  if(rc) {
+    return rc;
+  }
+  jfs_prefetch_read(fi->fh, offset, size);
   
-  rc = pread(fi->fh, buf, size, offset);
-  if(rc == -1) {
-	log_error("jfs_read---error:%d\n", -errno);
-    return -errno;
+  if(joinfs_context.uring) {
+    rc = jfs_uring_pread(fi->fh, buf, size, offset);
+  }
+  else {
+    rc = pread(fi->fh, buf, size, offset);
+    if(rc == -1) {
+      rc = -errno;
+    }
+  }
+  if(rc < 0) {
+	log_error("jfs_read---error:%d\n", rc);
+    return rc;
   }
 
   return rc;
@@ -610,13 +820,139 @@ jfs_write(const char *path, const char *buf, size_t size,
   int rc;
   
   (void) path;
-  
-  rc = pwrite(fi->fh, buf, size, offset);
-  if (rc == -1) {
-	log_error("jfs_write---error:%d\n", -errno);
-    return -errno;
+
+  if(joinfs_context.writeback) {
+    rc = jfs_writeback_write(fi->fh, buf, size, offset);
+  }
+  else if(joinfs_context.uring) {
+    rc = jfs_uring_pwrite(fi->fh, buf, size, offset);
+  }
+  else {
+    rc = pwrite(fi->fh, buf, size, offset);
+    if(rc == -1) {
+      rc = -errno;
+    }
+  }
+  if(rc < 0) {
+	log_error("jfs_write---error:%d\n", rc);
+    return rc;
+  }
+  jfs_stat_invalidate(path);
+
+  return rc;
+}
+
+/*
+ * Read into memory through the io_uring engine.
+ */
+static int
+jfs_read_uring(struct fuse_bufvec **bufp, size_t size, off_t offset,
+               struct fuse_file_info *fi)
+{
+  struct fuse_bufvec *src;
+  ssize_t rc;
+
+  src = malloc(sizeof(*src));
+  if(!src) {
+    return -ENOMEM;
+  }
+  *src = FUSE_BUFVEC_INIT(size);
+
+  src->buf[0].mem = malloc(size);
+  if(!src->buf[0].mem) {
+    free(src);
+    return -ENOMEM;
+  }
+
+  rc = jfs_uring_pread(fi->fh, src->buf[0].mem, size, offset);
+  if(rc < 0) {
+    log_error("jfs_read_buf---error:%d\n", (int)rc);
+    free(src->buf[0].mem);
+    free(src);
+    return rc;
+  }
+  src->buf[0].size = rc;
+
+  *bufp = src;
+
+  return 0;
+}
+
+/*
+ * Hand FUSE the backing file instead of the data, so it
+ * can splice straight from the file to /dev/fuse.
+ */
+static int
+jfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+             off_t offset, struct fuse_file_info *fi)
+{
+  struct fuse_bufvec *src;
+
+  int rc;
+
+  (void) path;
+
+  rc = jfs_writeback_sync(fi);
+  if(rc) {
+    return rc;
+  }
+  jfs_prefetch_read(fi->fh, offset, size);
+
+  if(joinfs_context.uring) {
+    return jfs_read_uring(bufp, size, offset, fi);
   }
 
+  src = malloc(sizeof(*src));
+  if(!src) {
+    return -ENOMEM;
+  }
+
+  *src = FUSE_BUFVEC_INIT(size);
+  src->buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+  src->buf[0].fd = fi->fh;
+  src->buf[0].pos = offset;
+
+  *bufp = src;
+
+  return 0;
+}
+
+/*
+ * Copy the request straight into the backing file, spliced
+ * from /dev/fuse when the kernel allows it.
+ */
+static int
+jfs_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset,
+              struct fuse_file_info *fi)
+{
+  struct fuse_bufvec dst = FUSE_BUFVEC_INIT(fuse_buf_size(buf));
+  ssize_t rc;
+
+  dst.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+  dst.buf[0].fd = fi->fh;
+  dst.buf[0].pos = offset;
+
+  //small writes are gathered in memory, anything else goes straight out
+  if(joinfs_context.writeback && buf->count == 1
+     && !(buf->buf[0].flags & FUSE_BUF_IS_FD)) {
+    rc = jfs_writeback_write(fi->fh, buf->buf[0].mem, buf->buf[0].size, offset);
+  }
+  else if(joinfs_context.uring && buf->count == 1
+          && !(buf->buf[0].flags & FUSE_BUF_IS_FD)) {
+    rc = jfs_uring_pwrite(fi->fh, buf->buf[0].mem, buf->buf[0].size, offset);
+  }
+  else {
+    rc = jfs_writeback_sync(fi);
+    if(!rc) {
+      rc = fuse_buf_copy(&dst, buf, FUSE_BUF_SPLICE_NONBLOCK);
+    }
+  }
+  if(rc < 0) {
+	log_error("jfs_write_buf---error:%d\n", (int)rc);
+    return rc;
+  }
+  jfs_stat_invalidate(path);
+
   return rc;
 }
 
@@ -642,22 +978,57 @@ static int
 jfs_fsync(const char *path, int isdatasync,
 		  struct fuse_file_info *fi)
 {
+  char *jfs_path;
   int rc;
 
-  (void) path;
+  rc = jfs_writeback_sync(fi);
+  if(rc) {
+    log_error("jfs_fsync---path:%s, buffered write error:%d\n", path, rc);
+    return rc;
+  }
+
+  if(joinfs_context.uring) {
+    rc = jfs_uring_fsync(fi->fh, isdatasync);
+  }
+  else {
 #ifndef HAVE_FDATASYNC
-  (void) isdatasync;
+    (void) isdatasync;
   
 #else
-  if(isdatasync)
-	rc = fdatasync(fi->fh);
-  else
+    if(isdatasync)
+      rc = fdatasync(fi->fh);
+    else
 #endif
-	rc = fsync(fi->fh);
+      rc = fsync(fi->fh);
+
+    if(rc < 0) {
+      rc = -errno;
+    }
+  }
 
   if(rc < 0) {
-    log_error("jfs_fsync---path:%s, error:%d\n", path, -errno);
-	return -errno;
+    log_error("jfs_fsync---path:%s, error:%d\n", path, rc);
+	return rc;
+  }
+
+  /* the file's metadata must be on disk too */
+  if(joinfs_context.async_writes) {
+    //an unlinked file has no path left to report failures for
+    if(!path) {
+      rc = jfs_pending_flush("");
+    }
+    else {
+      jfs_path = jfs_realpath(path);
+      if(!jfs_path) {
+        return -ENOMEM;
+      }
+      rc = jfs_pending_flush(jfs_path);
+      free(jfs_path);
+    }
+    if(rc) {
+      log_error("jfs_fsync---path:%s, queued write error:%d\n", path, rc);
+      return rc;
+    }
   }
 
   return 0;
@@ -739,8 +1110,19 @@ jfs_removexattr(const char *path, const char *name)
 static int
 jfs_release(const char *path, struct fuse_file_info *fi)
 {
-  (void) path;
+  struct stat st;
+
+  //close reported any error through flush already
+  if(joinfs_context.writeback) {
+    jfs_writeback_release(fi->fh);
+  }
+  jfs_prefetch_release(fi->fh);
 
+  //our own writes went through this node's page cache, so it is still current
+  if(joinfs_context.page_cache && path && (fi->flags & O_ACCMODE) != O_RDONLY
+     && !fstat(fi->fh, &st)) {
+    jfs_page_cache_update(jfs_page_cache_node(path), &st);
+  }
   close(fi->fh);
 
   return 0;
@@ -764,6 +1146,11 @@ jfs_fgetattr(const char *path, struct stat *stbuf,
 
 	(void) path;
 
+	rc = jfs_writeback_sync(fi);
+	if(rc) {
+      return rc;
+    }
+
 	rc = fstat(fi->fh, stbuf);
 	if(rc) {
       return -errno;
@@ -776,31 +1163,77 @@ static int
 jfs_ftruncate(const char *path, off_t size,
               struct fuse_file_info *fi)
 {
-	int rc;
+  int rc;
 
-	(void) path;
+  rc = jfs_writeback_sync(fi);
+  if(rc) {
+    return rc;
+  }
 
-	rc = ftruncate(fi->fh, size);
-	if(rc) {
-      return -errno;
-    }
+  rc = ftruncate(fi->fh, size);
+  if(rc) {
+    return -errno;
+  }
+  jfs_stat_invalidate(path);
 
-	return 0;
+  return 0;
+}
+
+/*
+ * Preallocate or punch out extents of the backing file.
+ */
+static int
+jfs_fallocate(const char *path, int mode, off_t offset, off_t length,
+              struct fuse_file_info *fi)
+{
+  int rc;
+
+  rc = jfs_writeback_sync(fi);
+  if(rc) {
+    return rc;
+  }
+
+#ifdef linux
+  rc = fallocate(fi->fh, mode, offset, length);
+  if(rc) {
+    return -errno;
+  }
+#else
+  //only plain preallocation is portable
+  if(mode) {
+    return -EOPNOTSUPP;
+  }
+
+  rc = posix_fallocate(fi->fh, offset, length);
+  if(rc) {
+    return -rc;
+  }
+#endif
+  jfs_stat_invalidate(path);
+
+  return 0;
 }
 
 static int 
 jfs_flush(const char *path, struct fuse_file_info *fi)
 {
-	int rc;
+  int rc;
 
-	(void) path;
-	
-	rc = close(dup(fi->fh));
-	if(rc) {
-      return -errno;
+  //close(2) is where buffered write errors are reported
+  if(joinfs_context.writeback) {
+    rc = jfs_writeback_flush(fi->fh);
+    if(rc) {
+      return rc;
     }
+    jfs_stat_invalidate(path);
+  }
 
-	return 0;
+  rc = close(dup(fi->fh));
+  if(rc) {
+    return -errno;
+  }
+
+  return 0;
 }
 
 static struct fuse_operations jfs_oper = {
@@ -827,6 +1260,8 @@ static struct fuse_operations jfs_oper = {
   .open		    = jfs_open,
   .read		    = jfs_read,
   .write        = jfs_write,
+  .read_buf     = jfs_read_buf,
+  .write_buf    = jfs_write_buf,
   .statfs       = jfs_statfs,
   .fsync        = jfs_fsync,
   .init         = jfs_init,
@@ -838,22 +1273,40 @@ static struct fuse_operations jfs_oper = {
   .release      = jfs_release,
   .lock         = jfs_lock,
   .flush        = jfs_flush,
+  .fallocate    = jfs_fallocate,
 
   .flag_nullpath_ok = 1,
 };
+#endif
 
 int 
 main(int argc, char *argv[])
 {
+  struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+
+#ifndef JFS_FUSE3
+  char timeouts[64];
+  char io_sizes[96];
+#endif
+
   size_t length;
 
   int i;
+  int j;
   int rc;
   
-  for(i = 1; (i < argc) && (argv[i][0] == '-'); i++);
+  for(i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+    //the value of a -o option is its own argument
+    if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      i++;
+    }
+  }
 
   if((argc - i) < 4) {
-	printf("format: joinfs querypath mountpath logpath dbpath\n");
+	printf("format: joinfs [-o jfs_async,jfs_wal,wal_autocheckpoint=N,mmap_size=N,cache_size=N,datapath_cache=KB,meta_cache=KB,"
+           "stat_timeout=MS,attr_timeout=S,entry_timeout=S,jfs_page_cache,max_write=N,max_readahead=N,"
+           "jfs_writeback,writeback_size=N,jfs_uring,prefetch_max=N] "
+           "querypath mountpath logpath dbpath\n");
     exit(EXIT_FAILURE);
   }
 
@@ -879,11 +1332,58 @@ main(int argc, char *argv[])
   }
   strncpy(joinfs_context.dbpath, argv[i + 3], length);
   
-  argc = 2;
-  argv[1] = joinfs_context.mountpath;
+  joinfs_context.wal_autocheckpoint = JFS_WAL_AUTOCHECKPOINT;
+  joinfs_context.datapath_cache_kb = JFS_DATAPATH_CACHE_KB;
+  joinfs_context.meta_cache_kb = JFS_META_CACHE_KB;
+  joinfs_context.stat_timeout_ms = JFS_STAT_TIMEOUT_MS;
+  joinfs_context.attr_timeout = JFS_ATTR_TIMEOUT;
+  joinfs_context.entry_timeout = JFS_ENTRY_TIMEOUT;
+  joinfs_context.max_write = JFS_MAX_WRITE;
+  joinfs_context.max_readahead = JFS_MAX_READAHEAD;
+  joinfs_context.writeback_size = JFS_WRITEBACK_SIZE;
+  joinfs_context.prefetch_max = JFS_PREFETCH_MAX;
+
+  /* options before the paths go to FUSE, minus our own */
+  fuse_opt_add_arg(&args, argv[0]);
+  for(j = 1; j < i; j++) {
+    fuse_opt_add_arg(&args, argv[j]);
+  }
+  fuse_opt_add_arg(&args, joinfs_context.mountpath);
+
+  if(fuse_opt_parse(&args, &joinfs_context, jfs_opts, NULL) == -1) {
+    printf("joinFS failed to parse its mount options.\n");
+    exit(EXIT_FAILURE);
+  }
+
+#ifdef JFS_FUSE3
+  /* the low-level backend hands its tuning to the kernel itself */
+  printf("Starting joinFS, mounted at: %s\n", joinfs_context.mountpath);
+  rc = jfs_lowlevel_main(&args);
+#else
+  /* the kernel caches attributes and lookups as long as we say */
+  snprintf(timeouts, sizeof(timeouts), "-oattr_timeout=%g,entry_timeout=%g",
+           joinfs_context.attr_timeout, joinfs_context.entry_timeout);
+  fuse_opt_add_arg(&args, timeouts);
+
+  /* large requests matter most once reads go through the page cache */
+  snprintf(io_sizes, sizeof(io_sizes), "-obig_writes,max_write=%d,max_readahead=%d",
+           joinfs_context.max_write, joinfs_context.max_readahead);
+  fuse_opt_add_arg(&args, io_sizes);
+
+  /* let read_buf and write_buf splice instead of copying,
+     coalesced writes and io_uring need the data in memory */
+  if(!joinfs_context.uring) {
+    fuse_opt_add_arg(&args, joinfs_context.writeback ? "-osplice_read"
+                     : "-osplice_read,splice_write");
+  }
+
+  /* readdir fills in real attributes, keep its inode numbers */
+  fuse_opt_add_arg(&args, "-ouse_ino");
   
-  printf("Starting joinFS, mounted at: %s\n", argv[1]);
-  rc = fuse_main(argc, argv, &jfs_oper, NULL);;
+  printf("Starting joinFS, mounted at: %s\n", joinfs_context.mountpath);
+  rc = fuse_main(args.argc, args.argv, &jfs_oper, NULL);
+#endif
+  fuse_opt_free_args(&args);
 
   if(rc) {
     printf("joinFS start up failed. FUSE error code=%d.\n", rc);
@@ -48,6 +48,12 @@ CREATE TABLE keys(keyid INTEGER PRIMARY KEY AUTOINCREMENT,
 CREATE TABLE metadata(jfs_id INTEGER NOT NULL,
 					  keyid INTEGER NOT NULL,
 					  keyvalue TEXT NOT NULL,
-					  FOREIGN KEY(jfs_id) REFERENCES files(jfs_id) ON DELETE CASCADE ON UPDATE CASCADE,
+					  FOREIGN KEY(jfs_id) REFERENCES links(jfs_id) ON DELETE CASCADE ON UPDATE CASCADE,
 					  FOREIGN KEY(keyid) REFERENCES keys(keyid) ON DELETE RESTRICT ON UPDATE CASCADE,
-					  PRIMARY KEY(jfs_id, keyid));
+					  PRIMARY KEY(jfs_id, keyid)) WITHOUT ROWID;
+
+CREATE INDEX links_inode ON links(inode);
+CREATE INDEX metadata_keyid_value ON metadata(keyid, keyvalue, jfs_id);
+
+-- keep in step with the migrations in jfs_schema.c
+PRAGMA user_version=2;
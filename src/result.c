@@ -99,7 +99,7 @@ jfs_do_meta_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
   row = malloc(sizeof(*row));
   if(!row) {
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	return -ENOMEM;
   }
 
@@ -110,7 +110,7 @@ jfs_do_meta_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
 	row->value = malloc(sizeof(*row->value) * value_len);
 	if(!row->value) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  free(row);
 	  return -ENOMEM;
 	}
@@ -122,7 +122,7 @@ jfs_do_meta_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	free(row);
   }
 
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 /*
@@ -137,7 +137,7 @@ jfs_do_key_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
   row = malloc(sizeof(*row));
   if(!row) {
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	return -ENOMEM;
   }
 
@@ -152,7 +152,7 @@ jfs_do_key_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	free(row);
   }
 
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 /*
@@ -170,7 +170,7 @@ jfs_do_datapath_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
   row = malloc(sizeof(*row));
   if(!row) {
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	return -ENOMEM;
   }
 
@@ -181,7 +181,7 @@ jfs_do_datapath_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
 	row->datapath = malloc(sizeof(*row->datapath) * datapath_len);
 	if(!row->datapath) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  free(row);
 	  return -ENOMEM;
 	}
@@ -193,7 +193,7 @@ jfs_do_datapath_cache_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	free(row);
   }
 
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 static int
@@ -214,7 +214,7 @@ jfs_do_readdir_op(jfs_list_t **result, sqlite3_stmt *stmt)
   while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
 	row = malloc(sizeof(*row));
 	if(!row) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  jfs_list_destroy(head, jfs_listattr_op);
 	  return -ENOMEM;
 	}
@@ -230,7 +230,7 @@ jfs_do_readdir_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	  
 	  row->filename = malloc(sizeof(*row->filename) * filename_len);
 	  if(!row->filename) {
-		sqlite3_finalize(stmt);
+		sqlite3_reset(stmt);
 		jfs_list_destroy(head, jfs_readdir_op);
 		return -ENOMEM;
 	  }
@@ -243,7 +243,7 @@ jfs_do_readdir_op(jfs_list_t **result, sqlite3_stmt *stmt)
 
 	  row->filename = malloc(sizeof(*row->filename) * filename_len);
 	  if(!row->filename) {
-		sqlite3_finalize(stmt);
+		sqlite3_reset(stmt);
 		jfs_list_destroy(head, jfs_readdir_op);
 		return -ENOMEM;
 	  }
@@ -254,7 +254,7 @@ jfs_do_readdir_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	  
       row->datapath = malloc(sizeof(*row->datapath) * datapath_len);
       if(!row->datapath) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         jfs_list_destroy(head, jfs_readdir_op);
         return -ENOMEM;
       }
@@ -268,7 +268,7 @@ jfs_do_readdir_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	*result = head;
   }
   
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 /* 
@@ -292,7 +292,7 @@ jfs_do_listattr_op(jfs_list_t **result, sqlite3_stmt *stmt, size_t *buff_size)
   while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
 	row = malloc(sizeof(*row));
 	if(!row) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  jfs_list_destroy(head, jfs_listattr_op);
 	  return -ENOMEM;
 	}
@@ -304,7 +304,7 @@ jfs_do_listattr_op(jfs_list_t **result, sqlite3_stmt *stmt, size_t *buff_size)
 	row->keyid = keyid;
 	row->key = malloc(sizeof(*row->key) * key_len);
 	if(!row->key) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  jfs_list_destroy(head, jfs_listattr_op);
 	  return -ENOMEM;
 	}
@@ -320,7 +320,7 @@ jfs_do_listattr_op(jfs_list_t **result, sqlite3_stmt *stmt, size_t *buff_size)
 	*buff_size = buffer_size;
   }
   
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 /*
@@ -336,7 +336,7 @@ jfs_do_dynamic_file_op(jfs_list_t **result, sqlite3_stmt *stmt)
   while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
 	row = malloc(sizeof(*row));
 	if(!row) {
-	  sqlite3_finalize(stmt);
+	  sqlite3_reset(stmt);
 	  jfs_list_destroy(head, jfs_dynamic_file_op);
 	  return -ENOMEM;
 	}
@@ -349,7 +349,7 @@ jfs_do_dynamic_file_op(jfs_list_t **result, sqlite3_stmt *stmt)
 	*result = head;
   }
 
-  return sqlite3_finalize(stmt);
+  return sqlite3_reset(stmt);
 }
 
 /*
@@ -361,7 +361,7 @@ jfs_do_write_op(sqlite3_stmt *stmt)
   int rc;
 
   sqlite3_step(stmt);
-  rc = sqlite3_finalize(stmt);
+  rc = sqlite3_reset(stmt);
   if(rc) {
 	return rc;
   }
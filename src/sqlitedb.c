@@ -26,6 +26,8 @@
 #include "sqlitedb.h"
 #include "result.h"
 #include "joinfs.h"
+#include "jfs_schema.h"
+#include "jfs_key_cache.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -37,8 +39,36 @@
 
 #define ERR_MAX 256
 
+/*
+ * SQL for the cached statements, indexed by enum jfs_db_stmts.
+ */
+static const char *jfs_db_stmts_sql[jfs_num_stmts] = {
+  "INSERT INTO links VALUES(NULL,?1,?2,?3);",
+  "SELECT keyvalue FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=?1) AND keyid=?2;",
+  "SELECT keyid FROM keys WHERE keytext=?1;",
+  "SELECT k.keyid, k.keytext FROM keys AS k, metadata AS m WHERE k.keyid=m.keyid AND m.jfs_id=(SELECT jfs_id FROM links WHERE path=?1);",
+  "DELETE FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=?1);",
+  "DELETE FROM links WHERE path=?1;",
+  "UPDATE links SET path=?1, filename=?2 WHERE path=?3;",
+  "UPDATE metadata SET jfs_id=(SELECT jfs_id FROM links WHERE path=?1) WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=?2);",
+  "INSERT INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=?1),?2,?3);",
+  "REPLACE INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=?1),?2,?3);",
+  "INSERT OR REPLACE INTO metadata VALUES((SELECT jfs_id FROM links WHERE path=?1),?2,?3);",
+  "DELETE FROM metadata WHERE jfs_id=(SELECT jfs_id FROM links WHERE path=?1) AND keyid=?2;",
+  "INSERT OR IGNORE INTO keys VALUES(NULL,?1);",
+  "SELECT path FROM links WHERE jfs_id=?1;"
+};
+
 //does not need to be public, prepares queries
 static int setup_stmt(sqlite3 *db, sqlite3_stmt **stmt, const char* query);
+static int jfs_query_bound(struct jfs_db_op *db_op);
+static struct jfs_db_arg *jfs_db_op_next_arg(struct jfs_db_op *db_op);
+static int jfs_db_bind_stmt(sqlite3 *db, sqlite3_stmt **stmt_cache, 
+                            struct jfs_db_bound *bound, sqlite3_stmt **stmt);
+static int jfs_db_pragma(sqlite3 *db, const char *pragma, sqlite3_int64 value);
+static int jfs_db_setup(void);
+static int jfs_db_set_journal(sqlite3 *db);
+static int jfs_db_load_keys(sqlite3 *db);
 
 void
 jfs_init_db(void)
@@ -62,9 +92,164 @@ jfs_init_db(void)
 	exit(EXIT_FAILURE);
   }
 
+  rc = jfs_db_setup();
+  if(rc) {
+	log_error("Failed to set up the database, error:%d.\n", rc);
+    log_destroy();
+
+	exit(EXIT_FAILURE);
+  }
+
   log_msg("SQLite started.\n");
 }
 
+/*
+ * Prepare the database file before the pools start.
+ */
+static int
+jfs_db_setup(void)
+{
+  sqlite3 *db;
+
+  int rc;
+
+  rc = sqlite3_open_v2(joinfs_context.dbpath, &db, SQLITE_OPEN_READWRITE, NULL);
+  if(rc) {
+    sqlite3_close(db);
+
+    return rc;
+  }
+  sqlite3_busy_timeout(db, JFS_DB_BUSY_TIMEOUT);
+
+  rc = jfs_db_set_journal(db);
+  if(rc) {
+    sqlite3_close(db);
+
+    return rc;
+  }
+
+  rc = jfs_schema_migrate(db);
+  if(rc) {
+    sqlite3_close(db);
+
+    return rc;
+  }
+
+  rc = jfs_db_load_keys(db);
+  sqlite3_close(db);
+
+  return rc;
+}
+
+/*
+ * Fill the key cache with every key in the database.
+ */
+static int
+jfs_db_load_keys(sqlite3 *db)
+{
+  sqlite3_stmt *stmt;
+  const unsigned char *keytext;
+
+  int num_keys;
+  int rc;
+
+  rc = sqlite3_prepare_v2(db, "SELECT keyid, keytext FROM keys;", -1, &stmt, NULL);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+
+  num_keys = 0;
+  while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    keytext = sqlite3_column_text(stmt, 1);
+    if(!keytext) {
+      continue;
+    }
+
+    rc = jfs_key_cache_add(sqlite3_column_int(stmt, 0), (const char *)keytext);
+    if(rc) {
+      sqlite3_finalize(stmt);
+
+      return rc;
+    }
+    ++num_keys;
+  }
+  sqlite3_finalize(stmt);
+
+  if(rc != SQLITE_DONE) {
+    return rc;
+  }
+  log_msg("Loaded %d keys.\n", num_keys);
+
+  return 0;
+}
+
+/*
+ * Set the journal mode once for the database file.
+ *
+ * WAL is persistent, so read only connections can not
+ * change it and it must be set before the pools start.
+ */
+static int
+jfs_db_set_journal(sqlite3 *db)
+{
+  sqlite3_stmt *stmt;
+
+  const char *mode;
+  int rc;
+
+  if(joinfs_context.wal) {
+    rc = setup_stmt(db, &stmt, "PRAGMA journal_mode=WAL;");
+  }
+  else {
+    rc = setup_stmt(db, &stmt, "PRAGMA journal_mode=truncate;");
+  }
+  if(rc) {
+    return rc;
+  }
+
+  rc = sqlite3_step(stmt);
+  if(rc != SQLITE_ROW) {
+    sqlite3_finalize(stmt);
+
+    return rc;
+  }
+
+  //not every file system can hold a WAL
+  mode = (const char *)sqlite3_column_text(stmt, 0);
+  if(joinfs_context.wal && (!mode || strcmp(mode, "wal") != 0)) {
+    log_error("WAL is not available, journal mode is %s.\n", mode ? mode : "unknown");
+    joinfs_context.wal = 0;
+  }
+  sqlite3_finalize(stmt);
+
+  if(joinfs_context.wal) {
+    log_msg("SQLite journal mode is WAL.\n");
+  }
+
+  return 0;
+}
+
+/*
+ * Set an integer pragma on a connection.
+ */
+static int
+jfs_db_pragma(sqlite3 *db, const char *pragma, sqlite3_int64 value)
+{
+  char *query;
+
+  int rc;
+
+  query = sqlite3_mprintf("PRAGMA %s=%lld;", pragma, value);
+  if(!query) {
+    return SQLITE_NOMEM;
+  }
+
+  rc = sqlite3_exec(db, query, NULL, NULL, NULL);
+  sqlite3_free(query);
+
+  return rc;
+}
+
 /*
  * Creates a database operation.
  */
@@ -128,12 +313,15 @@ jfs_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, const char *form
   
   db_op->op = jfs_op;
   db_op->query = query;
-  db_op->multi_query = NULL;
   db_op->db = NULL;
   db_op->stmt = NULL;
+  db_op->stmt_cache = NULL;
+  db_op->num_bound = 0;
   db_op->result = NULL;
   db_op->done = 0;
   db_op->rc = 0;
+  db_op->callback = NULL;
+  db_op->callback_arg = NULL;
 
   pthread_cond_init(&db_op->cond, NULL);
   pthread_mutex_init(&db_op->mut, NULL);
@@ -144,48 +332,32 @@ jfs_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, const char *form
 }
 
 /*
- * Create a multi-write operation.
+ * Create a database operation for a cached statement.
  */
-int jfs_db_op_create_multi_op(struct jfs_db_op **op, int num_queries,...)
+int
+jfs_db_op_create_stmt(struct jfs_db_op **op, enum jfs_db_ops jfs_op, enum jfs_db_stmts stmt_id)
 {
   struct jfs_db_op *db_op;
 
-  char *query;
-
-  va_list args;
-
-  int i;
-
   db_op = malloc(sizeof(*db_op));
   if(!db_op) {
     return -ENOMEM;
   }
 
-  db_op->multi_query = malloc(sizeof(*db_op->multi_query) * num_queries);
-  if(!db_op->multi_query) {
-    free(db_op);
-    return -ENOMEM;
-  }
-
-  va_start(args, num_queries);
-  for(i = 0; i < num_queries; ++i) {
-    query = va_arg(args, char *);
-    if(!query) {
-      free(db_op);
-      return -EINVAL;
-    }
-
-    db_op->multi_query[i] = query;
-  }
-
-  db_op->op = jfs_multi_write_op;
+  db_op->op = jfs_op;
   db_op->query = NULL;
   db_op->db = NULL;
   db_op->stmt = NULL;
+  db_op->stmt_cache = NULL;
   db_op->result = NULL;
-  db_op->num_queries = num_queries;
   db_op->done = 0;
   db_op->rc = 0;
+  db_op->callback = NULL;
+  db_op->callback_arg = NULL;
+
+  db_op->num_bound = 1;
+  db_op->bound[0].stmt_id = stmt_id;
+  db_op->bound[0].num_args = 0;
 
   pthread_cond_init(&db_op->cond, NULL);
   pthread_mutex_init(&db_op->mut, NULL);
@@ -196,55 +368,110 @@ int jfs_db_op_create_multi_op(struct jfs_db_op **op, int num_queries,...)
 }
 
 /*
- * Create a db query using a format string.
+ * Add a cached statement to a multi-write operation.
  */
-int jfs_db_op_create_query(char **query, const char *format, ...)
+int
+jfs_db_op_add_stmt(struct jfs_db_op *db_op, enum jfs_db_stmts stmt_id)
 {
-  va_list args;
+  struct jfs_db_bound *bound;
 
-  char *new_query;
+  if(db_op->op != jfs_multi_write_op || db_op->num_bound >= JFS_DB_BOUND_MAX) {
+    return -EINVAL;
+  }
 
-  int query_size;
-  int rc;
+  bound = &db_op->bound[db_op->num_bound];
+  bound->stmt_id = stmt_id;
+  bound->num_args = 0;
+  ++db_op->num_bound;
 
-  rc = 0;
-  new_query = NULL;
-  query_size = JFS_QUERY_INC;
-  
-  new_query = malloc(sizeof(*new_query) * query_size);
-  if(!new_query) {
-    return -ENOMEM;
+  return 0;
+}
+
+/*
+ * Get the next free argument of the last added statement.
+ */
+static struct jfs_db_arg *
+jfs_db_op_next_arg(struct jfs_db_op *db_op)
+{
+  struct jfs_db_bound *bound;
+
+  if(!db_op->num_bound) {
+    return NULL;
   }
 
-  while(1) {
-    va_start(args, format);
-    rc = vsnprintf(new_query, query_size, format, args);
-    va_end(args);
-    
-    if(rc > -1 && rc < query_size) {
-      break;
-    }
-    else if(rc > -1) {
-      query_size = rc + 1;
-    }
-    else {
-      if(errno == EILSEQ) {
-        free(new_query);
+  bound = &db_op->bound[db_op->num_bound - 1];
+  if(bound->num_args >= JFS_DB_ARGS_MAX) {
+    return NULL;
+  }
 
-        return -errno;
-      }
-      
-      query_size += JFS_QUERY_INC;
-    }
-    
-    free(new_query);
-    new_query = malloc(sizeof(*new_query) * query_size);
-    if(!query) {
-      return -ENOMEM;
-    }
+  return &bound->args[bound->num_args++];
+}
+
+/*
+ * Bind an integer to the last added statement.
+ */
+int
+jfs_db_op_bind_int(struct jfs_db_op *db_op, int value)
+{
+  struct jfs_db_arg *arg;
+
+  arg = jfs_db_op_next_arg(db_op);
+  if(!arg) {
+    return -EINVAL;
   }
 
-  *query = new_query;
+  arg->type = jfs_db_arg_int;
+  arg->len = 0;
+  arg->val.int_val = value;
+
+  return 0;
+}
+
+/*
+ * Bind text to the last added statement.
+ */
+int
+jfs_db_op_bind_text(struct jfs_db_op *db_op, const char *text)
+{
+  return jfs_db_op_bind_text_len(db_op, text, -1);
+}
+
+/*
+ * Bind sized text to the last added statement.
+ */
+int
+jfs_db_op_bind_text_len(struct jfs_db_op *db_op, const char *text, int len)
+{
+  struct jfs_db_arg *arg;
+
+  arg = jfs_db_op_next_arg(db_op);
+  if(!arg) {
+    return -EINVAL;
+  }
+
+  arg->type = jfs_db_arg_text;
+  arg->len = len;
+  arg->val.text = text;
+
+  return 0;
+}
+
+/*
+ * Bind a blob to the last added statement.
+ */
+int
+jfs_db_op_bind_blob(struct jfs_db_op *db_op, const void *blob, int len)
+{
+  struct jfs_db_arg *arg;
+
+  arg = jfs_db_op_next_arg(db_op);
+  if(!arg) {
+    return -EINVAL;
+  }
+
+  arg->type = jfs_db_arg_blob;
+  arg->len = len;
+  arg->val.blob = blob;
 
   return 0;
 }
@@ -265,13 +492,15 @@ jfs_do_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, char *query)
 
   db_op->op = jfs_op;
   db_op->query = query;
-  db_op->multi_query = NULL;
   db_op->db = NULL;
   db_op->stmt = NULL;
+  db_op->stmt_cache = NULL;
+  db_op->num_bound = 0;
   db_op->result = NULL;
-  db_op->num_queries = 0;
   db_op->done = 0;
   db_op->rc = 0;
+  db_op->callback = NULL;
+  db_op->callback_arg = NULL;
 
   pthread_cond_init(&db_op->cond, NULL);
   pthread_mutex_init(&db_op->mut, NULL);
@@ -287,8 +516,6 @@ jfs_do_db_op_create(struct jfs_db_op **op, enum jfs_db_ops jfs_op, char *query)
 void
 jfs_db_op_destroy(struct jfs_db_op *db_op)
 {
-  int i;
-
   if(!db_op->rc) {
 	switch(db_op->op) {
     case(jfs_datapath_cache_op):
@@ -313,16 +540,7 @@ jfs_db_op_destroy(struct jfs_db_op *db_op)
 	}
   }
 
-  if(db_op->op == jfs_multi_write_op) {
-    for(i = 0; i < db_op->num_queries; ++i) {
-      free(db_op->multi_query[i]);
-    }
-    free(db_op->multi_query);
-  }
-  else {
-    free(db_op->query);
-  }
-
+  free(db_op->query);
   free(db_op);
 }
 
@@ -362,14 +580,18 @@ jfs_open_db(sqlite3 **db, int sqlite_attr)
       sqlite3_close(new_db);
     }
     
-    return 0;
+    return rc;
   }
+  sqlite3_busy_timeout(new_db, JFS_DB_BUSY_TIMEOUT);
   
-  rc = sqlite3_exec(new_db, "PRAGMA journal_mode=truncate;", NULL, NULL, NULL);
-  if(rc) {
-    sqlite3_close(new_db);
-
-    return rc;
+  //a WAL database keeps its journal mode
+  if(!joinfs_context.wal) {
+    rc = sqlite3_exec(new_db, "PRAGMA journal_mode=truncate;", NULL, NULL, NULL);
+    if(rc) {
+      sqlite3_close(new_db);
+      
+      return rc;
+    }
   }
   
   rc = sqlite3_exec(new_db, "PRAGMA synchronous=OFF;", NULL, NULL, NULL);
@@ -386,6 +608,33 @@ jfs_open_db(sqlite3 **db, int sqlite_attr)
     return rc;
   }
 
+  if(joinfs_context.mmap_size) {
+    rc = jfs_db_pragma(new_db, "mmap_size", joinfs_context.mmap_size);
+    if(rc) {
+      sqlite3_close(new_db);
+      
+      return rc;
+    }
+  }
+
+  if(joinfs_context.cache_size) {
+    rc = jfs_db_pragma(new_db, "cache_size", joinfs_context.cache_size);
+    if(rc) {
+      sqlite3_close(new_db);
+      
+      return rc;
+    }
+  }
+
+  if(joinfs_context.wal && (sqlite_attr & SQLITE_OPEN_READWRITE)) {
+    rc = jfs_db_pragma(new_db, "wal_autocheckpoint", joinfs_context.wal_autocheckpoint);
+    if(rc) {
+      sqlite3_close(new_db);
+      
+      return rc;
+    }
+  }
+
   *db = new_db;
   
   return 0;
@@ -400,6 +649,31 @@ jfs_close_db(sqlite3 *db)
   sqlite3_close(db);
 }
 
+/*
+ * Finalize the statements cached by a worker.
+ */
+void
+jfs_db_stmt_cache_destroy(sqlite3_stmt **stmt_cache)
+{
+  int i;
+
+  for(i = 0; i < jfs_num_stmts; ++i) {
+    if(stmt_cache[i]) {
+      sqlite3_finalize(stmt_cache[i]);
+      stmt_cache[i] = NULL;
+    }
+  }
+}
+
+/*
+ * Get the SQL text for a cached statement.
+ */
+const char *
+jfs_db_stmt_sql(enum jfs_db_stmts stmt_id)
+{
+  return jfs_db_stmts_sql[stmt_id];
+}
+
 /*
  * Setup a sqlite prepared statement.
  */
@@ -417,53 +691,199 @@ setup_stmt(sqlite3 *db, sqlite3_stmt **stmt, const char* query)
 }
 
 /*
- * Perform a query.
+ * Get a cached statement, preparing it on first use,
+ * and bind the operation's values to it.
  */
-int
-jfs_query(struct jfs_db_op *db_op)
+static int
+jfs_db_bind_stmt(sqlite3 *db, sqlite3_stmt **stmt_cache, 
+                 struct jfs_db_bound *bound, sqlite3_stmt **stmt)
 {
-  sqlite3_stmt *stmt;
-  
+  sqlite3_stmt *new_stmt;
+  struct jfs_db_arg *arg;
+
   int rc;
   int i;
 
-  if(db_op->op == jfs_multi_write_op) {
-    rc = sqlite3_exec(db_op->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+  new_stmt = stmt_cache[bound->stmt_id];
+  if(!new_stmt) {
+    rc = setup_stmt(db, &new_stmt, jfs_db_stmts_sql[bound->stmt_id]);
     if(rc) {
       return rc;
     }
+    stmt_cache[bound->stmt_id] = new_stmt;
+  }
 
-    for(i = 0; i < db_op->num_queries; ++i) {
-      rc = setup_stmt(db_op->db, &stmt, db_op->multi_query[i]);
-      if(rc) {
-        return rc;
-      }
+  for(i = 0; i < bound->num_args; ++i) {
+    arg = &bound->args[i];
 
-      db_op->stmt = stmt;
-      rc = jfs_db_result(db_op);
-      if(rc) {
-        sqlite3_exec(db_op->db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
-        return rc;
-      }
+    switch(arg->type) {
+    case(jfs_db_arg_int):
+      rc = sqlite3_bind_int(new_stmt, i + 1, arg->val.int_val);
+      break;
+    case(jfs_db_arg_text):
+      rc = sqlite3_bind_text(new_stmt, i + 1, arg->val.text, arg->len, SQLITE_STATIC);
+      break;
+    case(jfs_db_arg_blob):
+      rc = sqlite3_bind_blob(new_stmt, i + 1, arg->val.blob, arg->len, SQLITE_STATIC);
+      break;
+    default:
+      rc = SQLITE_MISUSE;
     }
 
-    rc = sqlite3_exec(db_op->db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
     if(rc) {
+      sqlite3_clear_bindings(new_stmt);
       return rc;
     }
   }
-  else {
-    rc = setup_stmt(db_op->db, &stmt, db_op->query);
+
+  *stmt = new_stmt;
+
+  return 0;
+}
+
+/*
+ * Perform a query made of cached statements.
+ */
+static int
+jfs_query_bound(struct jfs_db_op *db_op)
+{
+  sqlite3_stmt *local_cache[jfs_num_stmts];
+  sqlite3_stmt **stmt_cache;
+
+  int in_txn;
+  int rc;
+  int i;
+
+  //ops run outside of a pool worker get a throw away cache
+  stmt_cache = db_op->stmt_cache;
+  if(!stmt_cache) {
+    memset(local_cache, 0, sizeof(local_cache));
+    stmt_cache = local_cache;
+  }
+
+  //inside a group commit the op's savepoint already makes it atomic
+  in_txn = !sqlite3_get_autocommit(db_op->db);
+  if(db_op->op == jfs_multi_write_op && !in_txn) {
+    rc = sqlite3_exec(db_op->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
     if(rc) {
       return rc;
     }
-    
-    db_op->stmt = stmt;
+  }
+
+  rc = 0;
+  for(i = 0; i < db_op->num_bound; ++i) {
+    rc = jfs_db_bind_stmt(db_op->db, stmt_cache, &db_op->bound[i], &db_op->stmt);
+    if(rc) {
+      break;
+    }
+
     rc = jfs_db_result(db_op);
+    sqlite3_clear_bindings(db_op->stmt);
+    db_op->stmt = NULL;
+
     if(rc) {
-      return rc;
+      break;
     }
   }
 
+  if(db_op->op == jfs_multi_write_op && !in_txn) {
+    if(rc) {
+      sqlite3_exec(db_op->db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+    }
+    else {
+      rc = sqlite3_exec(db_op->db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+    }
+  }
+
+  if(stmt_cache == local_cache) {
+    jfs_db_stmt_cache_destroy(local_cache);
+  }
+
+  return rc;
+}
+
+/*
+ * Perform a query.
+ */
+int
+jfs_query(struct jfs_db_op *db_op)
+{
+  sqlite3_stmt *stmt;
+  
+  int rc;
+
+  if(db_op->num_bound) {
+    return jfs_query_bound(db_op);
+  }
+
+  rc = setup_stmt(db_op->db, &stmt, db_op->query);
+  if(rc) {
+    return rc;
+  }
+    
+  db_op->stmt = stmt;
+  rc = jfs_db_result(db_op);
+  sqlite3_finalize(stmt);
+  db_op->stmt = NULL;
+
+  if(rc) {
+    return rc;
+  }
+
   return 0;
 }
+
+/*
+ * Perform a group of queries in one transaction.
+ *
+ * Each query runs in its own savepoint so a failed query
+ * only rolls back its own changes. The queries' error codes
+ * are stored in their rc.
+ */
+int
+jfs_query_group(struct jfs_db_op **db_ops, int num_ops)
+{
+  sqlite3 *db;
+
+  int rc;
+  int i;
+
+  db = db_ops[0]->db;
+
+  rc = sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+  if(rc) {
+    for(i = 0; i < num_ops; ++i) {
+      db_ops[i]->rc = jfs_query(db_ops[i]);
+    }
+
+    return rc;
+  }
+
+  for(i = 0; i < num_ops; ++i) {
+    rc = sqlite3_exec(db, "SAVEPOINT jfs_op;", NULL, NULL, NULL);
+    if(rc) {
+      db_ops[i]->rc = rc;
+      continue;
+    }
+
+    db_ops[i]->rc = jfs_query(db_ops[i]);
+    if(db_ops[i]->rc) {
+      sqlite3_exec(db, "ROLLBACK TO jfs_op;", NULL, NULL, NULL);
+    }
+    sqlite3_exec(db, "RELEASE jfs_op;", NULL, NULL, NULL);
+  }
+
+  rc = sqlite3_exec(db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+  if(rc) {
+    sqlite3_exec(db, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+
+    //nothing in the group was written
+    for(i = 0; i < num_ops; ++i) {
+      if(!db_ops[i]->rc) {
+        db_ops[i]->rc = rc;
+      }
+    }
+  }
+
+  return rc;
+}
@@ -0,0 +1,147 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#include "jfs_dir_plan.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+
+#define TEST_FILES 1000
+#define TEST_DEPTH 4
+
+static const char *schema = 
+  "CREATE TABLE links(jfs_id INTEGER PRIMARY KEY AUTOINCREMENT, inode INTEGER NOT NULL,"
+  " path TEXT NOT NULL UNIQUE, filename TEXT NOT NULL);"
+  "CREATE TABLE metadata(jfs_id INTEGER NOT NULL, keyid INTEGER NOT NULL, keyvalue TEXT NOT NULL,"
+  " PRIMARY KEY(jfs_id, keyid)) WITHOUT ROWID;"
+  "CREATE INDEX metadata_keyid_value ON metadata(keyid, keyvalue, jfs_id);";
+
+static int failed;
+
+/*
+ * Run a planned query and check the number of rows.
+ */
+static void
+check_query(const char *name, struct jfs_dir_term *terms, int num_terms,
+            int folder_keyid, int expected, sqlite3 *db)
+{
+  sqlite3_stmt *stmt;
+  char *query;
+  int rows;
+  int rc;
+
+  rc = jfs_dir_plan_query(terms, num_terms, folder_keyid, &query);
+  if(rc) {
+    printf("--%s: plan failed, error:%d\n", name, rc);
+    failed = 1;
+    return;
+  }
+  printf("--%s: %s\n", name, query);
+
+  rc = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+  free(query);
+  if(rc) {
+    printf("--%s: prepare failed, %s\n", name, sqlite3_errmsg(db));
+    failed = 1;
+    return;
+  }
+
+  rows = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW) {
+    ++rows;
+  }
+  sqlite3_finalize(stmt);
+
+  if(rows != expected) {
+    printf("--%s: FAILED, %d rows, expected %d\n", name, rows, expected);
+    failed = 1;
+  }
+}
+
+int
+main(void)
+{
+  struct jfs_dir_term terms[TEST_DEPTH + 1];
+  sqlite3 *db;
+  char *sql;
+  int i;
+  int k;
+
+  printf("JFS_QUERY_BUILDER_TEST: START\n");
+
+  if(sqlite3_open(":memory:", &db)) {
+    printf("Failed to open the test database.\n");
+    return -1;
+  }
+  sqlite3_exec(db, schema, NULL, NULL, NULL);
+
+  /* file i has key k set to i % (k + 2) */
+  sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+  for(i = 0; i < TEST_FILES; ++i) {
+    sql = sqlite3_mprintf("INSERT INTO links VALUES(NULL, %d, '/f%d', 'f%d');", i, i, i);
+    sqlite3_exec(db, sql, NULL, NULL, NULL);
+    sqlite3_free(sql);
+
+    for(k = 1; k <= TEST_DEPTH; ++k) {
+      sql = sqlite3_mprintf("INSERT INTO metadata VALUES(%d, %d, '%d');", i + 1, k, i % (k + 2));
+      sqlite3_exec(db, sql, NULL, NULL, NULL);
+      sqlite3_free(sql);
+    }
+  }
+  sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+
+  /* the 3 values of key 1 */
+  check_query("folder keys", NULL, 0, 1, 3, db);
+
+  /* every file has key 1 */
+  terms[0].keyid = 1;
+  terms[0].value = NULL;
+  check_query("key files", terms, 1, 0, TEST_FILES, db);
+
+  /* files 0, 12, 24... have key 1 = 0 and key 2 = 0 */
+  terms[0].value = "0";
+  terms[1].keyid = 2;
+  terms[1].value = "0";
+  check_query("pair files", terms, 2, 0, (TEST_FILES + 11) / 12, db);
+
+  /* duplicate terms do not change the result */
+  terms[2] = terms[0];
+  check_query("duplicate terms", terms, 3, 0, (TEST_FILES + 11) / 12, db);
+
+  /* key 3 values under key 1 = 0, key 2 = 0 */
+  check_query("nested folders", terms, 2, 3, 5, db);
+
+  /* quotes in values are escaped */
+  terms[0].value = "it's";
+  check_query("quoted value", terms, 1, 0, 0, db);
+
+  /* listing files needs a constraint */
+  if(jfs_dir_plan_query(terms, 0, 0, &sql) == 0) {
+    printf("--empty plan: FAILED, no error returned\n");
+    failed = 1;
+  }
+
+  sqlite3_close(db);
+
+  printf("JFS_QUERY_BUILDER_TEST: %s\n", failed ? "FAILED" : "PASSED");
+
+  return failed;
+}
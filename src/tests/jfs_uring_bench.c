@@ -0,0 +1,310 @@
+/********************************************************************
+ * Copyright 2010, 2011 Matthew Harlan <mharlan@gwmail.gwu.edu>
+ *
+ * This file is part of joinFS.
+ *	 
+ * JoinFS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JoinFS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with joinFS.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************************/
+
+#if !defined(_REENTRANT)
+#define	_REENTRANT
+#endif
+
+#include "jfs_uring.h"
+#include "error_log.h"
+#include "joinfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_FILE_SIZE (64 * 1024 * 1024)
+#define BENCH_BLOCK     4096
+#define BENCH_OPS       20000
+#define BENCH_SYNC_EVERY 64
+#define BENCH_ENTRIES   256
+#define BENCH_DEPTH     64
+#define BENCH_DEEP_THREADS 2
+
+//the engine logs through error_log, which reads the log path from here
+struct jfs_context joinfs_context;
+
+struct bench_req;
+
+struct bench_thread {
+  pthread_t tid;
+  int       fd;
+  int       engine;   //0 blocking, 1 engine, 2 engine with a deep queue
+  int       write;
+  unsigned  seed;
+  int       errors;
+
+  //deep queue mode, requests come back through idle
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+  struct bench_req *idle;
+};
+
+struct bench_req {
+  struct jfs_uring_req io;
+  struct bench_thread *t;
+  struct bench_req    *next;
+  char                 buf[BENCH_BLOCK];
+};
+
+static double
+bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Random block reads, or random block writes with a periodic fdatasync.
+ */
+static void *
+bench_thread_func(void *arg)
+{
+  struct bench_thread *t = arg;
+  char buf[BENCH_BLOCK];
+
+  off_t offset;
+  ssize_t rc;
+  int i;
+
+  memset(buf, 'j', sizeof(buf));
+
+  for(i = 0; i < BENCH_OPS; ++i) {
+    offset = (off_t)(rand_r(&t->seed) % (BENCH_FILE_SIZE / BENCH_BLOCK)) * BENCH_BLOCK;
+
+    if(!t->write) {
+      rc = t->engine ? jfs_uring_pread(t->fd, buf, BENCH_BLOCK, offset)
+        : pread(t->fd, buf, BENCH_BLOCK, offset);
+    }
+    else {
+      rc = t->engine ? jfs_uring_pwrite(t->fd, buf, BENCH_BLOCK, offset)
+        : pwrite(t->fd, buf, BENCH_BLOCK, offset);
+
+      if(rc == BENCH_BLOCK && i % BENCH_SYNC_EVERY == 0) {
+        rc = t->engine ? jfs_uring_fsync(t->fd, 1) : fdatasync(t->fd);
+        rc = rc ? rc : BENCH_BLOCK;
+      }
+    }
+
+    if(rc != BENCH_BLOCK) {
+      t->errors++;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+bench_req_done(struct jfs_uring_req *io, ssize_t res)
+{
+  struct bench_req *r = (struct bench_req *)io;
+  struct bench_thread *t = r->t;
+
+  pthread_mutex_lock(&t->lock);
+  if(res != (io->op == jfs_uring_op_fdatasync ? 0 : BENCH_BLOCK)) {
+    t->errors++;
+  }
+  r->next = t->idle;
+  t->idle = r;
+  pthread_cond_signal(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+}
+
+/*
+ * Keep BENCH_DEPTH operations in flight from one thread, the way
+ * the low level backend drives the engine.
+ */
+static void *
+bench_deep_thread_func(void *arg)
+{
+  struct bench_thread *t = arg;
+  struct bench_req *reqs;
+  struct bench_req *r;
+
+  int idle;
+  int i;
+
+  reqs = calloc(BENCH_DEPTH, sizeof(*reqs));
+  if(!reqs) {
+    t->errors = BENCH_OPS;
+    return NULL;
+  }
+
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->cond, NULL);
+  t->idle = NULL;
+  for(i = 0; i < BENCH_DEPTH; ++i) {
+    reqs[i].t = t;
+    reqs[i].io.fd = t->fd;
+    reqs[i].io.buf = reqs[i].buf;
+    reqs[i].io.done = bench_req_done;
+    memset(reqs[i].buf, 'j', BENCH_BLOCK);
+    reqs[i].next = t->idle;
+    t->idle = &reqs[i];
+  }
+
+  for(i = 0; i < BENCH_OPS; ++i) {
+    pthread_mutex_lock(&t->lock);
+    while(!t->idle) {
+      pthread_cond_wait(&t->cond, &t->lock);
+    }
+    r = t->idle;
+    t->idle = r->next;
+    pthread_mutex_unlock(&t->lock);
+
+    r->io.offset = (off_t)(rand_r(&t->seed) % (BENCH_FILE_SIZE / BENCH_BLOCK)) * BENCH_BLOCK;
+    r->io.len = BENCH_BLOCK;
+    if(!t->write) {
+      r->io.op = jfs_uring_op_read;
+    }
+    else {
+      r->io.op = i % BENCH_SYNC_EVERY ? jfs_uring_op_write : jfs_uring_op_fdatasync;
+    }
+    jfs_uring_submit(&r->io);
+  }
+
+  //wait for every request to come back
+  pthread_mutex_lock(&t->lock);
+  for(;;) {
+    idle = 0;
+    for(r = t->idle; r; r = r->next) {
+      ++idle;
+    }
+    if(idle == BENCH_DEPTH) {
+      break;
+    }
+    pthread_cond_wait(&t->cond, &t->lock);
+  }
+  pthread_mutex_unlock(&t->lock);
+
+  pthread_cond_destroy(&t->cond);
+  pthread_mutex_destroy(&t->lock);
+  free(reqs);
+
+  return NULL;
+}
+
+static int
+bench_run(const char *name, int fd, int threads, int engine, int write)
+{
+  struct bench_thread *t;
+
+  double start;
+  double secs;
+  int errors;
+  int i;
+
+  t = calloc(threads, sizeof(*t));
+  if(!t) {
+    return -ENOMEM;
+  }
+
+  start = bench_now();
+  for(i = 0; i < threads; ++i) {
+    t[i].fd = fd;
+    t[i].engine = engine;
+    t[i].write = write;
+    t[i].seed = i + 1;
+    pthread_create(&t[i].tid, NULL, engine > 1 ? bench_deep_thread_func
+                   : bench_thread_func, &t[i]);
+  }
+
+  errors = 0;
+  for(i = 0; i < threads; ++i) {
+    pthread_join(t[i].tid, NULL);
+    errors += t[i].errors;
+  }
+  secs = bench_now() - start;
+  free(t);
+
+  printf("%-16s %-6s threads:%3d  %10.0f ops/s  %8.1f MB/s  errors:%d\n",
+         name, write ? "write" : "read", threads,
+         threads * BENCH_OPS / secs,
+         threads * (double)BENCH_OPS * BENCH_BLOCK / secs / (1024 * 1024),
+         errors);
+
+  return errors ? -EIO : 0;
+}
+
+/*
+ * Compares the io_uring engine against blocking pread/pwrite/fdatasync,
+ * with a thread per operation and with a few threads each keeping
+ * BENCH_DEPTH operations in flight.
+ *
+ * usage: jfs_uring_bench dir [threads]
+ * Errors are logged to dir/jfs_uring_bench.log.
+ * Point dir at a tmpfs or loop mount to take the disk out of the numbers.
+ */
+int main(int argc, char *argv[])
+{
+  char path[4096];
+  char log_path[4096];
+
+  int threads;
+  int fd;
+  int rc;
+  int i;
+
+  if(argc < 2) {
+    printf("usage: jfs_uring_bench dir [threads]\n");
+    return EXIT_FAILURE;
+  }
+  threads = argc > 2 ? atoi(argv[2]) : 8;
+
+  snprintf(log_path, sizeof(log_path), "%s/jfs_uring_bench.log", argv[1]);
+  joinfs_context.logpath = log_path;
+  log_init();
+
+  snprintf(path, sizeof(path), "%s/jfs_uring_bench.dat", argv[1]);
+  fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if(fd < 0 || ftruncate(fd, BENCH_FILE_SIZE)) {
+    printf("Could not create %s: %s\n", path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  rc = jfs_uring_init(BENCH_ENTRIES);
+  if(rc) {
+    printf("jfs_uring_init failed, error:%d\n", rc);
+    return EXIT_FAILURE;
+  }
+  printf("JoinFS io_uring bench, engine:%s\n",
+         jfs_uring_enabled() ? "io_uring" : "blocking fallback");
+
+  rc = 0;
+  for(i = 0; i < 2; ++i) {
+    rc |= bench_run("blocking", fd, threads, 0, i);
+    rc |= bench_run("engine", fd, threads, 1, i);
+    rc |= bench_run("engine deep", fd, BENCH_DEEP_THREADS, 2, i);
+  }
+
+  jfs_uring_destroy();
+  close(fd);
+  unlink(path);
+  log_destroy();
+
+  return rc ? EXIT_FAILURE : 0;
+}
@@ -18,8 +18,6 @@
 #define	_REENTRANT
 #endif
 
-#define QUERY_TIMEOUT 600000
-
 #include "sqlitedb.h"
 #include "error_log.h"
 #include "thr_pool.h"
@@ -29,6 +27,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <pthread.h>
+#include <string.h>
 #include <time.h>
 
 typedef struct timespec timestruc_t;
@@ -73,6 +72,7 @@ struct thr_pool {
 	int		         pool_nthreads;	/* current number of worker threads */
 	int		         pool_idle;	/* number of idle workers */
     int              sqlite_attr; /* sqlite connection attributes */
+	uint_t           pool_batch;	/* max jobs run in one transaction */
 };
 
 /* pool_flags */
@@ -170,9 +170,13 @@ worker_thread(void *arg)
 	active_t          active;
 	timestruc_t       ts;
 	struct jfs_db_op *db_op; 
+	struct jfs_db_op *batch[JFS_POOL_BATCH_MAX];
 	sqlite3          *db;
+	sqlite3_stmt     *stmt_cache[jfs_num_stmts];
 	int               rc;
+	int               num_ops;
     int               i;
+    int               j;
 	thr_pool_t *pool = (thr_pool_t *)arg;
 
 	/*
@@ -180,10 +184,21 @@ worker_thread(void *arg)
 	 */
 	rc = jfs_open_db(&db, pool->sqlite_attr);
     if(rc) {
+      /* leave the pool, without starting a replacement */
+      log_error("jfs_thread_pool---Failed to open a connection, error:%d\n", rc);
+      (void) pthread_mutex_lock(&pool->pool_mutex);
+      if(--pool->pool_nthreads == 0) {
+        (void) pthread_cond_broadcast(&pool->pool_busycv);
+      }
+      (void) pthread_mutex_unlock(&pool->pool_mutex);
       return NULL;
     }
 
-	sqlite3_busy_timeout(db, QUERY_TIMEOUT);
+	/*
+	 * Statements are prepared on first use and kept
+	 * for the lifetime of the worker's connection.
+	 */
+	memset(stmt_cache, 0, sizeof(stmt_cache));
 
 	/*
 	 * This is the worker's main loop.  It will only be left
@@ -232,45 +247,78 @@ worker_thread(void *arg)
         }
 		if((job = pool->pool_head) != NULL) {
           timedout = 0;
-          db_op = job->db_op;
-          pool->pool_head = job->job_next;
-          if(job == pool->pool_tail) {
-            pool->pool_tail = NULL;
+
+          /*
+           * Take the first job and, if the pool batches its jobs,
+           * every other queued job up to the batch limit.
+           */
+          num_ops = 0;
+          while(job != NULL && num_ops < pool->pool_batch) {
+            batch[num_ops++] = job->db_op;
+            pool->pool_head = job->job_next;
+            if(job == pool->pool_tail) {
+              pool->pool_tail = NULL;
+            }
+            free(job);
+            job = pool->pool_head;
           }
           active.active_next = pool->pool_active;
           pool->pool_active = &active;
           (void) pthread_mutex_unlock(&pool->pool_mutex);
           pthread_cleanup_push((void (*)(void *))job_cleanup,
                                (void *)pool);
-          free(job);
           
 		  /*
-		   * Perform the database operation.
+		   * Perform the database operations.
 		   */
-          pthread_mutex_lock(&db_op->mut);
-          db_op->db = db;
-          rc = jfs_query(db_op);
-          if(rc) {
-            if(db_op->op == jfs_multi_write_op) {
-              log_error("jfs_thread_pool---multi_write failed.\n");
-              for(i = 0; i < db_op->num_queries; ++i) {
-                log_error("jfs_thread_pool---Query:%s, error:%d\n", db_op->multi_query[i], rc);
+          for(i = 0; i < num_ops; ++i) {
+            batch[i]->db = db;
+            batch[i]->stmt_cache = stmt_cache;
+          }
+
+          if(num_ops > 1) {
+            jfs_query_group(batch, num_ops);
+          }
+          else {
+            batch[0]->rc = jfs_query(batch[0]);
+          }
+
+          for(i = 0; i < num_ops; ++i) {
+            db_op = batch[i];
+            rc = db_op->rc;
+            if(rc) {
+              if(db_op->num_bound) {
+                for(j = 0; j < db_op->num_bound; ++j) {
+                  log_error("jfs_thread_pool---Statement:%s, error:%d\n", 
+                            jfs_db_stmt_sql(db_op->bound[j].stmt_id), rc);
+                }
+              }
+              else {
+                log_error("jfs_thread_pool---Query:%s, error:%d\n", db_op->query, rc);
               }
             }
-            else {
-              log_error("jfs_thread_pool---Query:%s, error:%d\n", db_op->query, rc);
+          
+            /*
+             * Nobody waits on an op with a callback.
+             */
+            if(db_op->callback) {
+              db_op->db = NULL;
+              db_op->stmt_cache = NULL;
+              db_op->callback(db_op);
+              continue;
             }
+
+            /*
+             * Wake up the thread waiting on the job.
+             */
+            pthread_mutex_lock(&db_op->mut);
+            db_op->db = NULL;
+            db_op->stmt_cache = NULL;
+            db_op->done = 1;
+            pthread_cond_signal(&db_op->cond);
+            pthread_mutex_unlock(&db_op->mut);
           }
           
-          /*
-           * Wake up the thread waiting on the job.
-           */
-          db_op->db = NULL;
-          db_op->rc = rc;
-          db_op->done = 1;
-          pthread_cond_signal(&db_op->cond);
-          pthread_mutex_unlock(&db_op->mut);
-          
           /*
            * If the job function calls pthread_exit(), the thread
            * calls job_cleanup(pool) and worker_cleanup(pool);
@@ -289,8 +337,9 @@ worker_thread(void *arg)
 	}
     
 	/*
-	 * Cleanup the db connection.
+	 * Cleanup the cached statements and the db connection.
 	 */
+	jfs_db_stmt_cache_destroy(stmt_cache);
 	jfs_close_db(db);
     
 	pthread_cleanup_pop(1);	/* worker_cleanup(pool) */
@@ -364,6 +413,7 @@ jfs_pool_create(uint_t min_threads, uint_t max_threads, uint_t linger,
 	pool->pool_nthreads = 0;
 	pool->pool_idle = 0;
 	pool->sqlite_attr = sqlite_attr;
+	pool->pool_batch = 1;
 
 	/*
 	 * We cannot just copy the attribute pointer.
@@ -392,6 +442,33 @@ jfs_pool_create(uint_t min_threads, uint_t max_threads, uint_t linger,
 	return pool;
 }
 
+int
+jfs_pool_is_idle(thr_pool_t *pool)
+{
+	int idle;
+
+	(void) pthread_mutex_lock(&pool->pool_mutex);
+	idle = (pool->pool_head == NULL && pool->pool_active == NULL);
+	(void) pthread_mutex_unlock(&pool->pool_mutex);
+
+	return idle;
+}
+
+void
+jfs_pool_set_batch(thr_pool_t *pool, uint_t max_batch)
+{
+	if(max_batch < 1) {
+      max_batch = 1;
+    }
+	else if(max_batch > JFS_POOL_BATCH_MAX) {
+      max_batch = JFS_POOL_BATCH_MAX;
+    }
+
+	(void) pthread_mutex_lock(&pool->pool_mutex);
+	pool->pool_batch = max_batch;
+	(void) pthread_mutex_unlock(&pool->pool_mutex);
+}
+
 int
 jfs_pool_queue(thr_pool_t *pool, struct jfs_db_op *db_op)
 {